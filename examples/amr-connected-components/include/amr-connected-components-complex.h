@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 
 #include <dlog/stats.h>
 #include <dlog/log.h>
@@ -8,38 +9,36 @@
 #include <diy/link.hpp>
 #include <reeber/box.h>
 #include <reeber/amr_helper.h>
+#include <reeber/amr-edge-codec.h>
 #include "fab-cc-block.h"
 
 using AMRLink = diy::AMRLink;
 using AmrVertexId = reeber::AmrVertexId;
 using AmrEdgeContainer = reeber::AmrEdgeContainer;
 
+// every neighbor gets the active cells of b with edges to it and their deepest vertices (sparse face, no edges)
 template<class R, unsigned D>
-void send_edges_to_neighbors_cc(FabComponentBlock<R, D>* b, const diy::Master::ProxyWithLink& cp)
+void send_boundary_cells_to_neighbors_cc(FabComponentBlock<R, D>* b, const diy::Master::ProxyWithLink& cp)
 {
     auto* l = static_cast<diy::AMRLink*>(cp.link());
 
     for(const diy::BlockID& receiver : link_unique(l, b->gid))
     {
-        int receiver_gid = receiver.gid;
-        cp.enqueue(receiver, b->gid_to_outgoing_edges_[receiver_gid]);
-        cp.enqueue(receiver, b->vertex_to_deepest_);
+        b->boundary_cells(receiver.gid).save(cp.outgoing(receiver));
     }
 }
 
 template<class R, unsigned D>
 void delete_low_edges_cc(FabComponentBlock<R, D>* b, const diy::Master::ProxyWithLink& cp)
 {
-    using VertexVertexMap = typename FabComponentBlock<R, D>::VertexVertexMap;
+    using BoundaryCells = typename FabComponentBlock<R, D>::BoundaryCells;
     auto* l = static_cast<diy::AMRLink*>(cp.link());
 
     for(const diy::BlockID& sender : link_unique(l, b->gid))
     {
-        AmrEdgeContainer edges_from_neighbor;
-        VertexVertexMap received_vertex_to_deepest;
-        cp.dequeue(sender, edges_from_neighbor);
-        cp.dequeue(sender, received_vertex_to_deepest);
-        b->delete_low_edges(sender.gid, edges_from_neighbor, received_vertex_to_deepest);
+        BoundaryCells cells_from_neighbor;
+        cells_from_neighbor.load(cp.incoming(sender.gid));
+        b->delete_low_edges(sender.gid, cells_from_neighbor);
     }
     b->adjust_outgoing_edges();
 }
@@ -49,7 +48,7 @@ void expand_link(FabComponentBlock<Real, D>* b,
         const diy::Master::ProxyWithLink& cp,
         AMRLink* l,
         std::vector<AMRLink>& received_links,
-        std::unordered_set<int> needed_gids)
+        const typename FabComponentBlock<Real, D>::GidSet& needed_gids)
 {
     int n_added = 0;
     std::set<int> added_gids;
@@ -88,20 +87,30 @@ template<class Real, unsigned D>
 void amr_cc_send(FabComponentBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp)
 {
     using Component = typename FabComponentBlock<Real, D>::Component;
+    using AmrVertexSet = typename FabComponentBlock<Real, D>::AmrVertexSet;
 
     b->round_++;
 
     auto* l = static_cast<AMRLink*>(cp.link());
     auto receivers = link_unique(l, b->gid);
 
+    b->message_stats_.emplace_back();
+    MessageStats& stats = b->message_stats_.back();
+
+    // all components for one receiver go into one message:
+    // link, frame with the headers of the components, then trees and edges of those that send them
     for(const diy::BlockID& receiver : receivers)
     {
         diy::MemoryBuffer& out = cp.outgoing(receiver);
+        size_t start = out.position;
+
         diy::LinkFactory::save(out, l);
 
-        int n_sent = 0;
         int receiver_gid = receiver.gid;
 
+        std::vector<Component*> sent_components;
+        ComponentFrame<AmrVertexSet> frame;
+
         for(Component& c : b->components_)
         {
             if (c.is_done_sending())
@@ -110,21 +119,27 @@ void amr_cc_send(FabComponentBlock<Real, D>* b, const diy::Master::ProxyWithLink
             if (not c.must_send_to_gid(receiver_gid))
                 continue;
 
-            n_sent++;
+            sent_components.push_back(&c);
+            frame.add_component(c.original_deepest(), c.current_neighbors());
+        } // loop over components
+
+        diy::save(out, frame);
 
-            cp.enqueue(receiver, c.original_deepest());
-            cp.enqueue(receiver, c.current_neighbors());
-            int n_trees = c.must_send_tree_to_gid(receiver_gid);
-            cp.enqueue(receiver, n_trees);
+        for(Component* c : sent_components)
+        {
+            int n_trees = c->must_send_tree_to_gid(receiver_gid);
+            diy::save(out, n_trees);
             if (n_trees)
             {
-                cp.enqueue(receiver, c.tree_);
-                cp.enqueue(receiver, c.edges());
+                b->tree_store_.save(out, c->tree_);
+                reeber::AmrEdgeCodec::save(out, c->edges());
 #ifdef REEBER_EXTRA_INTEGRAL
-                cp.enqueue(receiver, c.extra_values());
+                diy::save(out, c->extra_values());
 #endif
             }
-        } // loop over components
+        }
+
+        stats.add(sent_components.size(), out.position - start);
     } // loop over receivers
 
     for(Component& c : b->components_)
@@ -138,7 +153,9 @@ void amr_cc_send(FabComponentBlock<Real, D>* b, const diy::Master::ProxyWithLink
 //                            });
 //                }))) throw std::runtime_error("not all neighbors are in link!");
 
+        b->n_obligations_ -= c.n_obligations();
         c.mark_all_gids_processed();
+        b->n_obligations_ += c.n_obligations();
     }
 }
 
@@ -190,34 +207,40 @@ void amr_cc_receive(FabComponentBlock<Real, D>* b, const diy::Master::ProxyWithL
         received_links.push_back(*l);
         delete l;
 
-        while(cp.incoming(sender.gid))
+        ComponentFrame<AmrVertexSet> frame;
+        diy::load(in, frame);
+
+        for(size_t k = 0; k < frame.size(); ++k)
         {
-            AmrVertexSet received_current_neighbors;
-            AmrVertexId received_original_deepest;
+            AmrVertexSet received_current_neighbors = frame.current_neighbors(k);
+            AmrVertexId received_original_deepest = frame.original_deepest(k);
             int received_n_trees;
-            TripletMergeTree received_tree;
             AmrEdgeContainer received_edges;
 
 #ifdef REEBER_EXTRA_INTEGRAL
             ExtraValues received_extra_values;
 #endif
-            cp.dequeue(sender, received_original_deepest);
-            cp.dequeue(sender, received_current_neighbors);
-            cp.dequeue(sender, received_n_trees);
+            diy::load(in, received_n_trees);
             total_received_trees += received_n_trees;
             if (received_n_trees)
             {
-                cp.dequeue(sender, received_tree);
-                cp.dequeue(sender, received_edges);
-#ifdef REEBER_EXTRA_INTEGRAL
-                cp.dequeue(sender, received_extra_values);
-#endif
-
 #ifdef REEBER_DO_DETAILED_TIMING
                 merge_call_timer.restart();
 #endif
+                // nodes of the received component go straight into the tree of the block
+                Block::TreeStore::load_into(in, b->merge_tree_);
+                reeber::AmrEdgeCodec::load(in, received_edges);
+#ifdef REEBER_EXTRA_INTEGRAL
+                diy::load(in, received_extra_values);
+#endif
 
-                r::merge(b->merge_tree_, received_tree, received_edges, true);
+                TripletMergeTree& mt = b->merge_tree_;
+                for(const reeber::AmrEdge& e : received_edges)
+                {
+                    if (mt.contains(std::get<0>(e)) and mt.contains(std::get<1>(e)))
+                        mt.merge(mt[std::get<0>(e)], mt[std::get<1>(e)]);
+                }
+                r::repair(mt);
 
                 for(auto e : received_edges)
                 {
@@ -274,31 +297,76 @@ void amr_cc_receive(FabComponentBlock<Real, D>* b, const diy::Master::ProxyWithL
 
     GidSet needed_gids;
 
-    // process internal components that are united after merging
+    if (received_deepest_vertices.empty())
     {
-        std::unordered_map<AmrVertexId, AmrVertexSet> global_deepest_to_neighbors;  // to accumulate current_neighbors of all local components that are in one global component
-        std::unordered_map<AmrVertexId, AmrVertexSet> global_deepest_to_original_deepests;
+        // nothing new arrived: connectivity did not change, and components that are connected
+        // already share their neighbors, so only mark the neighbors of every component as sent
+        for(Component& c : b->components_)
+        {
+            if (c.must_send_neighbors())
+            {
+                AmrVertexSet cn = c.current_neighbors();
+                b->n_obligations_ -= c.n_obligations();
+                c.set_current_neighbors(cn);
+                b->n_obligations_ += c.n_obligations();
+            }
+
+            for(const auto& deepest : c.current_neighbors())
+            {
+                needed_gids.insert(deepest.gid);
+            }
+        }
+    } else
+    {
+        // process internal components that are united after merging
+        using UnionFind = typename Block::UnionFind;
+        using Index = typename UnionFind::Index;
 
-        // collect all neighbors in merged components and corresponding roots
+        UnionFind& connectivity = b->connectivity_;
+
+        // current_neighbors of all local components that are in one global component
+        // are accumulated at the slot of its root in the union-find;
+        // every deepest vertex must be known to the union-find (index() throws otherwise)
+        std::vector<Index> component_roots;
+        component_roots.reserve(b->components_.size());
         for(const Component& c : b->components_)
         {
-            AmrVertexId original_deepest = c.original_deepest();
-            AmrVertexId global_deepest = b->vertex_to_deepest_.at(original_deepest);
-            global_deepest_to_neighbors[global_deepest].insert(c.current_neighbors().begin(),
+            component_roots.push_back(connectivity.find_root(connectivity.index(c.original_deepest())));
+        }
+
+        std::vector<Index> received_roots;
+        received_roots.reserve(received_root_to_components.size());
+        for(const auto& root_deepest_set_pair : received_root_to_components)
+        {
+            received_roots.push_back(connectivity.find_root(connectivity.index(root_deepest_set_pair.first)));
+        }
+
+        // one slot per distinct root
+        std::vector<Index> roots(component_roots);
+        roots.insert(roots.end(), received_roots.begin(), received_roots.end());
+        std::sort(roots.begin(), roots.end());
+        roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+        auto slot = [&roots](Index root) { return std::lower_bound(roots.begin(), roots.end(), root) - roots.begin(); };
+
+        std::vector<AmrVertexSet> root_to_neighbors(roots.size());
+
+        // collect all neighbors in merged components
+        for(size_t i = 0; i < b->components_.size(); ++i)
+        {
+            const Component& c = b->components_[i];
+            root_to_neighbors[slot(component_roots[i])].insert(c.current_neighbors().begin(),
                     c.current_neighbors().end());
-            global_deepest_to_original_deepests[global_deepest].insert(original_deepest);
         }
 
 #ifdef REEBER_DO_DETAILED_TIMING
         b->comps_loop_time += timer.elapsed();
         timer.restart();
 #endif
+        size_t received_idx = 0;
         for(const auto& root_deepest_set_pair : received_root_to_components)
         {
-            const AmrVertexId& original_deepest = root_deepest_set_pair.first;
-            AmrVertexId global_deepest = b->vertex_to_deepest_.at(original_deepest);
             const AmrVertexSet& cn = root_deepest_set_pair.second;
-            global_deepest_to_neighbors[global_deepest].insert(cn.begin(), cn.end());
+            root_to_neighbors[slot(received_roots[received_idx++])].insert(cn.begin(), cn.end());
         }
 
 #ifdef REEBER_DO_DETAILED_TIMING
@@ -307,19 +375,17 @@ void amr_cc_receive(FabComponentBlock<Real, D>* b, const diy::Master::ProxyWithL
 #endif
 
         // update current neighbors
-        for(const auto& deepest_roots_pair : global_deepest_to_original_deepests)
+        for(size_t i = 0; i < b->components_.size(); ++i)
         {
-            AmrVertexId global_deepest = deepest_roots_pair.first;
-            for(AmrVertexId original_deepest : deepest_roots_pair.second)
-            {
-                Component& c = b->get_component_by_deepest(original_deepest);
-                auto& cn = global_deepest_to_neighbors.at(global_deepest);
-                c.set_current_neighbors(cn);
+            Component& c = b->components_[i];
+            const AmrVertexSet& cn = root_to_neighbors[slot(component_roots[i])];
+            b->n_obligations_ -= c.n_obligations();
+            c.set_current_neighbors(cn);
+            b->n_obligations_ += c.n_obligations();
 
-                for(const auto& deepest : cn)
-                {
-                    needed_gids.insert(deepest.gid);
-                }
+            for(const auto& deepest : cn)
+            {
+                needed_gids.insert(deepest.gid);
             }
         }
 
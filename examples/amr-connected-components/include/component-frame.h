@@ -0,0 +1,160 @@
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <diy/serialization.hpp>
+
+#include <reeber/amr-vertex.h>
+#include <reeber/format.h>
+
+// Header of the message that carries all components a block sends to one gid in a round.
+// Original deepest vertices and current neighbors of the components are stored once,
+// in a vertex table, and components refer to them by index.
+// Components that belong to one merged component have the same current neighbors,
+// so sets of neighbors are stored once too.
+// Trees, edges and extra values of the components follow the header in the message.
+template<class AmrVertexSet>
+class ComponentFrame
+{
+public:
+    using AmrVertexId = reeber::AmrVertexId;
+    using Index = int;
+    using IndexVector = std::vector<Index>;
+
+    void add_component(const AmrVertexId& original_deepest, const AmrVertexSet& current_neighbors)
+    {
+        deepest_.push_back(vertex_index(original_deepest));
+
+        IndexVector neighbors;
+        neighbors.reserve(current_neighbors.size());
+        for(const AmrVertexId& v : current_neighbors)
+            neighbors.push_back(vertex_index(v));
+        std::sort(neighbors.begin(), neighbors.end());
+
+        auto iter = neighbor_set_index_.find(neighbors);
+        if (iter == neighbor_set_index_.end())
+        {
+            iter = neighbor_set_index_.emplace(neighbors, static_cast<Index>(n_neighbor_sets())).first;
+            neighbor_set_vertices_.insert(neighbor_set_vertices_.end(), neighbors.begin(), neighbors.end());
+            neighbor_set_offsets_.push_back(static_cast<Index>(neighbor_set_vertices_.size()));
+        }
+        neighbors_.push_back(iter->second);
+    }
+
+    size_t size() const { return deepest_.size(); }
+    bool empty() const { return deepest_.empty(); }
+
+    size_t n_vertices() const { return vertices_.size(); }
+    size_t n_neighbor_sets() const { return neighbor_set_offsets_.size() - 1; }
+
+    AmrVertexId original_deepest(size_t i) const { return vertices_[deepest_[i]]; }
+
+    AmrVertexSet current_neighbors(size_t i) const
+    {
+        AmrVertexSet result;
+        Index s = neighbors_[i];
+        for(Index j = neighbor_set_offsets_[s]; j < neighbor_set_offsets_[s + 1]; ++j)
+            result.insert(vertices_[neighbor_set_vertices_[j]]);
+        return result;
+    }
+
+private:
+    Index vertex_index(const AmrVertexId& v)
+    {
+        auto iter = vertex_index_.find(v);
+        if (iter != vertex_index_.end())
+            return iter->second;
+        Index i = static_cast<Index>(vertices_.size());
+        vertex_index_.emplace(v, i);
+        vertices_.push_back(v);
+        return i;
+    }
+
+    std::vector<AmrVertexId> vertices_;
+    IndexVector neighbor_set_vertices_;            // indices in vertices_ of all sets of neighbors, one after another
+    IndexVector neighbor_set_offsets_ { 0 };       // set s is [neighbor_set_offsets_[s], neighbor_set_offsets_[s + 1])
+    IndexVector deepest_;          // per component, index in vertices_
+    IndexVector neighbors_;        // per component, index of its set of neighbors
+
+    // used only while the frame is built, not sent
+    std::unordered_map<AmrVertexId, Index> vertex_index_;
+    std::map<IndexVector, Index> neighbor_set_index_;
+
+    friend diy::Serialization<ComponentFrame>;
+};
+
+// messages sent by a block in one round
+struct MessageStats
+{
+    size_t n_messages {0};           // one per receiver
+    size_t n_components {0};         // component payloads in them
+    size_t n_bytes {0};
+    std::vector<size_t> histogram;   // histogram[k] = number of messages of size in [2^k, 2^{k+1})
+
+    void add(size_t message_components, size_t message_bytes)
+    {
+        n_messages++;
+        n_components += message_components;
+        n_bytes += message_bytes;
+
+        size_t k = 0;
+        while((message_bytes >> (k + 1)) > 0)
+            k++;
+        if (histogram.size() <= k)
+            histogram.resize(k + 1, 0);
+        histogram[k]++;
+    }
+
+    MessageStats& operator+=(const MessageStats& other)
+    {
+        n_messages += other.n_messages;
+        n_components += other.n_components;
+        n_bytes += other.n_bytes;
+        if (histogram.size() < other.histogram.size())
+            histogram.resize(other.histogram.size(), 0);
+        for(size_t k = 0; k < other.histogram.size(); ++k)
+            histogram[k] += other.histogram[k];
+        return *this;
+    }
+
+    std::string to_string() const
+    {
+        std::string hist;
+        for(size_t k = 0; k < histogram.size(); ++k)
+        {
+            if (histogram[k])
+                hist += fmt::format(" {}B: {}", size_t(1) << k, histogram[k]);
+        }
+        return fmt::format("messages = {}, components = {}, bytes = {}, histogram:{}",
+                n_messages, n_components, n_bytes, hist);
+    }
+};
+
+namespace diy {
+    template<class AmrVertexSet>
+    struct Serialization<ComponentFrame<AmrVertexSet>> {
+        using Frame = ComponentFrame<AmrVertexSet>;
+
+        static void save(BinaryBuffer& bb, const Frame& f)
+        {
+            diy::save(bb, f.vertices_);
+            diy::save(bb, f.neighbor_set_vertices_);
+            diy::save(bb, f.neighbor_set_offsets_);
+            diy::save(bb, f.deepest_);
+            diy::save(bb, f.neighbors_);
+        }
+
+        static void load(BinaryBuffer& bb, Frame& f)
+        {
+            diy::load(bb, f.vertices_);
+            diy::load(bb, f.neighbor_set_vertices_);
+            diy::load(bb, f.neighbor_set_offsets_);
+            diy::load(bb, f.deepest_);
+            diy::load(bb, f.neighbors_);
+        }
+    };
+}
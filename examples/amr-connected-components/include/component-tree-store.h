@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <diy/serialization.hpp>
+
+#include "reeber/triplet-merge-tree.h"
+
+// Nodes of the local trees of all components of a block, kept in one array.
+// Nodes of one component are contiguous; a component refers to them by a View,
+// the range of their indices, instead of owning a TripletMergeTree.
+// A node is a triplet (vertex, saddle, parent) with the value of the vertex,
+// as in TripletMergeTree; saddle and parent of a node belong to the same component.
+template<class Vertex_, class Value_>
+class ComponentTreeStore
+{
+public:
+    using Vertex = Vertex_;
+    using Value = Value_;
+    using TripletMergeTree = reeber::TripletMergeTree<Vertex, Value>;
+
+    struct Node
+    {
+        Vertex vertex;
+        Value value;
+        Vertex s;
+        Vertex v;
+    };
+
+    struct View
+    {
+        size_t begin { 0 };
+        size_t end { 0 };
+
+        size_t size() const { return end - begin; }
+        bool empty() const { return begin == end; }
+    };
+
+    ComponentTreeStore(bool negate = false):
+            negate_(negate) {}
+
+    bool negate() const { return negate_; }
+
+    // nodes[i] belongs to component component_of[i] < n_components,
+    // return the views of the components; the order of nodes within a component is kept
+    std::vector<View> assign(const std::vector<Node>& nodes, const std::vector<size_t>& component_of, size_t n_components)
+    {
+        std::vector<View> views(n_components);
+
+        for(size_t c : component_of)
+            views[c].end++;
+
+        size_t start = 0;
+        for(View& view : views)
+        {
+            view.begin = start;
+            start += view.end;
+            view.end = view.begin;
+        }
+
+        nodes_.resize(nodes.size());
+        for(size_t i = 0; i < nodes.size(); ++i)
+            nodes_[views[component_of[i]].end++] = nodes[i];
+
+        return views;
+    }
+
+    const Node* begin(const View& view) const { return nodes_.data() + view.begin; }
+    const Node* end(const View& view) const { return nodes_.data() + view.end; }
+
+    size_t size() const { return nodes_.size(); }
+
+    // keep the nodes of view that satisfy special, together with the paths to their roots,
+    // as reeber::sparsify does for a TripletMergeTree; kept nodes are compacted to the front of the view
+    template<class Special>
+    void sparsify(View& view, const Special& special)
+    {
+        std::unordered_map<Vertex, size_t> index;
+        index.reserve(view.size());
+        for(size_t i = view.begin; i < view.end; ++i)
+            index[nodes_[i].vertex] = i;
+
+        std::unordered_set<Vertex> keep;
+        for(size_t i = view.begin; i < view.end; ++i)
+        {
+            if (not special(nodes_[i].vertex))
+                continue;
+
+            size_t u = i;
+            while(true)
+            {
+                keep.insert(nodes_[u].vertex);
+                keep.insert(nodes_[u].s);
+                if (keep.count(nodes_[u].v))
+                    break;
+                u = index.at(nodes_[u].v);
+            }
+        }
+
+        size_t new_end = view.begin;
+        for(size_t i = view.begin; i < view.end; ++i)
+        {
+            if (keep.count(nodes_[i].vertex))
+                nodes_[new_end++] = nodes_[i];
+        }
+        view.end = new_end;
+    }
+
+    // drop the nodes that are not in any of the views (left behind by sparsify), adjust the views
+    template<class Views>
+    void shrink(Views& views)
+    {
+        size_t new_end = 0;
+        for(View* view : views)
+        {
+            size_t new_begin = new_end;
+            for(size_t i = view->begin; i < view->end; ++i)
+                nodes_[new_end++] = nodes_[i];
+            view->begin = new_begin;
+            view->end = new_end;
+        }
+        nodes_.resize(new_end);
+        nodes_.shrink_to_fit();
+    }
+
+    // same layout as the serialization of a TripletMergeTree without vertices,
+    // so the view can be loaded as a TripletMergeTree or merged by load_into
+    void save(diy::BinaryBuffer& bb, const View& view) const
+    {
+        bool save_vertices = false;
+        diy::save(bb, save_vertices);
+        diy::save(bb, negate_);
+        size_t sz = view.size();
+        diy::save(bb, sz);
+        for(const Node* n = begin(view); n != end(view); ++n)
+        {
+            diy::save(bb, n->vertex);
+            diy::save(bb, n->value);
+            diy::save(bb, n->s);
+            diy::save(bb, n->v);
+        }
+    }
+
+    // add the nodes of a saved tree directly to mt;
+    // nodes that mt already has keep their value and parent: mt comes first, as mt1 in reeber::merge
+    static void load_into(diy::BinaryBuffer& bb, TripletMergeTree& mt)
+    {
+        using Neighbor = typename TripletMergeTree::Neighbor;
+        using VerticesVector = typename TripletMergeTree::Node::VerticesVector;
+
+        bool load_vertices;
+        bool negate;
+        size_t sz;
+        diy::load(bb, load_vertices);
+        diy::load(bb, negate);
+        diy::load(bb, sz);
+
+        std::vector<Node> nodes(sz);
+        std::vector<VerticesVector> vertices(load_vertices ? sz : 0);
+        for(size_t i = 0; i < sz; ++i)
+        {
+            diy::load(bb, nodes[i].vertex);
+            diy::load(bb, nodes[i].value);
+            diy::load(bb, nodes[i].s);
+            diy::load(bb, nodes[i].v);
+            if (load_vertices)
+                diy::load(bb, vertices[i]);
+        }
+
+        std::vector<char> existing(sz);
+        for(size_t i = 0; i < sz; ++i)
+            existing[i] = mt.contains(nodes[i].vertex);
+
+        for(size_t i = 0; i < sz; ++i)
+        {
+            if (existing[i])
+                continue;
+
+            Neighbor n_u = mt.add_or_update(nodes[i].vertex, nodes[i].value);
+            Neighbor n_s = mt.find_or_add(nodes[i].s, 0);
+            Neighbor n_v = mt.find_or_add(nodes[i].v, 0);
+            mt.link(n_u, n_s, n_v);
+
+            if (load_vertices)
+                n_u->vertices = std::move(vertices[i]);
+        }
+    }
+
+private:
+    bool negate_;
+    std::vector<Node> nodes_;
+};
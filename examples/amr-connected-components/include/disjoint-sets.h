@@ -1,20 +1,27 @@
 #pragma once
 
 #include <vector>
+#include <cassert>
 #include <unordered_map>
 
 #include <reeber/format.h>
 
 #include <diy/serialization.hpp>
 
+// Union-find over compact indices: every vertex gets an index when its component is made,
+// parents and sizes live in arrays indexed by it.
+// Union by size, path halving in find; the only hash lookup is vertex -> index,
+// once per query.
 template<class Vertex_>
 struct DisjointSets {
     using Vertex = Vertex_;
-    using VertexVertexMap = std::unordered_map<Vertex, Vertex>;
-    using VertexSizeMap = std::unordered_map<Vertex, int>;
+    using Index = int;
+    using VertexIndexMap = std::unordered_map<Vertex, Index>;
 
-    VertexVertexMap parent_;
-    VertexSizeMap size_;
+    VertexIndexMap index_;
+    std::vector<Vertex> vertices_;
+    std::vector<Index> parent_;
+    std::vector<int> size_;
 
     DisjointSets()
     {}
@@ -24,70 +31,93 @@ struct DisjointSets {
     {
         for(const auto& v : vc)
         {
-            create_component(v);
+            make_component_if_not_exists(v);
         }
     }
 
-    void make_component(const Vertex& v)
+    Index make_component(const Vertex& v)
     {
-        assert(parent_.count(v) == 0);
-        parent_[v] = v;
-        size_[v] = 1;
+        assert(index_.count(v) == 0);
+        Index i = static_cast<Index>(vertices_.size());
+        index_[v] = i;
+        vertices_.push_back(v);
+        parent_.push_back(i);
+        size_.push_back(1);
+        return i;
     }
 
-    void make_component_if_not_exists(const Vertex& v)
+    Index make_component_if_not_exists(const Vertex& v)
     {
-        if (!has_component(v))
+        auto iter = index_.find(v);
+        if (iter != index_.end())
         {
-            make_component(v);
+            return iter->second;
         }
+        return make_component(v);
     }
 
     bool has_component(const Vertex& v) const
     {
-        return parent_.count(v) == 1;
+        return index_.count(v) == 1;
     }
 
-    bool are_connected(const Vertex& a, const Vertex_& b)
+    // number of vertices (not of components)
+    size_t size() const
     {
-        return find_component(a) == find_component(a);
+        return vertices_.size();
     }
 
-    bool are_connected(const Vertex& a, const Vertex_& b) const
+    Index index(const Vertex& v) const
     {
-        return find_component(a) == find_component(a);
+        return index_.at(v);
     }
 
-    Vertex find_component(const Vertex& a)
+    const Vertex& vertex(Index i) const
     {
-        Vertex x = a;
-        bool debug = false;
-        while(parent_.at(x) != x)
+        return vertices_[i];
+    }
+
+    Index find_root(Index x)
+    {
+        while(parent_[x] != x)
         {
-            auto next = parent_[x];
-            if (debug) fmt::print("in find_component_in_disjoint_sets, x = {}, next = {}\n", x, next);
-            parent_[x] = parent_.at(next);
-            x = next;
+            parent_[x] = parent_[parent_[x]];
+            x = parent_[x];
         }
-        if (debug) fmt::print("Exiting find_component_in_disjoint_sets, x = {}\n", x);
         return x;
     }
 
     // no path compression
-    Vertex find_component(const Vertex& a) const
+    Index find_root(Index x) const
     {
-        Vertex x = a;
-        bool debug = false;
-        while(parent_.at(x) != x)
+        while(parent_[x] != x)
         {
-            x = parent_.at(x);
-            if (debug) fmt::print("in find_component_in_disjoint_sets, x = {}\n", x);
+            x = parent_[x];
         }
-        if (debug) fmt::print("Exiting find_component_in_disjoint_sets, x = {}\n", x);
         return x;
     }
 
-    Vertex unite_components_by_roots(Vertex a_root, Vertex b_root)
+    bool are_connected(const Vertex& a, const Vertex_& b)
+    {
+        return find_root(index(a)) == find_root(index(b));
+    }
+
+    bool are_connected(const Vertex& a, const Vertex_& b) const
+    {
+        return find_root(index(a)) == find_root(index(b));
+    }
+
+    Vertex find_component(const Vertex& a)
+    {
+        return vertices_[find_root(index(a))];
+    }
+
+    Vertex find_component(const Vertex& a) const
+    {
+        return vertices_[find_root(index(a))];
+    }
+
+    Index unite_roots(Index a_root, Index b_root)
     {
         bool debug = false;
         if (a_root == b_root)
@@ -100,28 +130,29 @@ struct DisjointSets {
         }
         parent_[b_root] = a_root;
         size_[a_root] += size_[b_root];
-        if (debug) fmt::print("Successfully united roots {} and {}\n", a_root, b_root);
+        if (debug) fmt::print("Successfully united roots {} and {}\n", vertices_[a_root], vertices_[b_root]);
         return a_root;
     }
 
+    Vertex unite_components_by_roots(const Vertex& a_root, const Vertex& b_root)
+    {
+        return vertices_[unite_roots(index(a_root), index(b_root))];
+    }
+
     void unite_components(const Vertex& a, const Vertex& b)
     {
-        auto a_root = find_component(a);
-        auto b_root = find_component(b);
-        unite_components_by_roots(a_root, b_root);
+        unite_roots(find_root(index(a)), find_root(index(b)));
     }
 
     std::vector<Vertex> component_of(const Vertex& a)
     {
         std::vector<Vertex> result;
-        auto root = find_component(a);
-        // loop over size map just because it is a simple way of looping over all vertices
-        for(const auto& v_size_pair : size_)
+        Index root = find_root(index(a));
+        for(Index i = 0; i < static_cast<Index>(vertices_.size()); ++i)
         {
-            const Vertex& v = v_size_pair.first;
-            if (find_component(v) == root)
+            if (find_root(i) == root)
             {
-                result.push_back(v);
+                result.push_back(vertices_[i]);
             }
         }
         return result;
@@ -135,15 +166,22 @@ namespace diy {
 
         static void save(BinaryBuffer& bb, const DS& disjoint_sets)
         {
+            diy::save(bb, disjoint_sets.vertices_);
             diy::save(bb, disjoint_sets.parent_);
             diy::save(bb, disjoint_sets.size_);
         }
 
         static void load(BinaryBuffer& bb, DS& disjoint_sets)
         {
+            diy::load(bb, disjoint_sets.vertices_);
             diy::load(bb, disjoint_sets.parent_);
             diy::load(bb, disjoint_sets.size_);
 
+            disjoint_sets.index_.clear();
+            for(size_t i = 0; i < disjoint_sets.vertices_.size(); ++i)
+            {
+                disjoint_sets.index_[disjoint_sets.vertices_[i]] = static_cast<typename DS::Index>(i);
+            }
         }
     };
 }
@@ -179,4 +217,3 @@ namespace diy {
 //
 //
 //}
-
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <utility>
+#include <memory>
 #include <numeric>
 #include <stack>
 #include <boost/functional/hash.hpp>
@@ -12,6 +13,7 @@
 #include <diy/master.hpp>
 
 #include "disjoint-sets.h"
+#include "component-frame.h"
 
 #include "reeber/format.h"
 
@@ -19,9 +21,12 @@
 #include "reeber/triplet-merge-tree.h"
 #include "reeber/triplet-merge-tree-serialization.h"
 #include "reeber/grid.h"
+#include "reeber/linear-combination.h"
 #include "reeber/grid-serialization.h"
 #include "reeber/masked-box.h"
+#include "reeber/amr-link-index.h"
 #include "reeber/edges.h"
+#include "reeber/amr-boundary-cells.h"
 
 #include "../../amr-merge-tree/include/fab-block.h"
 #include "reeber/amr_helper.h"
@@ -36,6 +41,7 @@ struct FabComponentBlock {
 
     using Grid = r::Grid<Real, D>;
     using GridRef = r::GridRef<Real, D>;
+    using Function = r::LinearCombination<Real, D>;       // sum of function fields, evaluated on the fly
 
     using Component = FabConnectedComponent<Real>;
 
@@ -61,10 +67,16 @@ struct FabComponentBlock {
 
     using RealType = Real;
 
-//    using UnionFind = typename Component::UnionFind;
+    using UnionFind = typename Component::UnionFind;
     using VertexVertexMap = std::map<AmrVertexId, AmrVertexId>;
+    // active boundary cells with their deepest vertices
+    using BoundaryCells = r::AmrBoundaryCells<AmrVertexId>;
 //    using VertexSizeMap = typename UnionFind::VertexSizeMap;
 
+    using TreeStore = typename Component::TreeStore;
+    using TreeView = typename Component::TreeView;
+    using TreeNode = typename TreeStore::Node;
+
     using Neighbor = typename TripletMergeTree::Neighbor;
     using Node = typename TripletMergeTree::Node;
     using VertexNeighborMap =typename TripletMergeTree::VertexNeighborMap;
@@ -78,12 +90,12 @@ struct FabComponentBlock {
 
     int gid;
     MaskedBox local_;
-    GridRef fab_;
+    Function fab_;
 
     // if relative threshold is given, we cannot determine
     // LOW values in constructor. Instead, we mark all unmasked vertices
     // ACTIVE and save the average of their values in local_sum_ and the number in local_n_unmasked_
-    // Pointer to grid data is saved in fab_ and after all blocks exchange their local averages
+    // Function (references to grid data) is saved in fab_ and after all blocks exchange their local averages
     // we resume initialization
     Real sum_{0};
     size_t n_active_ {0};
@@ -109,8 +121,10 @@ struct FabComponentBlock {
 
 //    UnionFind disjoint_sets_;   // keep topology of graph of connected components
     std::vector<Component> components_;
+    TreeStore tree_store_;      // nodes of the local trees of components_
 
     VertexVertexMap vertex_to_deepest_;
+    UnionFind connectivity_;    // original deepest vertices of components known to the block, united, if connected
 
     diy::DiscreteBounds domain_ { D };
     // physical domain at the level of this block
@@ -118,6 +132,7 @@ struct FabComponentBlock {
     Real cell_volume_ { 1 };
 
     int done_{0};
+    size_t n_obligations_ {0};  // sum of n_obligations() of components_, updated where they change
 
     std::unordered_map<int, AmrEdgeContainer> gid_to_outgoing_edges_;
 
@@ -130,6 +145,8 @@ struct FabComponentBlock {
 
     int round_{0};
 
+    std::vector<MessageStats> message_stats_;   // message_stats_[r]: messages sent in round r + 1
+
     int max_gid_ {0};
 
 #ifdef REEBER_EXTRA_INTEGRAL
@@ -186,7 +203,7 @@ struct FabComponentBlock {
     int level() const
     { return local_.level(); }
 
-    FabComponentBlock(diy::GridRef<Real, D>& fab_grid,
+    FabComponentBlock(const Function& fab_grid,
                       std::vector<std::string>& extra_names,
                       std::vector<diy::GridRef<Real, D>>& extra_grids,
                       int _ref,
@@ -202,8 +219,7 @@ struct FabComponentBlock {
                       bool is_absolute_threshold,
                       Real cell_volume);
 
-    FabComponentBlock() :
-            fab_(nullptr, diy::Point<int, D>::zero())
+    FabComponentBlock()
     {}
 
     void init(Real absolute_rho, diy::AMRLink *amr_link, bool must_set_low);
@@ -216,6 +232,7 @@ struct FabComponentBlock {
 
     void set_mask(const diy::Point<int, D>& v_mask,
                   diy::AMRLink *l,
+                  const r::AmrLinkIndex<D>& link_index,
                   const Real& rho,
                   bool is_absolute_threshold);
 
@@ -223,8 +240,10 @@ struct FabComponentBlock {
 
     void compute_original_connected_components(const VertexEdgesMap& vertex_to_outgoing_edges);
 
-    void delete_low_edges(int sender_gid, AmrEdgeContainer& edges_from_sender,
-                          const VertexVertexMap& received_vertex_to_deepest);
+    // active cells of this block with edges to receiver, what delete_low_edges of receiver needs
+    BoundaryCells boundary_cells(int receiver_gid) const;
+
+    void delete_low_edges(int sender_gid, const BoundaryCells& cells_from_sender);
 
 //
     void adjust_outgoing_edges();
@@ -236,6 +255,7 @@ struct FabComponentBlock {
     int get_n_components_for_gid(int gid) const;
 
     int are_all_components_done() const;
+    size_t count_obligations() const;
 
     bool is_deepest_computed(const AmrVertexId& v) const;
 
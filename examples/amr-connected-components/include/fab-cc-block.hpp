@@ -1,5 +1,5 @@
 template<class Real, unsigned D>
-FabComponentBlock<Real, D>::FabComponentBlock(diy::GridRef<Real, D>& fab_grid,
+FabComponentBlock<Real, D>::FabComponentBlock(const Function& fab_grid,
         std::vector<std::string>& extra_names,
         std::vector<diy::GridRef<Real, D>>& extra_grids,
         int _ref,
@@ -16,9 +16,9 @@ FabComponentBlock<Real, D>::FabComponentBlock(diy::GridRef<Real, D>& fab_grid,
         Real cell_volume)
         :
         gid(_gid),
-        local_(project_point<D>(core.min), project_point<D>(core.max), project_point<D>(bounds.min),
-                project_point<D>(bounds.max), _ref, _level, gid, fab_grid.c_order()),
-        fab_(fab_grid.data(), fab_grid.shape(), fab_grid.c_order()),
+        local_(point_from_dynamic_point<D>(core.min), point_from_dynamic_point<D>(core.max), point_from_dynamic_point<D>(bounds.min),
+                point_from_dynamic_point<D>(bounds.max), _ref, _level, gid, fab_grid.c_order()),
+        fab_(fab_grid),
         domain_(_domain),
         cell_volume_(cell_volume),
         negate_(_negate),
@@ -33,8 +33,11 @@ FabComponentBlock<Real, D>::FabComponentBlock(diy::GridRef<Real, D>& fab_grid,
     assert(cell_volume_ > 0);
     std::string debug_prefix = "FabComponentBlock ctor, gid = " + std::to_string(gid);
 
-    diy::for_each(local_.mask_shape(), [this, amr_link, rho, is_absolute_threshold](const Vertex& v) {
-        this->set_mask(v, amr_link, rho, is_absolute_threshold);
+    r::AmrLinkIndex<D> link_index(amr_link, local_.level(), local_.refinement(), local_.mask_from(),
+                                  local_.mask_shape(), domain_, local_.c_order());
+
+    diy::for_each(local_.mask_shape(), [this, amr_link, &link_index, rho, is_absolute_threshold](const Vertex& v) {
+        this->set_mask(v, amr_link, link_index, rho, is_absolute_threshold);
     });
 
 #ifdef REEBER_ENABLE_CHECKS
@@ -66,11 +69,10 @@ bool FabComponentBlock<Real, D>::cmp(Real a, Real b) const
 template<class Real, unsigned D>
 void FabComponentBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
         diy::AMRLink* l,
+        const r::AmrLinkIndex<D>& link_index,
         const Real& rho,
         bool is_absolute_threshold)
 {
-    using Position = diy::Point<int, D>;
-
     int debug_gid = local_.gid();
 
     bool debug = false;
@@ -110,52 +112,17 @@ void FabComponentBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
         local_.set_mask(v_mask, MaskedBox::ACTIVE);
     }
 
-    const int v_ref = local_.refinement();
-    const int v_level = local_.level();
-
-    Position v_glob = wrap_point(v_mask + local_.mask_from(), domain_, v_ref, true);
-
     bool mask_set{false};
 
-    // loop over neighbouring blocks one level above
-    for(int i = 0; i < l->size(); ++i)
-        if (l->level(i) == v_level + 1 && neighbor_contains<D>(i, l, v_glob, v_ref))
-        {
-            mask_set = true;
-            local_.set_mask(v_mask, l->target(i).gid);
-            if (not is_ghost)
-                n_masked_++;
-            break;
-        }
-
-    // real cells can only be masked by blocks above, only ghost cells need to look at same level and below
-    if (not mask_set and is_ghost)
+    // blocks one level above mask real and ghost cells, blocks on the same level and one level below
+    // only ghost cells (this is not actual masking, but we save this info in ghost cells to get outgoing edges)
+    int owner_idx = link_index.owner(v_mask, is_ghost);
+    if (owner_idx >= 0)
     {
-        // loop over neighbours on the same level
-        for(int i = 0; i < l->size(); ++i)
-        {
-            if (l->level(i) == v_level && neighbor_contains<D>(i, l, v_glob, v_ref))
-            {
-                mask_set = true;
-                local_.set_mask(v_mask, l->target(i).gid);
-                break;
-            }
-        }
-    }
-
-    // loop over neighbours one level below. This is not actual masking,
-    // but we save this info in ghost cells to get outgoing edges.
-    if (not mask_set and is_ghost)
-    {
-        for(int i = 0; i < l->size(); ++i)
-        {
-            if (l->level(i) == v_level - 1 && neighbor_contains<D>(i, l, v_glob, v_ref))
-            {
-                mask_set = true;
-                local_.set_mask(v_mask, l->target(i).gid);
-                break;
-            }
-        }
+        mask_set = true;
+        local_.set_mask(v_mask, l->target(owner_idx).gid);
+        if (not is_ghost)
+            n_masked_++;
     }
 
     if (not mask_set and is_low)
@@ -271,17 +238,21 @@ void FabComponentBlock<Real, D>::sparsify_prune_original_tree(const VertexEdgesM
 {
 #ifndef REEBER_NO_SPARSIFICATION
 
+    std::vector<TreeView*> views;
+    views.reserve(components_.size());
     for(Component& c : components_)
     {
-        c.sparsify(vertex_to_outgoing_edges);
+        c.sparsify(tree_store_, vertex_to_outgoing_edges);
+        views.push_back(&c.tree_);
     }
+    tree_store_.shrink(views);
 #endif
 }
 
 template<unsigned D>
 r::AmrEdgeContainer
 get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& local, diy::AMRLink* l,
-        const diy::DiscreteBounds& domain, bool wrap)
+        const diy::DiscreteBounds& domain, bool wrap, const r::AmrLinkIndex<D>* link_index = nullptr)
 {
     using Position = diy::Point<int, D>;
 
@@ -294,10 +265,20 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
 
     r::AmrEdgeContainer result;
 
+    // without a prebuilt index, index the link here
+    std::unique_ptr<r::AmrLinkIndex<D>> own_link_index;
+    if (not link_index)
+    {
+        own_link_index.reset(new r::AmrLinkIndex<D>(l));
+        link_index = own_link_index.get();
+    }
+
+    const Position period = domain_period<D>(domain, local.refinement());
+
     for(const Position& neighb_v_glob : local.outer_edge_link(v_glob))
     {
         // TODO: add wrap to MaskedBox and return only domain vertices in outer_edge_link?
-        if (not wrap and not point_in_domain(neighb_v_glob, domain, local.refinement())) {
+        if (not wrap and not point_in_domain(neighb_v_glob, period)) {
             if (debug) { fmt::print("neighb_v_glob = {} not in domain, continue\n", v_glob, v_glob_idx, local); }
             continue;
         }
@@ -310,7 +291,7 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
                     local.gid(), neighb_v_bounds, neighb_v_glob);
         }
 
-        Position wrapped_neighb_vert_glob = wrap_point(neighb_v_glob, domain, local.refinement());
+        Position wrapped_neighb_vert_glob = wrap_point(neighb_v_glob, period);
 
         Position neighb_v_mask = local.mask_position_from_local(neighb_v_bounds);
         int masking_gid = local.mask(neighb_v_mask);
@@ -323,27 +304,19 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
         }
 #endif
 
-        size_t link_idx = 0;
-        bool link_idx_found = false;
-        for(; link_idx < (size_t) l->size(); ++link_idx)
-        {
-            if (l->target(link_idx).gid == masking_gid)
-            {
-                link_idx_found = true;
-                break;
-            }
-        }
+        int link_idx = link_index->link_index(masking_gid);
+        bool link_idx_found = link_idx >= 0;
 
         if (not link_idx_found)
         {
             throw std::runtime_error("masking_gid not found in link");
         }
 
-        auto nb_level = l->level(link_idx);
-        Position nb_from = point_from_dynamic_point<D>(l->bounds(link_idx).min);
-        Position nb_to = point_from_dynamic_point<D>(l->bounds(link_idx).max);
-        // TODO: vector refinement
-        int nb_refinement = l->refinement(link_idx)[0];
+        const LinkBox<D>& nb = link_index->box(link_idx);
+        auto nb_level = nb.level;
+        const Position& nb_from = nb.bounds_from;
+        const Position& nb_to = nb.bounds_to;
+        int nb_refinement = nb.refinement;
 
         if (debug)
         {
@@ -359,8 +332,7 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
         {
             // neighbour is on the same level or below me, neighbouring vertex corresponds
             // to the unique vertex in a neighbouring block
-            size_t neighb_vertex_idx = get_vertex_id(wrapped_neighb_vert_glob, local.refinement(), link_idx, l,
-                    local.mask_grid().c_order());
+            size_t neighb_vertex_idx = get_vertex_id(wrapped_neighb_vert_glob, local.refinement(), nb, local.c_order());
 
             result.emplace_back(v_glob_idx, reeber::AmrVertexId{masking_gid, neighb_vertex_idx});
 
@@ -373,9 +345,11 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
 
         } else if (nb_level > local.level())
         {
+            RefinementRatio ratio(nb_refinement, local.refinement());
+            Position nb_period = ratio.refine(period);
+
             Position masking_box_from, masking_box_to;
-            std::tie(masking_box_from, masking_box_to) = refine_vertex(neighb_v_glob, local.refinement(),
-                    nb_refinement);
+            std::tie(masking_box_from, masking_box_to) = refine_vertex(neighb_v_glob, ratio);
             if (debug)
                 fmt::print(
                         "In get_vertex_edges, v_glob = {}, masking_gid = {}, masking_box_from = {}, masking_box_to = {}\n",
@@ -388,10 +362,7 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
             {
                 for(Position covering_position_glob : covering_box.position_link(masking_position))
                 {
-                    Position covering_position_coarsened = wrap_point(
-                            coarsen_point(covering_position_glob, nb_refinement,
-                                    local.refinement()),
-                            domain, local.refinement());
+                    Position covering_position_coarsened = wrap_point(ratio.coarsen(covering_position_glob), period);
                     if (debug)
                     {
                         fmt::print(
@@ -403,11 +374,9 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
                     if (covering_position_coarsened == v_glob)
                     {
 
-                        Position masking_position_global = wrap_point(masking_position, domain, nb_refinement);
+                        Position masking_position_global = wrap_point(masking_position, nb_period);
                         r::AmrVertexId masking_vertex_idx{masking_gid,
-                                                          get_vertex_id(masking_position_global, nb_refinement,
-                                                                  link_idx, l,
-                                                                  local.mask_grid().c_order())};
+                                                          get_vertex_id(masking_position_global, nb_refinement, nb, local.c_order())};
 
                         if (debug)
                         {
@@ -430,9 +399,10 @@ template<class Real, unsigned D>
 void FabComponentBlock<Real, D>::compute_outgoing_edges(diy::AMRLink* l, VertexEdgesMap& vertex_to_outgoing_edges)
 {
     bool debug = false;
+    r::AmrLinkIndex<D> link_index(l);
     for(const Vertex& v_glob : local_.active_global_positions())
     {
-        AmrEdgeContainer out_edges = get_vertex_edges(v_glob, local_, l, domain(), wrap_);
+        AmrEdgeContainer out_edges = get_vertex_edges(v_glob, local_, l, domain(), wrap_, &link_index);
         if (debug) for(auto&& e : out_edges) fmt::print("outogoing edge e = {} {}\n", std::get<0>(e), std::get<1>(e));
 
         if (not out_edges.empty())
@@ -448,12 +418,25 @@ void FabComponentBlock<Real, D>::compute_outgoing_edges(diy::AMRLink* l, VertexE
     }
 }
 
+template<class Real, unsigned D>
+typename FabComponentBlock<Real, D>::BoundaryCells FabComponentBlock<Real, D>::boundary_cells(int receiver_gid) const
+{
+    BoundaryCells result;
+    auto iter = gid_to_outgoing_edges_.find(receiver_gid);
+    if (iter != gid_to_outgoing_edges_.end())
+    {
+        for(const AmrEdge& e : iter->second)
+            result.add(std::get<0>(e).vertex, vertex_to_deepest_.at(std::get<0>(e)));
+    }
+    result.sort();
+    return result;
+}
+
 // delete edges from this block that end in a low vertex of a neighbor block.
-// edges_from_gid: outogoing eddes we receive from a neigbor block
-// subtract them from the edges we keep in gid_to_outgoing_edges_
+// cells_from_sender: active cells of the neighbor with edges to this block, with their deepest vertices;
+// an edge is kept, if it ends in one of them (the neighbor has the reverse edge then)
 template<class Real, unsigned D>
-void FabComponentBlock<Real, D>::delete_low_edges(int sender_gid, AmrEdgeContainer& edges_from_sender,
-        const VertexVertexMap& received_vertex_to_deepest)
+void FabComponentBlock<Real, D>::delete_low_edges(int sender_gid, const BoundaryCells& cells_from_sender)
 {
     auto iter = gid_to_outgoing_edges_.find(sender_gid);
     if (iter == gid_to_outgoing_edges_.end())
@@ -462,23 +445,19 @@ void FabComponentBlock<Real, D>::delete_low_edges(int sender_gid, AmrEdgeContain
         return;  // we don't expect any edges from gid
     }
 
-    // edges from neighbor come reversed, correct that
-    std::transform(edges_from_sender.begin(), edges_from_sender.end(), edges_from_sender.begin(),
-            &reeber::reverse_amr_edge);
-
-    // put edges into set to find the set difference
-    std::set<AmrEdge> my_edges{iter->second.begin(), iter->second.end()};
-    std::set<AmrEdge> neighbor_edges{edges_from_sender.begin(), edges_from_sender.end()};
+    AmrEdgeContainer& my_edges = iter->second;
 
     int old_n_edges = my_edges.size();
     (void) old_n_edges; // suppress warning
 
-    iter->second.clear();
+    // sorted and without duplicates, as before
+    std::sort(my_edges.begin(), my_edges.end());
+    my_edges.erase(std::unique(my_edges.begin(), my_edges.end()), my_edges.end());
+    my_edges.erase(std::remove_if(my_edges.begin(), my_edges.end(),
+            [&cells_from_sender](const AmrEdge& e) { return not cells_from_sender.contains(std::get<1>(e).vertex); }),
+            my_edges.end());
 
-    std::set_intersection(my_edges.begin(), my_edges.end(), neighbor_edges.begin(), neighbor_edges.end(),
-            std::back_inserter(iter->second));
-
-    int new_n_edges = iter->second.size();
+    int new_n_edges = my_edges.size();
     (void)new_n_edges; // suppress warning
 
 #ifdef REEBER_ENABLE_CHECKS
@@ -489,16 +468,16 @@ void FabComponentBlock<Real, D>::delete_low_edges(int sender_gid, AmrEdgeContain
     }
 #endif
 
-    if (iter->second.empty())
+    if (my_edges.empty())
     {
         gid_to_outgoing_edges_.erase(iter);
         return;
     }
 
-    for(auto&& e : iter->second)
+    for(auto&& e : my_edges)
     {
         AmrVertexId my_deepest = vertex_to_deepest_.at(std::get<0>(e));
-        AmrVertexId other_deepest = received_vertex_to_deepest.at(std::get<1>(e));
+        AmrVertexId other_deepest = cells_from_sender.value(std::get<1>(e).vertex);
 
         Component& my_component = get_component_by_deepest(my_deepest);
         my_component.add_current_neighbor(other_deepest);
@@ -518,6 +497,9 @@ void FabComponentBlock<Real, D>::adjust_outgoing_edges()
             c.add_edge(e);
         }
     }
+
+    // components got their initial neighbors in delete_low_edges
+    n_obligations_ = count_obligations();
 }
 
 template<class Real, unsigned D>
@@ -542,7 +524,13 @@ void FabComponentBlock<Real, D>::compute_original_connected_components(
     Real sf = scaling_factor();
 
     const TripletMergeTree& const_tree = merge_tree_;
-    std::unordered_set<AmrVertexId> processed_deepest;
+    std::unordered_map<AmrVertexId, size_t> deepest_to_component;
+
+    // nodes of the local tree, copied to the tree store grouped by component
+    std::vector<TreeNode> component_nodes;
+    std::vector<size_t> node_component;
+    component_nodes.reserve(const_tree.nodes().size());
+    node_component.reserve(const_tree.nodes().size());
 
 #ifdef REEBER_EXTRA_INTEGRAL
     // we can push_back to extra_names, but loop only over original ones
@@ -586,38 +574,38 @@ void FabComponentBlock<Real, D>::compute_original_connected_components(
 
 #endif
 
-        if (processed_deepest.count(deepest_vertex) == 0)
+        auto deepest_component = deepest_to_component.emplace(deepest_vertex, components_.size());
+        if (deepest_component.second)
         {
             // we encounter this deepest vertex for the first time
             AmrVertexId deepest_value = deepest_neighbor->vertex;
             // local integral is still incomplete and will be set below,
             // after all active vertices were processed
             components_.emplace_back(negate_, deepest_vertex, deepest_value);
-            processed_deepest.insert(deepest_vertex);
         }
 
 #ifdef REEBER_DO_DETAILED_TIMING
         copy_nodes_timer.restart();
 #endif
 
-        TripletMergeTree& mt = get_component_by_deepest(deepest_vertex).tree_;
-        Value val = n->value;
-
         AmrVertexId s = std::get<0>(n->parent())->vertex;
         AmrVertexId v = std::get<1>(n->parent())->vertex;
 
-        Neighbor n_u, n_s, n_v;
-
-        n_u = mt.add_or_update(u, val);
-        n_s = mt.find_or_add(s, 0);
-        n_v = mt.find_or_add(v, 0);
-        mt.link(n_u, n_s, n_v);
+        component_nodes.push_back({ u, n->value, s, v });
+        node_component.push_back(deepest_component.first->second);
 
 #ifdef REEBER_DO_DETAILED_TIMING
         copy_nodes_time += copy_nodes_timer.elapsed();
 #endif
     }
 
+    tree_store_ = TreeStore(negate_);
+    auto views = tree_store_.assign(component_nodes, node_component, components_.size());
+    for(size_t i = 0; i < components_.size(); ++i)
+    {
+        components_[i].tree_ = views[i];
+    }
+
 #ifdef REEBER_DO_DETAILED_TIMING
     compute_components_time += timer.elapsed();
 #endif
@@ -757,23 +745,24 @@ FabComponentBlock<Real, D>::pretty_integral(const AmrVertexId& deepest, const st
 template<class Real, unsigned D>
 void FabComponentBlock<Real, D>::update_connectivity(const AmrVertexContainer& deepest)
 {
-    for(const Component& c : components_)
-    {
-        auto original_deepest = c.original_deepest();
-        if (merge_tree_.contains(original_deepest))
+    auto update = [this](const AmrVertexId& v) {
+        if (merge_tree_.contains(v))
         {
-            auto current_deepest = merge_tree_.find_deepest(merge_tree_[original_deepest])->vertex;
-            vertex_to_deepest_[original_deepest] = current_deepest;
+            auto current_deepest = merge_tree_.find_deepest(merge_tree_[v])->vertex;
+            vertex_to_deepest_[v] = current_deepest;
+            connectivity_.unite_roots(connectivity_.find_root(connectivity_.make_component_if_not_exists(v)),
+                                      connectivity_.find_root(connectivity_.make_component_if_not_exists(current_deepest)));
         }
+    };
+
+    for(const Component& c : components_)
+    {
+        update(c.original_deepest());
     }
 
     for(AmrVertexId v : deepest)
     {
-        if (merge_tree_.contains(v))
-        {
-            auto current_deepest = merge_tree_.find_deepest(merge_tree_[v])->vertex;
-            vertex_to_deepest_[v] = current_deepest;
-        }
+        update(v);
     }
 }
 
@@ -791,14 +780,19 @@ Real FabComponentBlock<Real, D>::scaling_factor() const
 template<class Real, unsigned D>
 int FabComponentBlock<Real, D>::are_all_components_done() const
 {
+    assert(n_obligations_ == count_obligations());
+    return n_obligations_ == 0;
+}
+
+template<class Real, unsigned D>
+size_t FabComponentBlock<Real, D>::count_obligations() const
+{
+    size_t result = 0;
     for(const Component& c : components_)
     {
-        if (not c.is_done_sending())
-        {
-            return 0;
-        }
+        result += c.n_obligations();
     }
-    return 1;
+    return result;
 }
 
 //TODO: fix
@@ -910,6 +904,7 @@ void FabComponentBlock<Real, D>::save(const void* b, diy::BinaryBuffer& bb)
     diy::save(bb, block->negate_);
     diy::save(bb, block->round_);
     diy::save(bb, block->vertex_to_deepest_);
+    diy::save(bb, block->connectivity_);
     diy::save(bb, block->merge_tree_);
     diy::save(bb, block->local_diagrams_);
     //diy::save(bb, block->components_);
@@ -925,6 +920,7 @@ void FabComponentBlock<Real, D>::load(void* b, diy::BinaryBuffer& bb)
     diy::load(bb, block->negate_);
     diy::load(bb, block->round_);
     diy::load(bb, block->vertex_to_deepest_);
+    diy::load(bb, block->connectivity_);
     diy::load(bb, block->merge_tree_);
     diy::load(bb, block->local_diagrams_);
     //diy::load(bb, block->components_);
@@ -15,6 +15,7 @@
 #include "reeber/amr_helper.h"
 
 #include "small_set.h"
+#include "component-tree-store.h"
 
 namespace r = reeber;
 
@@ -32,10 +33,11 @@ public:
     using AmrVertexId = reeber::AmrVertexId;
     using AmrEdge = reeber::AmrEdge;
     using AmrEdgeContainer = reeber::AmrEdgeContainer;
-    using AmrVertexSet = std::unordered_set<AmrVertexId>;
-//    using AmrVertexSet = SmallSet<AmrVertexId>;
-    using GidSet = std::unordered_set<int>;
+    using AmrVertexSet = SmallSet<AmrVertexId>;
+    using GidSet = SmallSet<int>;
     using TripletMergeTree = reeber::TripletMergeTree<AmrVertexId, Real>;
+    using TreeStore = ComponentTreeStore<AmrVertexId, Real>;
+    using TreeView = typename TreeStore::View;
     using VertexValueMap = std::unordered_map<AmrVertexId, Real>;
     using UnionFind = DisjointSets<AmrVertexId>;
 
@@ -83,6 +85,10 @@ public:
 
     bool is_done_sending() const;
 
+    // gids the component has not been sent to, plus 1, if it has new neighbors to send;
+    // the component is done sending, when this is 0
+    int n_obligations() const;
+
     void add_current_neighbor(const AmrVertexId& new_current_neighbor);
     void set_current_neighbors(const AmrVertexSet& new_current_neighbors);
 
@@ -95,10 +101,10 @@ public:
 
     void add_edge(const AmrEdge& e);
 
-    void sparsify(const VertexEdgesMap& vertex_to_outgoing_edges);
+    void sparsify(TreeStore& store, const VertexEdgesMap& vertex_to_outgoing_edges);
 
-    // access to tree
-    TripletMergeTree tree_;
+    // nodes of the local tree of the component in the tree store of the block
+    TreeView tree_;
 
     std::string to_string() const;
 
@@ -11,16 +11,15 @@ FabConnectedComponent<Real>::FabConnectedComponent(bool negate, const AmrVertexI
         current_neighbors_({deepest}),
         current_gids_({deepest.gid}),
         processed_gids_({deepest.gid}),
-        n_prev_current_neighbors_(1),
-        tree_(negate)
+        n_prev_current_neighbors_(1)
 {
 }
 
 template<class Real>
-void FabConnectedComponent<Real>::sparsify(const VertexEdgesMap& vertex_to_outgoing_edges)
+void FabConnectedComponent<Real>::sparsify(TreeStore& store, const VertexEdgesMap& vertex_to_outgoing_edges)
 {
 #ifndef REEBER_NO_SPARSIFICATION
-    r::sparsify(tree_,
+    store.sparsify(tree_,
             [&vertex_to_outgoing_edges, this](AmrVertexId u) {
                 return u == this->original_deepest() or vertex_to_outgoing_edges.find(u) != vertex_to_outgoing_edges.end();
             });
@@ -41,7 +40,13 @@ bool FabConnectedComponent<Real>::is_done_sending() const
     assert(std::all_of(processed_gids().begin(), processed_gids().end(),
                        [this](const auto& gid) { return this->current_gids_.count(gid) == 1; }));
 
-    return current_gids().size() == processed_gids().size() and not must_send_neighbors();
+    return n_obligations() == 0;
+}
+
+template<class Real>
+int FabConnectedComponent<Real>::n_obligations() const
+{
+    return static_cast<int>(current_gids().size() - processed_gids().size()) + must_send_neighbors();
 }
 
 
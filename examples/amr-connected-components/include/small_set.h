@@ -1,66 +1,163 @@
 #ifndef REEBER_SMALL_SET_H
 #define REEBER_SMALL_SET_H
 
-#include <vector>
+#include <array>
+#include <iterator>
 #include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include <initializer_list>
+
 #include <diy/serialization.hpp>
 
-template<class T>
-struct SmallSet
+// Set that keeps up to N elements inline, in insertion order, and looks them up by linear search;
+// the (N+1)-st element moves all of them to a hash set.
+// Components touch few neighbors, so most sets never allocate.
+// Iteration order is unspecified, as for std::unordered_set.
+template<class T, size_t N = 8, class Hash = std::hash<T>>
+class SmallSet
 {
-    using ContainerType = typename std::vector<T>;
-    using value_type = typename ContainerType::value_type;
-    using iterator = typename ContainerType::iterator;
-    using const_iterator = typename ContainerType::const_iterator;
-    using size_type = typename ContainerType::size_type;
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using HashSet = std::unordered_set<T, Hash>;
+
+        class const_iterator
+        {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type        = T;
+                using difference_type   = std::ptrdiff_t;
+                using reference         = const T&;
+                using pointer           = const T*;
+
+                const_iterator()                                                        {}
+                const_iterator(const T* p): p_(p)                                       {}
+                const_iterator(typename HashSet::const_iterator it): it_(it)            {}
+
+                reference       operator*() const                                       { return p_ ? *p_ : *it_; }
+                pointer         operator->() const                                      { return &**this; }
+
+                const_iterator& operator++()                                            { if (p_) ++p_; else ++it_; return *this; }
+                const_iterator  operator++(int)                                         { const_iterator it = *this; ++(*this); return it; }
 
-    SmallSet() {};
-    SmallSet(const SmallSet& s) : data_(s.data_) {};
-    SmallSet(std::initializer_list<T> init) : data_(init) {};
+                bool            operator==(const const_iterator& other) const           { return p_ == other.p_ and (p_ or it_ == other.it_); }
+                bool            operator!=(const const_iterator& other) const           { return not (*this == other); }
 
-    ContainerType data_;
+            private:
+                const T*                            p_ = nullptr;     // inline element, if the set has not spilled
+                typename HashSet::const_iterator    it_;
+        };
 
-    iterator begin() { return  data_.begin(); }
-    const_iterator begin() const { return  data_.begin(); }
+        using iterator = const_iterator;
 
-    iterator end() { return  data_.end(); }
-    const_iterator end() const { return  data_.end(); }
+        SmallSet() {}
+        SmallSet(std::initializer_list<T> init)                                         { insert(init.begin(), init.end()); }
 
-    size_type size() const { return data_.size(); }
+        template<class IterType>
+        SmallSet(IterType first, IterType last)                                         { insert(first, last); }
 
-    auto count(const T& val) const { return std::count(data_.begin(), data_.end(), val); }
+        bool            spilled() const                                                 { return n_inline_ > N; }
+
+        size_type       size() const                                                    { return spilled() ? spilled_.size() : n_inline_; }
+        bool            empty() const                                                   { return size() == 0; }
+
+        const_iterator  begin() const       { return spilled() ? const_iterator(spilled_.cbegin()) : const_iterator(inline_.data()); }
+        const_iterator  end() const         { return spilled() ? const_iterator(spilled_.cend()) : const_iterator(inline_.data() + n_inline_); }
+
+        const_iterator  find(const T& val) const
+        {
+            if (spilled())
+                return const_iterator(spilled_.find(val));
+            const T* last = inline_.data() + n_inline_;
+            return const_iterator(std::find(inline_.data(), last, val));
+        }
 
-    void insert(const T& val) { if (0 == count(val)) data_.push_back(val); }
+        size_type       count(const T& val) const                                       { return find(val) != end(); }
+
+        std::pair<const_iterator, bool> insert(const T& val)
+        {
+            if (spilled())
+            {
+                auto result = spilled_.insert(val);
+                return { const_iterator(result.first), result.second };
+            }
+
+            const_iterator iter = find(val);
+            if (iter != end())
+                return { iter, false };
+
+            if (n_inline_ < N)
+            {
+                inline_[n_inline_++] = val;
+                return { const_iterator(inline_.data() + n_inline_ - 1), true };
+            }
+
+            // spill: n_inline_ = N + 1 marks the hash set as the storage
+            spilled_.reserve(2 * N);
+            spilled_.insert(inline_.begin(), inline_.end());
+            n_inline_ = N + 1;
+            return { const_iterator(spilled_.insert(val).first), true };
+        }
+
+        // for std::inserter
+        const_iterator  insert(const_iterator, const T& val)                            { return insert(val).first; }
+
+        template<class IterType>
+        void            insert(IterType first, IterType last)
+        {
+            for(IterType iter = first; iter != last; ++iter)
+            {
+                insert(*iter);
+            }
+        }
+
+        void            clear()
+        {
+            n_inline_ = 0;
+            spilled_.clear();
+        }
 
-    template<class IterType>
-    void insert(IterType first, IterType last)
-    {
-        for(IterType iter = first; iter != last; ++iter)
+        bool            operator==(const SmallSet& other) const
         {
-            insert(*iter);
+            return size() == other.size() and std::all_of(begin(), end(), [&other](const T& x) { return other.count(x) == 1; });
         }
-    }
 
-    void clear() { data_.clear(); }
+        bool            operator!=(const SmallSet& other) const                         { return not (*this == other); }
 
-    friend diy::Serialization<SmallSet<T>>;
+    private:
+        std::array<T, N>    inline_ {};
+        size_t              n_inline_ { 0 };
+        HashSet             spilled_;
 };
 
 
 namespace diy {
 
-    template<class R>
-    struct Serialization<SmallSet<R>> {
-        using SmallSetR = SmallSet<R>;
+    // same layout as std::unordered_set: size, then the elements
+    template<class R, size_t N, class Hash>
+    struct Serialization<SmallSet<R, N, Hash>> {
+        using SmallSetR = SmallSet<R, N, Hash>;
 
         static void save(BinaryBuffer& bb, const SmallSetR& x)
         {
-            diy::save(bb, x.data_);
+            size_t s = x.size();
+            diy::save(bb, s);
+            for(const R& r : x)
+                diy::save(bb, r);
         }
 
         static void load(BinaryBuffer& bb, SmallSetR& x)
         {
-            diy::load(bb, x.data_);
+            size_t s;
+            diy::load(bb, s);
+            x.clear();
+            for(size_t i = 0; i < s; ++i)
+            {
+                R r;
+                diy::load(bb, r);
+                x.insert(r);
+            }
         }
     };
 }
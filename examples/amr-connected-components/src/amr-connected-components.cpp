@@ -136,7 +136,8 @@ void read_from_file(std::string infn,
         diy::DiscreteBounds& domain,
         bool split,
         int nblocks,
-        BoolVector wrap)
+        BoolVector wrap,
+        const DecompositionParams& decomposition)
 {
     if (not file_exists(infn))
     {
@@ -145,10 +146,11 @@ void read_from_file(std::string infn,
 
     if (ends_with(infn, ".npy"))
     {
-        read_from_npy_file<DIM>(infn, world, nblocks, master_reader, assigner, header, domain, wrap);
+        read_from_npy_file<DIM>(infn, world, nblocks, master_reader, assigner, header, domain, wrap, decomposition);
     } else if (ends_with(infn, ".h5") || ends_with(infn, ".hdf5"))
     {
-        read_from_hdf5_file(infn, all_var_names, n_mt_vars, world, nblocks, master_reader, assigner, header, domain);
+        read_from_hdf5_file(infn, all_var_names, n_mt_vars, world, nblocks, master_reader, assigner, header, domain,
+                decomposition);
     } else
     {
         if (split)
@@ -181,7 +183,7 @@ void create_fab_cc_blocks(const diy::mpi::communicator& world, int in_memory, in
                 int local_lev = l->level();
 
                 master.add(cp.gid(),
-                        new Block(b->fab, b->extra_names_, b->extra_fabs_, local_ref, local_lev, domain,
+                        new Block(b->function(), b->extra_names_, b->extra_fabs_, local_ref, local_lev, domain,
                                 l->bounds(),
                                 l->core(), cp.gid(),
                                 new_link, rho, negate, wrap, absolute, cell_volume),
@@ -230,6 +232,7 @@ int main(int argc, char** argv)
     std::string function_fields = "";
 
     int n_runs = 1;
+    DecompositionParams decomposition;
 
     using namespace opts;
 
@@ -246,6 +249,7 @@ int main(int argc, char** argv)
             >> Option('f', "function_fields", function_fields, "fields to add for merge tree, separated with , ")
             >> Option(      "integral_fields", integral_fields, "fields to integrate separated with , ")
             >> Option('r', "runs", n_runs, "number of runs")
+            >> Option("kd-coarse", decomposition.coarse, "side of the coarse cells that count active cells for --kd")
             >> Option('p', "profile", profile_path, "path to keep the execution profile")
             >> Option('l', "log", log_level, "log level");
 
@@ -256,6 +260,7 @@ int main(int argc, char** argv)
     // ignored for now, wrap is always assumed
     bool wrap = ops >> opts::Present('w', "wrap", "wrap");
     bool split = ops >> opts::Present("split", "use split IO");
+    decomposition.kd = ops >> opts::Present("kd", "decompose npy and HDF5 inputs by a kd-tree of active cells (instead of regular boxes)");
 
     BoolVector wrap_vec { wrap, wrap, wrap };
 
@@ -376,7 +381,11 @@ int main(int argc, char** argv)
         read_amr_plotfile(input_filename, all_var_names, n_mt_vars, world, nblocks, master_reader, header, cell_volume, domain);
     } else
     {
-        read_from_file(input_filename, all_var_names, n_mt_vars, world, master_reader, assigner, header, domain, split, nblocks, wrap_vec);
+        decomposition.rho = rho;
+        decomposition.absolute = absolute;
+        decomposition.negate = negate;
+        read_from_file(input_filename, all_var_names, n_mt_vars, world, master_reader, assigner, header, domain, split, nblocks, wrap_vec,
+                decomposition);
     }
 
     auto time_to_read_data = timer.elapsed();
@@ -511,7 +520,7 @@ int main(int argc, char** argv)
 
         int global_n_undone = 1;
 
-        master.foreach(&send_edges_to_neighbors_cc<Real, DIM>);
+        master.foreach(&send_boundary_cells_to_neighbors_cc<Real, DIM>);
         master.exchange();
         master.foreach(&delete_low_edges_cc<Real, DIM>);
 
@@ -589,6 +598,16 @@ int main(int argc, char** argv)
 
                 LOG_SEV(info) << "STAT MASTER round " << rounds << ", rank = " << world.rank() << ", local_n_undone = "
                               << local_n_undone;
+
+                MessageStats round_stats;
+                master.foreach(
+                        [&round_stats, rounds](Block* b, const diy::Master::ProxyWithLink& cp) {
+                            if (b->message_stats_.size() >= static_cast<size_t>(rounds))
+                                round_stats += b->message_stats_[rounds - 1];
+                        });
+
+                LOG_SEV(info) << "STAT MASTER round " << rounds << ", rank = " << world.rank() << ", sent "
+                              << round_stats.to_string();
             }
             dlog::flush();
         }
@@ -1178,3 +1178,175 @@ TEST_CASE("Check blocks constructor in simple masked case", "[FabTmtBlock][dim2]
     }
 }
 */
+
+TEST_CASE("Disjoint sets", "[DisjointSets]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+    using UnionFind = DisjointSets<AmrVertexId>;
+
+    UnionFind uf;
+    for(size_t i = 0; i < 20; ++i)
+    {
+        uf.make_component(AmrVertexId(i % 2, i));
+    }
+
+    // two chains: even and odd vertices
+    for(size_t i = 2; i < 20; ++i)
+    {
+        uf.unite_components(AmrVertexId(i % 2, i - 2), AmrVertexId(i % 2, i));
+    }
+
+    REQUIRE(uf.are_connected(AmrVertexId(0, 0), AmrVertexId(0, 18)));
+    REQUIRE(uf.are_connected(AmrVertexId(1, 1), AmrVertexId(1, 19)));
+    REQUIRE(not uf.are_connected(AmrVertexId(0, 0), AmrVertexId(1, 1)));
+    REQUIRE(uf.component_of(AmrVertexId(1, 5)).size() == 10);
+
+    diy::MemoryBuffer bb;
+    diy::save(bb, uf);
+    bb.reset();
+    UnionFind loaded;
+    diy::load(bb, loaded);
+    REQUIRE(not loaded.are_connected(AmrVertexId(0, 4), AmrVertexId(1, 5)));
+
+    loaded.unite_components(AmrVertexId(0, 4), AmrVertexId(1, 5));
+    REQUIRE(loaded.are_connected(AmrVertexId(0, 0), AmrVertexId(1, 19)));
+    REQUIRE(loaded.component_of(AmrVertexId(1, 5)).size() == 20);
+
+}
+
+TEST_CASE("Component frame", "[ComponentFrame]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+    using AmrVertexSet = std::unordered_set<AmrVertexId>;
+    using Frame = ComponentFrame<AmrVertexSet>;
+
+    // components of one merged component share their neighbors
+    AmrVertexSet neighbors_a { AmrVertexId(1, 10), AmrVertexId(2, 20), AmrVertexId(0, 3) };
+    AmrVertexSet neighbors_b { AmrVertexId(0, 3) };
+
+    Frame frame;
+    frame.add_component(AmrVertexId(0, 1), neighbors_a);
+    frame.add_component(AmrVertexId(0, 2), neighbors_a);
+    frame.add_component(AmrVertexId(0, 3), neighbors_b);
+    frame.add_component(AmrVertexId(0, 4), AmrVertexSet());
+
+    REQUIRE(frame.size() == 4);
+    REQUIRE(frame.n_vertices() == 6);
+    REQUIRE(frame.n_neighbor_sets() == 3);
+
+    diy::MemoryBuffer bb;
+    diy::save(bb, frame);
+    bb.reset();
+    Frame loaded;
+    diy::load(bb, loaded);
+
+    REQUIRE(loaded.size() == 4);
+    REQUIRE(loaded.original_deepest(1) == AmrVertexId(0, 2));
+    REQUIRE(loaded.current_neighbors(0) == neighbors_a);
+    REQUIRE(loaded.current_neighbors(1) == neighbors_a);
+    REQUIRE(loaded.current_neighbors(2) == neighbors_b);
+    REQUIRE(loaded.current_neighbors(3).empty());
+
+    MessageStats stats;
+    stats.add(4, 100);
+    stats.add(1, 64);
+    stats.add(0, 127);
+    REQUIRE(stats.n_messages == 3);
+    REQUIRE(stats.n_components == 5);
+    REQUIRE(stats.n_bytes == 291);
+    REQUIRE(stats.histogram.size() == 7);
+    REQUIRE(stats.histogram[6] == 3);
+}
+
+TEST_CASE("Small set", "[SmallSet]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+    using Set = SmallSet<AmrVertexId, 4>;
+
+    Set s { AmrVertexId(0, 1), AmrVertexId(1, 2), AmrVertexId(0, 1) };
+    REQUIRE(s.size() == 2);
+    REQUIRE(not s.spilled());
+    REQUIRE(s.count(AmrVertexId(1, 2)) == 1);
+    REQUIRE(s.find(AmrVertexId(2, 2)) == s.end());
+
+    std::unordered_set<AmrVertexId> expected(s.begin(), s.end());
+    for(size_t i = 0; i < 20; ++i)
+    {
+        AmrVertexId v(i % 3, i % 7);
+        REQUIRE(s.insert(v).second == expected.insert(v).second);
+        REQUIRE(s.size() == expected.size());
+    }
+    REQUIRE(s.spilled());
+    REQUIRE(std::unordered_set<AmrVertexId>(s.begin(), s.end()) == expected);
+
+    // equality does not depend on the order of insertion
+    Set t(expected.begin(), expected.end());
+    REQUIRE(s == t);
+
+    diy::MemoryBuffer bb;
+    diy::save(bb, s);
+    bb.reset();
+    Set loaded;
+    diy::load(bb, loaded);
+    REQUIRE(loaded == s);
+
+    s.clear();
+    REQUIRE(s.empty());
+    REQUIRE(not s.spilled());
+    REQUIRE(s.begin() == s.end());
+}
+
+TEST_CASE("Component tree store", "[ComponentTreeStore]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+    using TreeStore = ComponentTreeStore<AmrVertexId, double>;
+    using TripletMergeTree = TreeStore::TripletMergeTree;
+    using Node = TreeStore::Node;
+
+    // two components: chain 0 <- 1 <- 2 <- 3 with root 0, and 4 <- 5 with root 4,
+    // nodes of the components interleaved
+    std::vector<Node> nodes {
+            { AmrVertexId(0, 0), 0.0, AmrVertexId(0, 0), AmrVertexId(0, 0) },
+            { AmrVertexId(0, 4), 0.5, AmrVertexId(0, 4), AmrVertexId(0, 4) },
+            { AmrVertexId(0, 1), 1.0, AmrVertexId(0, 1), AmrVertexId(0, 0) },
+            { AmrVertexId(0, 5), 1.5, AmrVertexId(0, 5), AmrVertexId(0, 4) },
+            { AmrVertexId(0, 2), 2.0, AmrVertexId(0, 2), AmrVertexId(0, 1) },
+            { AmrVertexId(0, 3), 3.0, AmrVertexId(0, 3), AmrVertexId(0, 2) } };
+    std::vector<size_t> component_of { 0, 1, 0, 1, 0, 0 };
+
+    TreeStore store;
+    auto views = store.assign(nodes, component_of, 2);
+    REQUIRE(views[0].size() == 4);
+    REQUIRE(views[1].size() == 2);
+    REQUIRE(store.begin(views[1])->vertex == AmrVertexId(0, 4));
+
+    // keep vertex 2 and the path to the root, drop 3
+    store.sparsify(views[0], [](AmrVertexId u) { return u == AmrVertexId(0, 2); });
+    REQUIRE(views[0].size() == 3);
+
+    std::vector<TreeStore::View*> view_ptrs { &views[0], &views[1] };
+    store.shrink(view_ptrs);
+    REQUIRE(store.size() == 5);
+    REQUIRE(views[1].begin == 3);
+
+    // a saved view loads as a TripletMergeTree
+    diy::MemoryBuffer bb;
+    store.save(bb, views[0]);
+    bb.reset();
+    TripletMergeTree loaded;
+    diy::load(bb, loaded);
+    REQUIRE(loaded.size() == 3);
+    REQUIRE(not loaded.contains(AmrVertexId(0, 3)));
+    REQUIRE(loaded.find_deepest(loaded[AmrVertexId(0, 2)])->vertex == AmrVertexId(0, 0));
+
+    // or directly into an existing tree, whose nodes are not changed
+    TripletMergeTree mt;
+    mt.add(AmrVertexId(0, 1), -1.0);
+    mt.link(mt[AmrVertexId(0, 1)], mt[AmrVertexId(0, 1)], mt[AmrVertexId(0, 1)]);
+    bb.reset();
+    TreeStore::load_into(bb, mt);
+    REQUIRE(mt.size() == 3);
+    REQUIRE(mt[AmrVertexId(0, 1)]->value == -1.0);
+    REQUIRE(mt[AmrVertexId(0, 0)]->value == 0.0);
+    REQUIRE(mt.find_deepest(mt[AmrVertexId(0, 2)])->vertex == AmrVertexId(0, 1));
+}
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <set>
+#include <vector>
+#include <unordered_set>
 
 #include "reeber-real.h"
 #include "fab-tmt-block.h"
 #include "reeber/amr-vertex.h"
+#include "reeber/amr-edge-codec.h"
 
 using AmrEdgeContainer = reeber::AmrEdgeContainer;
 using AmrEdge = reeber::AmrEdge;
@@ -13,11 +16,44 @@ using AmrVertexId = r::AmrVertexId;
 
 /**
  *
- * send outgoing edges computed in b to all its neighbors
+ * call f(b, cp) for all local blocks of master
+ * with TBB and all blocks in memory, blocks are tasks of the TBB scheduler, so the parallel loops inside f
+ * (mask passes, compute_merge_tree2, edge extraction) share it with the loop over blocks,
+ * and threads that are done with small blocks help with the large ones;
+ * otherwise this is master.foreach
+ *
+ * @param master diy::Master
+ * @param all_in_memory bool
+ * master never unloads blocks
+ * @param f callback, called concurrently for different blocks
+ * master.proxy is not thread-safe (it touches the incoming, outgoing and collectives maps of master),
+ * so the proxies are created serially before the parallel loop
+ */
+template<class Block, class F>
+void foreach_block_parallel(diy::Master& master, bool all_in_memory, const F& f)
+{
+#ifdef REEBER_USE_TBB
+    if (all_in_memory)
+    {
+        std::vector<diy::Master::ProxyWithLink> proxies;
+        proxies.reserve(master.size());
+        for(int i = 0; i < master.size(); ++i)
+            proxies.push_back(master.proxy(i));
+
+        r::for_each(0, master.size(), [&master, &proxies, &f](size_t i) { f(master.block<Block>(i), proxies[i]); });
+        return;
+    }
+#endif
+    master.foreach(f);
+}
+
+/**
+ *
+ * send to every neighbor the active cells of b with edges to it (sparse face, no edges)
  * used to symmetrize the edge set in the beginning of the algorithm
  *
  * @param b FabTmtBlock
- * block that will send its edges
+ * block that will send its boundary cells
  *
  * @param cp diy::Master::ProxyWithLink
  * communication proxy
@@ -25,22 +61,23 @@ using AmrVertexId = r::AmrVertexId;
  */
 
 template<unsigned D>
-void send_edges_to_neighbors(FabTmtBlock<Real, D> *b, const diy::Master::ProxyWithLink& cp)
+void send_boundary_cells_to_neighbors(FabTmtBlock<Real, D> *b, const diy::Master::ProxyWithLink& cp)
 {
     bool debug = false;
 
-    if (debug) fmt::print("Called send_edges_to_neighbors for block = {}\n", b->gid);
+    if (debug) fmt::print("Called send_boundary_cells_to_neighbors for block = {}\n", b->gid);
 
     auto *l = static_cast<diy::AMRLink *>(cp.link());
 
     for (const diy::BlockID& receiver : link_unique(l, b->gid))
     {
         int receiver_gid = receiver.gid;
-        cp.enqueue(receiver, b->gid_to_outgoing_edges_[receiver_gid]);
-//        debug = receiver_gid == 0 and (b->gid == 3 or b->gid == 12 || b->gid == 15);
+        typename FabTmtBlock<Real, D>::BoundaryCells cells = b->boundary_cells(receiver_gid);
+        b->edge_bytes_sent_ += cells.save(cp.outgoing(receiver));
+        b->edge_bytes_raw_ += reeber::AmrEdgeCodec::raw_size(b->gid_to_outgoing_edges_[receiver_gid]);
         if (debug)
-            fmt::print("In send_edges_to_neighbors for block = {}, sending to receiver= {}, cardinality = {}\n",
-                       b->gid, receiver_gid, b->gid_to_outgoing_edges_[receiver_gid].size());
+            fmt::print("In send_boundary_cells_to_neighbors for block = {}, sending to receiver= {}, cells = {}\n",
+                       b->gid, receiver_gid, cells.size());
 
     }
 }
@@ -58,11 +95,104 @@ void delete_low_edges(FabTmtBlock<Real, D> *b, const diy::Master::ProxyWithLink&
 
     for (const diy::BlockID& sender : link_unique(l, b->gid))
     {
-        AmrEdgeContainer edges_from_neighbor;
-        cp.dequeue(sender, edges_from_neighbor);
-        b->delete_low_edges(sender.gid, edges_from_neighbor);
+        typename FabTmtBlock<Real, D>::BoundaryCells cells_from_neighbor;
+        cells_from_neighbor.load(cp.incoming(sender.gid));
+        b->delete_low_edges(sender.gid, cells_from_neighbor);
     }
 
     b->adjust_outgoing_edges();
     b->sparsify_prune_original_tree();
 }
+
+/**
+ *
+ * take the blocks that cannot contribute to any merge out of the communication graph;
+ * must be called after init and before send_boundary_cells_to_neighbors
+ *
+ * a block is communicating, if it has active cells with outgoing edges;
+ * communicating gids are gathered from all ranks, the link of every communicating block is pruned
+ * to the communicating neighbors, the link of every other block keeps only its own entries.
+ * Blocks without active cells are retired: they skip all rounds, but still produce (empty) output.
+ *
+ * @param master diy::Master
+ * @return number of local retired blocks
+ */
+template<unsigned D>
+int retire_inactive_blocks(diy::Master& master)
+{
+    bool debug = false;
+
+    std::vector<int> local_communicating_gids;
+    for(int i = 0; i < master.size(); ++i)
+    {
+        auto* b = master.block<FabTmtBlock<Real, D>>(i);
+        if (b->is_communicating())
+            local_communicating_gids.push_back(b->gid);
+    }
+
+    std::vector<std::vector<int>> all_communicating_gids;
+    diy::mpi::all_gather(master.communicator(), local_communicating_gids, all_communicating_gids);
+
+    std::unordered_set<int> communicating_gids;
+    for(const auto& gids : all_communicating_gids)
+        communicating_gids.insert(gids.begin(), gids.end());
+
+    int n_retired = 0;
+
+    for(int i = 0; i < master.size(); ++i)
+    {
+        auto* b = master.block<FabTmtBlock<Real, D>>(i);
+        auto* l = static_cast<diy::AMRLink*>(master.link(i));
+
+        bool is_retained = communicating_gids.count(b->gid) == 1;
+
+        auto* new_link = new diy::AMRLink(D, l->level(), l->refinement(), l->core(), l->bounds());
+        for(int j = 0; j < l->size(); ++j)
+        {
+            int target_gid = l->target(j).gid;
+            if (target_gid != b->gid and not (is_retained and communicating_gids.count(target_gid)))
+                continue;
+            new_link->add_neighbor(l->target(j));
+            new_link->add_bounds(l->level(j), l->refinement(j), l->core(j), l->bounds(j));
+        }
+        for(const diy::Direction& dir : l->wrap())
+            new_link->add_wrap(dir);
+
+        if (debug)
+            fmt::print("In retire_inactive_blocks, gid = {}, retained = {}, link size: {} -> {}\n", b->gid,
+                    is_retained, l->size(), new_link->size());
+
+        // replace_link deletes l and updates the number of expected messages
+        master.replace_link(i, new_link);
+
+        b->retire_neighbors(communicating_gids);
+        n_retired += b->retired_;
+    }
+
+    return n_retired;
+}
+
+/**
+ *
+ * total size of the edges sent since the last call, over all blocks and ranks;
+ * the counters of the local blocks are reset
+ *
+ * @param master diy::Master
+ * @return (bytes the edges would take in plain serialization, bytes actually sent)
+ */
+template<unsigned D>
+std::pair<size_t, size_t> collect_edge_bytes(diy::Master& master)
+{
+    std::vector<size_t> local_bytes { 0, 0 }, bytes;
+    for(int i = 0; i < master.size(); ++i)
+    {
+        auto* b = master.block<FabTmtBlock<Real, D>>(i);
+        local_bytes[0] += b->edge_bytes_raw_;
+        local_bytes[1] += b->edge_bytes_sent_;
+        b->edge_bytes_raw_ = b->edge_bytes_sent_ = 0;
+    }
+
+    diy::mpi::all_reduce(master.communicator(), local_bytes, bytes, std::plus<size_t>());
+
+    return { bytes[0], bytes[1] };
+}
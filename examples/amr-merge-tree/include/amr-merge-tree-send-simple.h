@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <unordered_set>
 
 #include <diy/link.hpp>
 #include <reeber/box.h>
@@ -9,45 +11,103 @@
 #include "amr-merge-tree-helper.h"
 using AMRLink = diy::AMRLink;
 
+// one entry of an AMRLink; links travel between blocks as deltas of these
+struct AmrLinkEntry
+{
+    using Point = diy::DiscreteBounds::Point;
+
+    AmrLinkEntry() {}
+
+    AmrLinkEntry(const AMRLink* l, int i) :
+            target(l->target(i)),
+            level(l->level(i)),
+            refinement(l->refinement(i)),
+            core(l->core(i)),
+            bounds(l->bounds(i))
+    {
+    }
+
+    diy::BlockID target;
+    int level { -1 };
+    Point refinement;
+    diy::DiscreteBounds core { 0 };
+    diy::DiscreteBounds bounds { 0 };
+};
+
+namespace diy
+{
+    template<>
+    struct Serialization<AmrLinkEntry>
+    {
+        static void save(BinaryBuffer& bb, const AmrLinkEntry& e)
+        {
+            diy::save(bb, e.target);
+            diy::save(bb, e.level);
+            diy::save(bb, e.refinement);
+            diy::save(bb, e.core);
+            diy::save(bb, e.bounds);
+        }
+
+        static void load(BinaryBuffer& bb, AmrLinkEntry& e)
+        {
+            diy::load(bb, e.target);
+            diy::load(bb, e.level);
+            diy::load(bb, e.refinement);
+            diy::load(bb, e.core);
+            diy::load(bb, e.bounds);
+        }
+    };
+}
+
+// bring the gid -> link index hash of the block up to date; the link only grows at the end
+template<class Real, unsigned D>
+void index_link(FabTmtBlock<Real, D>* b, AMRLink* l)
+{
+    for(; b->link_indexed_size_ < l->size(); ++b->link_indexed_size_)
+        b->link_gid_to_idx_.emplace(l->target(b->link_indexed_size_).gid, b->link_indexed_size_);
+}
+
 template<class Real, unsigned D>
 void expand_link(FabTmtBlock<Real, D>* b,
                  const diy::Master::ProxyWithLink& cp,
                  AMRLink* l,
-                 std::vector<AMRLink>& received_links,
-                 std::vector<std::vector<int>>& received_original_gids)
+                 const std::vector<std::vector<AmrLinkEntry>>& received_link_deltas,
+                 const std::vector<std::vector<int>>& received_original_gids)
 {
 //    bool debug = (b->gid == 3) || (b->gid == 11) || (b->gid == 0) || (b->gid == 1);
     bool debug = false;
     if (debug) fmt::print("in expand_link for block = {}, round = {}, started updating link\n", b->gid, b->round_);
     int n_added = 0;
-    assert(received_links.size() == received_original_gids.size());
+    assert(received_link_deltas.size() == received_original_gids.size());
     std::set<int> added_gids;
 
-    for(size_t i = 0; i < received_links.size(); ++i)
+    index_link(b, l);
+
+    for(size_t i = 0; i < received_link_deltas.size(); ++i)
     {
-        const AMRLink& received_link = received_links[i];
+        const std::vector<AmrLinkEntry>& received_delta = received_link_deltas[i];
+        if (received_delta.empty())
+            continue;
+
         assert(not received_original_gids[i].empty());
-        //if (debug) fmt::print("in expand_link for block = {}, i = {}, received_links[i].size = {}\n", b->gid, i, received_links[i].size());
+        std::unordered_set<int> original_gids(received_original_gids[i].begin(), received_original_gids[i].end());
 
-        for(int j = 0; j < received_link.size(); ++j)
+        for(const AmrLinkEntry& e : received_delta)
         {
             // if we are already sending to this block, skip it
-            int candidate_gid = received_link.target(j).gid;
-            if (link_contains_gid(l, candidate_gid))
+            int candidate_gid = e.target.gid;
+            if (b->link_gid_to_idx_.count(candidate_gid))
                 continue;
 
-            //if (debug) fmt::print("in expand_link for block = {}, candidate_gid = {}, received_original_links[{}] = {}\n", b->gid, candidate_gid, i, container_to_string(received_original_gids[i]));
             // skip non-original gids (we only include the original link)
-            if (std::find(received_original_gids[i].begin(), received_original_gids[i].end(), candidate_gid) ==
-                received_original_gids[i].end()) {
-                //if (debug) fmt::print("in expand_link for block = {}, gid = {} not in original gids, skipping\n", b->gid, candidate_gid);
+            if (original_gids.count(candidate_gid) == 0)
                 continue;
-            }
+
             n_added++;
-            l->add_neighbor(received_link.target(j));
+            l->add_neighbor(e.target);
             added_gids.insert(candidate_gid);
-            l->add_bounds(received_link.level(j), received_link.refinement(j), received_link.core(j),
-                          received_link.bounds(j));
+            l->add_bounds(e.level, e.refinement, e.core, e.bounds);
+            index_link(b, l);
             //if (debug) fmt::print("in expand_link for block = {}, added gid = {}\n", b->gid, candidate_gid);
         }
     }
@@ -57,169 +117,172 @@ void expand_link(FabTmtBlock<Real, D>* b,
         fmt::print(
                 "In expand_link for block = {}, round = {}, b->done_ = {}, n_added = {}, new link size = {}, new link size_unqie = {}\n",
                 b->gid, b->round_, b->done_, n_added, l->size(), l->size_unique());
+    // needed after asynchronous rounds too: later bulk exchanges (integral) go over the expanded link
     cp.master()->add_expected(n_added);
 }
 
+// message to one receiver: n_trees, the link delta (original link gids, if anything is sent, and the new link entries)
+// and, if n_trees == 1, the original tree, vertex-to-deepest map, deepest vertices and all outgoing edges (encoded by AmrEdgeCodec)
 template<class Real, unsigned D>
-void amr_tmt_send(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp)
+void amr_tmt_send_to(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp, AMRLink* l, const diy::BlockID& receiver)
 {
-
-//    bool debug = (b->gid == 1 or b->gid == 100);
     bool debug = false;
-    if (debug) fmt::print("Called send_simple for block = {}\n", b->gid);
-
-    auto* l = static_cast<AMRLink*>(cp.link());
 
+    int receiver_gid = receiver.gid;
 
-    auto receivers = link_unique(l, b->gid);
+    // if we have sent our tree to this receiver before, only send n_trees = 0
+    // else send the tree and all outgoing edges
+    int n_trees = (b->processed_receivers_.count(receiver_gid) == 0 and
+                   b->new_receivers_.count(receiver_gid) == 1
+                   and b->done_ == 0);
 
-//    if (debug) fmt::print("In send_simple for block = {}, link size = {}, unique = {}\n", b->gid, l->size(), receivers.size());
+//    if (debug) fmt::print("In send_simple for block = {}, sending to {}, n_trees = {}\n", b->gid, receiver_gid, n_trees);
 
+    // link delta: only the entries added since our last message to this receiver
+    int& n_sent_entries = b->link_sent_size_[receiver_gid];
+    int n_new_entries = l->size() - n_sent_entries;
 
-    for (const diy::BlockID& receiver : receivers)
-    {
-        int receiver_gid = receiver.gid;
+    cp.enqueue(receiver, n_trees);
+    cp.enqueue(receiver, n_new_entries);
 
+    if (n_trees or n_new_entries)
         cp.enqueue(receiver, b->get_original_link_gids());
 
-        //if (debug) fmt::print("In send_simple for block = {}, receiver = {}, enqueued original_link_gids = {}\n", b->gid, receiver.gid, container_to_string(b->get_original_link_gids()));
+    //if (debug) fmt::print("In send_simple for block = {}, receiver = {}, enqueued original_link_gids = {}\n", b->gid, receiver.gid, container_to_string(b->get_original_link_gids()));
 
-        diy::MemoryBuffer& out = cp.outgoing(receiver);
-        diy::LinkFactory::save(out, l);
+    for(int i = n_sent_entries; i < l->size(); ++i)
+        cp.enqueue(receiver, AmrLinkEntry(l, i));
+    n_sent_entries = l->size();
 
-        // if we have sent our tree to this receiver before, only send n_trees = 0
-        // else send the tree and all outgoing edges
-        int n_trees = (b->processed_receivers_.count(receiver_gid) == 0 and
-                       b->new_receivers_.count(receiver_gid) == 1
-                       and b->done_ == 0);
-
-
-//        if (debug) fmt::print("In send_simple for block = {}, sending to {}, n_trees = {}\n", b->gid, receiver_gid, n_trees);
-
-        cp.enqueue(receiver, n_trees);
-
-        if (n_trees)
-        {
-            // send local tree and all outgoing edges that end in receiver
-            cp.enqueue(receiver, b->original_tree_);
-            cp.enqueue(receiver, b->original_vertex_to_deepest_);
-            cp.enqueue(receiver, b->get_original_deepest_vertices());
-            cp.enqueue(receiver, b->get_all_outgoing_edges());
-
-            if (debug) fmt::print("In send_simple for block = {}, sent data to {}, n_trees = {}, tree_size = {}, deepest_vertices = {}, n_edges = {}\n",
-                    b->gid, receiver_gid, n_trees, b->original_tree_.size(), b->get_original_deepest_vertices().size(), b->get_all_outgoing_edges().size());
-
-            // mark receiver_gid as processed
-            b->new_receivers_.erase(receiver_gid);
-            b->processed_receivers_.insert(receiver_gid);
-        }
+    if (n_trees)
+    {
+        // send local tree and all outgoing edges that end in receiver
+        cp.enqueue(receiver, b->original_tree_);
+        cp.enqueue(receiver, b->original_vertex_to_deepest_);
+        cp.enqueue(receiver, b->get_original_deepest_vertices());
+        b->edge_bytes_sent_ += reeber::AmrEdgeCodec::save(cp.outgoing(receiver), b->get_all_outgoing_edges());
+        b->edge_bytes_raw_ += reeber::AmrEdgeCodec::raw_size(b->get_all_outgoing_edges());
+
+        if (debug) fmt::print("In send_simple for block = {}, sent data to {}, n_trees = {}, tree_size = {}, deepest_vertices = {}, n_edges = {}\n",
+                b->gid, receiver_gid, n_trees, b->original_tree_.size(), b->get_original_deepest_vertices().size(), b->get_all_outgoing_edges().size());
+
+        // mark receiver_gid as processed
+        b->new_receivers_.erase(receiver_gid);
+        b->processed_receivers_.insert(receiver_gid);
     }
-
-    int done = b->done_;
-    b->round_++;
-    if (debug) fmt::print("Exit send_simple for block = {}, b->done = {}, b->round = {}\n", b->gid, done, b->round_);
 }
 
 template<class Real, unsigned D>
-void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp)
+void amr_tmt_send(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp)
 {
-#ifdef DO_DETAILED_TIMING
-    dlog::Timer timer;
-    dlog::Timer rl_loop_timer;
-    dlog::Timer merge_timer;
-    dlog::Timer union_find_timer;
-
-    // detailed timings
-    using DurationType = decltype(timer.elapsed());
-
-//    DurationType time_to_receive_trees_and_gids;
-//    DurationType rl_loop_time;
-//    DurationType repair_time;
-//    DurationType merge_call_time;
-//    DurationType union_find_time;
-//    DurationType sparsify_time;
-//    DurationType expand_link_time;
 
-#endif
+//    bool debug = (b->gid == 1 or b->gid == 100);
+    bool debug = false;
+    if (debug) fmt::print("Called send_simple for block = {}\n", b->gid);
 
-    bool debug = false; // (b->gid == 1 or b->gid == 100);
+    if (b->retired_)
+        return;
 
-    if (debug) fmt::print("Called receive_simple for block = {}\n", b->gid);
+    auto* l = static_cast<AMRLink*>(cp.link());
 
-    using Block = FabTmtBlock<Real, D>;
-    using AmrTripletMergeTree = typename Block::TripletMergeTree;
-    using AmrEdgeVector = typename Block::AmrEdgeContainer;
-    using AmrVertexSet = typename Block::AmrVertexSet;
-    using VertexVertexMap = typename Block::VertexVertexMap;
-    //    using VertexSizeMap = typename Block::VertexSizeMap;
-    using LinkVector = std::vector<AMRLink>;
 
+    auto receivers = link_unique(l, b->gid);
 
-    auto* l = static_cast<AMRLink*>(cp.link());
+//    if (debug) fmt::print("In send_simple for block = {}, link size = {}, unique = {}\n", b->gid, l->size(), receivers.size());
 
 
-    std::vector<AmrTripletMergeTree> received_trees;
-    std::vector<VertexVertexMap> received_vertex_to_deepest;
-    std::vector<AmrEdgeVector> received_edges;
-    std::vector<std::vector<AmrVertexId>> received_deepest_vertices;
-    std::vector<std::vector<int>> received_original_gids;
-    
-    AmrVertexSet keep; // for sparsification
+    for (const diy::BlockID& receiver : receivers)
+        amr_tmt_send_to(b, cp, l, receiver);
 
-    LinkVector received_links;
+    int done = b->done_;
+    b->round_++;
+    if (debug) fmt::print("Exit send_simple for block = {}, b->done = {}, b->round = {}\n", b->gid, done, b->round_);
+}
 
-#ifdef DO_DETAILED_TIMING
-    timer.restart();
-#endif
+// everything a block dequeued from its senders in one round (bulk) or one call (asynchronous)
+template<class Real, unsigned D>
+struct AmrTmtReceived
+{
+    using Block = FabTmtBlock<Real, D>;
 
-    auto senders = link_unique(l, b->gid);
-    std::vector<int> sender_gids_debug;
-    for(const auto& sender : senders)
+    std::vector<typename Block::TripletMergeTree>   trees;
+    std::vector<typename Block::VertexVertexMap>    vertex_to_deepest;
+    std::vector<typename Block::AmrEdgeContainer>   edges;
+    std::vector<std::vector<AmrVertexId>>           deepest_vertices;
+    std::vector<std::vector<int>>                   original_gids;
+    std::vector<std::vector<AmrLinkEntry>>          link_deltas;
+    std::vector<int>                                sender_gids;
+    std::vector<size_t>                             tree_messages;      // message (index into the above) of every tree
+
+    // no trees and no new link entries: nothing to merge, no link to expand
+    bool empty() const
     {
-        sender_gids_debug.push_back(sender.gid);
+        return trees.empty() and std::all_of(link_deltas.begin(), link_deltas.end(),
+                                             [](const std::vector<AmrLinkEntry>& d) { return d.empty(); });
     }
 
-    if (debug) fmt::print("In receive_simple for block = {}, # senders = {}\n", b->gid, senders.size());
-
-    for (const diy::BlockID& sender : senders)
+    // one message, as sent by amr_tmt_send_to
+    void dequeue(const diy::Master::ProxyWithLink& cp, int sender_gid)
     {
-        int n_trees;
+        int n_trees, n_new_entries;
 
-        received_original_gids.emplace_back();
-        cp.dequeue(sender, received_original_gids.back());
-        diy::MemoryBuffer& in = cp.incoming(sender.gid);
-        AMRLink* l = static_cast<AMRLink*>(diy::LinkFactory::load(in));
-        received_links.push_back(*l);
-        delete l;
+        cp.dequeue(sender_gid, n_trees);
+        cp.dequeue(sender_gid, n_new_entries);
 
-        cp.dequeue(sender, n_trees);
+        sender_gids.push_back(sender_gid);
+        original_gids.emplace_back();
+        if (n_trees or n_new_entries)
+            cp.dequeue(sender_gid, original_gids.back());
 
-//        if (debug) fmt::print("In receive_simple for block = {}, dequeued from sender {} n_trees = {} \n", b->gid, sender.gid, n_trees);
+        link_deltas.emplace_back(n_new_entries);
+        for(AmrLinkEntry& e : link_deltas.back())
+            cp.dequeue(sender_gid, e);
 
         if (n_trees > 0)
         {
             assert(n_trees == 1);
 
-            received_trees.emplace_back();
-            received_vertex_to_deepest.emplace_back();
-            received_deepest_vertices.emplace_back();
-            received_edges.emplace_back();
-
-            cp.dequeue(sender, received_trees.back());
-            cp.dequeue(sender, received_vertex_to_deepest.back());
-            cp.dequeue(sender, received_deepest_vertices.back());
-            cp.dequeue(sender, received_edges.back());
-
-//            if (debug) fmt::print( "In receive_simple for block = {}, dequeued from sender {} original link gids = {}\n", b->gid, sender.gid, container_to_string(received_original_gids.back()));
+            tree_messages.push_back(sender_gids.size() - 1);
+            trees.emplace_back();
+            vertex_to_deepest.emplace_back();
+            deepest_vertices.emplace_back();
+            edges.emplace_back();
 
+            cp.dequeue(sender_gid, trees.back());
+            cp.dequeue(sender_gid, vertex_to_deepest.back());
+            cp.dequeue(sender_gid, deepest_vertices.back());
+            reeber::AmrEdgeCodec::load(cp.incoming(sender_gid), edges.back());
         }
     }
+};
 
+// merge the received trees into the current tree, collect new receivers, sparsify, expand the link
+// and recompute done_; shared by the bulk-synchronous and the asynchronous rounds
+template<class Real, unsigned D>
+void amr_tmt_merge_received(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp, AMRLink* l,
+                            AmrTmtReceived<Real, D>& received)
+{
 #ifdef DO_DETAILED_TIMING
-    b->receive_trees_and_gids_time += timer.elapsed();
-    timer.restart();
+    dlog::Timer timer;
+    dlog::Timer rl_loop_timer;
+    dlog::Timer merge_timer;
+    dlog::Timer union_find_timer;
 #endif
 
+    bool debug = false; // (b->gid == 1 or b->gid == 100);
+
+    using Block = FabTmtBlock<Real, D>;
+    using AmrTripletMergeTree = typename Block::TripletMergeTree;
+    using AmrVertexSet = typename Block::AmrVertexSet;
+
+    auto& received_trees = received.trees;
+    auto& received_vertex_to_deepest = received.vertex_to_deepest;
+    auto& received_edges = received.edges;
+    auto& received_deepest_vertices = received.deepest_vertices;
+    auto& received_original_gids = received.original_gids;
+    auto& sender_gids_debug = received.sender_gids;
+
+    AmrVertexSet keep; // for sparsification
 
     assert(received_trees.size() == received_vertex_to_deepest.size() and
            received_trees.size() == received_edges.size() and
@@ -242,10 +305,6 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
 
     //if (debug) fmt::print("In receive_simple for block = {}, dequeed all, edges checked OK\n", b->gid);
 
-    // vertices in our processed neighbourhood, from which there is an edge going out to blocks we have not communicated with
-    // if any of these vertices is in a connected component of original tree, we are not done
-    std::vector<AmrVertexId> vertices_to_check;
-
     // merge all received trees
     for (size_t i = 0; i < received_trees.size(); ++i)
     {
@@ -271,7 +330,7 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
         b->merge_call_time += merge_timer.elapsed();
 #endif
 
-        if (debug) fmt::print( "In receive_simple for block = {}, merge and repair OK for sender = {}, tree size = {}\n", b->gid, sender_gids_debug[i], b->get_merge_tree().size());
+        if (debug) fmt::print( "In receive_simple for block = {}, merge and repair OK for sender = {}, tree size = {}\n", b->gid, sender_gids_debug[received.tree_messages[i]], b->get_merge_tree().size());
 
         // save information about vertex-component relation and component merging in block
         b->original_vertex_to_deepest_.insert(received_vertex_to_deepest[i].begin(),
@@ -299,23 +358,14 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
         rl_loop_timer.restart();
 #endif
 
-        for (const AMRLink& rl : received_links)
+        for (int sender_neighbor_gid : received_original_gids[received.tree_messages[i]])
         {
-            for (int k = 0; k < rl.size(); ++k)
-            {
-                int sender_neighbor_gid = rl.target(k).gid;
-
-                auto& original_gids = received_original_gids[i];
-
-                bool is_in_original_gids = std::find(original_gids.begin(), original_gids.end(), sender_neighbor_gid) !=
-                                           original_gids.end();
-                bool is_not_processed = b->processed_receivers_.count(sender_neighbor_gid) == 0;
+            bool is_not_processed = b->processed_receivers_.count(sender_neighbor_gid) == 0;
 
-                //if (debug) fmt::print( "In receive_simple for block = {}, round = {}, sender_neighbor_gid = {}, is_in_original_gids = {}, is_not_processed = {}\n", b->gid, b->round_, sender_neighbor_gid, is_in_original_gids, is_not_processed);
+            //if (debug) fmt::print( "In receive_simple for block = {}, round = {}, sender_neighbor_gid = {}, is_not_processed = {}\n", b->gid, b->round_, sender_neighbor_gid, is_not_processed);
 
-                if (is_not_processed and is_in_original_gids)
-                    b->new_receivers_.insert(sender_neighbor_gid);
-            }
+            if (is_not_processed)
+                b->new_receivers_.insert(sender_neighbor_gid);
         }
 
 #ifdef DO_DETAILED_TIMING
@@ -338,6 +388,10 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
 
 //    if (debug) fmt::print("In receive_simple for block = {}, processed_receiveres_ OK\n", b->gid);
 
+    // vertices in our processed neighbourhood, from which there is an edge going out to blocks we have not communicated with
+    // if any of these vertices is in a connected component of original tree, the edge is pending and we are not done
+    auto our_deepest = b->update_current_deepest();
+
     // update disjoint sets data structure (some components are now connected to each other)
     for (size_t i = 0; i < received_trees.size(); ++i)
     {
@@ -351,7 +405,7 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
 //                b->connect_components(deepest_a, deepest_b);
             } else
             {
-                vertices_to_check.push_back(std::get<0>(e));
+                b->add_pending_edge(std::get<0>(e), our_deepest);
             }
         }
     }
@@ -372,7 +426,7 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
 
     if (debug) fmt::print("In receive_simple for block = {}, disjoint sets updated OK, tree size = {}\n", b->gid, b->get_merge_tree().size());
 
-    expand_link(b, cp, l, received_links, received_original_gids);
+    expand_link(b, cp, l, received.link_deltas, received_original_gids);
 
 #ifdef DO_DETAILED_TIMING
     b->expand_link_time += timer.elapsed();
@@ -381,29 +435,107 @@ void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink&
 
     if (debug) fmt::print("Exit receive_simple for block = {}, expand_link OK\n", b->gid);
 
-    b->done_ = b->is_done_simple(vertices_to_check);
-
-
+    b->done_ = b->is_done_simple();
 
+#ifdef DO_DETAILED_TIMING
+    b->is_done_time += timer.elapsed();
+#endif
 
-    int n_undone = 1 - b->done_;
+    if (debug)
+        fmt::print("In receive_simple for block = {}, is_done_simple OK, n_pending = {}\n", b->gid, b->n_pending_);
+}
 
+template<class Real, unsigned D>
+void amr_tmt_receive(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp)
+{
 #ifdef DO_DETAILED_TIMING
-    b->is_done_time += timer.elapsed();
-    timer.restart();
+    dlog::Timer timer;
 #endif
 
+    bool debug = false; // (b->gid == 1 or b->gid == 100);
+
+    if (debug) fmt::print("Called receive_simple for block = {}\n", b->gid);
 
-    cp.collectives()->clear();
-    cp.all_reduce(n_undone, std::plus<int>());
+    auto* l = static_cast<AMRLink*>(cp.link());
 
-    if (debug)
-        fmt::print("In receive_simple for block = {}, is_done_simple OK, vertices_to_check.size = {}\n", b->gid,
-                   vertices_to_check.size());
+    // retired blocks have nothing to receive
+    if (b->retired_)
+        return;
+
+    AmrTmtReceived<Real, D> received;
+
+    auto senders = link_unique(l, b->gid);
+
+    if (debug) fmt::print("In receive_simple for block = {}, # senders = {}\n", b->gid, senders.size());
+
+    for (const diy::BlockID& sender : senders)
+        received.dequeue(cp, sender.gid);
+
+#ifdef DO_DETAILED_TIMING
+    b->receive_trees_and_gids_time += timer.elapsed();
+#endif
+
+    // pending edges of the previous round went to new_receivers_, count the ones that arrive in this round;
+    // a block that got nothing new skips the merge, the sparsification and the link expansion
+    b->n_pending_ = 0;
+    if (received.empty())
+        b->done_ = b->is_done_simple();
+    else
+        amr_tmt_merge_received(b, cp, l, received);
 
     int old_size_unique = l->size_unique();
     int old_size = l->size();
 
     if (debug) fmt::print( "In receive_simple for block = {}, b->done_ = {}, old link size = {}, old link size_unqie = {}\n", b->gid, b->done_, old_size, old_size_unique);
+}
+
+// Asynchronous counterpart of amr_tmt_send + amr_tmt_receive, to be called from master.iexchange:
+// merge whatever has arrived and send our tree right away to every receiver we have learned about.
+// Messages without a tree are not sent: the link and the original gids of a block travel with its tree.
+// Always returns true, a block has nothing to do until a new message arrives;
+// iexchange terminates when all blocks are done and no messages are in flight.
+// b->round_ counts the calls in which the block received something.
+template<class Real, unsigned D>
+bool amr_tmt_async(FabTmtBlock<Real, D>* b, const diy::Master::ProxyWithLink& cp)
+{
+    bool debug = false;
+
+    if (b->retired_)
+        return true;
+
+    auto* l = static_cast<AMRLink*>(cp.link());
+
+    AmrTmtReceived<Real, D> received;
+
+    std::vector<int> incoming_gids;
+    cp.incoming(incoming_gids);
+    for (int sender_gid : incoming_gids)
+    {
+        diy::MemoryBuffer& in = cp.incoming(sender_gid);
+        while (in)
+            received.dequeue(cp, sender_gid);
+    }
+
+    if (not received.empty())
+    {
+        b->round_++;
+        b->n_pending_ = 0;
+        amr_tmt_merge_received(b, cp, l, received);
+    }
+
+    if (b->done_ == 0)
+        for (const diy::BlockID& receiver : link_unique(l, b->gid))
+            if (b->new_receivers_.count(receiver.gid) and b->processed_receivers_.count(receiver.gid) == 0)
+                amr_tmt_send_to(b, cp, l, receiver);
+
+    // nothing arrived and nothing is left to send: as in amr_tmt_receive, the block is done unless edges are pending;
+    // a block without receivers (e.g., an isolated component) never receives anything and is done here
+    if (received.empty() and std::all_of(b->new_receivers_.begin(), b->new_receivers_.end(),
+                                         [b](int gid) { return b->processed_receivers_.count(gid) == 1; }))
+        b->done_ = b->is_done_simple();
+
+    if (debug) fmt::print("Exit amr_tmt_async for block = {}, received from {} senders, b->done = {}, b->round = {}\n",
+                          b->gid, received.sender_gids.size(), b->done_, b->round_);
 
+    return true;
 }
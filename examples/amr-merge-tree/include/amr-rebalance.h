@@ -0,0 +1,256 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <queue>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include <diy/master.hpp>
+#include <diy/link.hpp>
+#include <diy/mpi.hpp>
+#include <diy/serialization.hpp>
+
+// Rebalancing blocks between ranks, once their work is known (after init).
+// Every rank gathers the costs of all blocks, computes the same new assignment gid -> rank,
+// sends the blocks that change rank together with their links and points all links to the new ranks.
+
+// all blocks, sorted by gid, as gathered from all ranks
+struct BlockCosts
+{
+    std::vector<int> gids;
+    std::vector<int> ranks;         // current rank
+    std::vector<double> costs;
+
+    size_t size() const { return gids.size(); }
+};
+
+/**
+ *
+ * @param assignment rank for every block in costs
+ * @return load of the most loaded rank over the average load (1 is perfect balance, 0 if there is no work)
+ */
+inline double load_imbalance(const BlockCosts& costs, const std::vector<int>& assignment, int n_ranks)
+{
+    std::vector<double> load(n_ranks, 0);
+    for(size_t i = 0; i < costs.size(); ++i)
+        load[assignment[i]] += costs.costs[i];
+
+    double total = std::accumulate(load.begin(), load.end(), 0.0);
+    if (total == 0)
+        return 0;
+
+    return *std::max_element(load.begin(), load.end()) * n_ranks / total;
+}
+
+/**
+ * largest blocks first, each to the least loaded rank, ties go to the rank with fewer blocks;
+ * every rank gets at least one block, so the current assignment is kept if there are fewer blocks than ranks
+ * or no work at all
+ */
+inline std::vector<int> assign_greedy(const BlockCosts& costs, int n_ranks)
+{
+    double total = std::accumulate(costs.costs.begin(), costs.costs.end(), 0.0);
+    if (total == 0 or costs.size() < static_cast<size_t>(n_ranks))
+        return costs.ranks;
+
+    std::vector<int> assignment(costs.size());
+
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs.costs[a] > costs.costs[b]; });
+
+    // (load, number of blocks, rank), least loaded on top; a rank without blocks comes before any rank with blocks
+    using RankLoad = std::tuple<double, size_t, int>;
+    std::priority_queue<RankLoad, std::vector<RankLoad>, std::greater<RankLoad>> loads;
+    for(int rank = 0; rank < n_ranks; ++rank)
+        loads.emplace(0, 0, rank);
+
+    for(size_t i : order)
+    {
+        RankLoad least = loads.top();
+        loads.pop();
+        assignment[i] = std::get<2>(least);
+        std::get<0>(least) += costs.costs[i];
+        std::get<1>(least) += 1;
+        loads.push(least);
+    }
+
+    return assignment;
+}
+
+/**
+ * blocks in gid order, cut into n_ranks contiguous pieces of about the same cost;
+ * gids follow the order of boxes in the input, so blocks that were together mostly stay together.
+ * Every piece has at least one block, so the current assignment is kept if there are fewer blocks than ranks
+ * or no work at all
+ */
+inline std::vector<int> assign_contiguous(const BlockCosts& costs, int n_ranks)
+{
+    double total = std::accumulate(costs.costs.begin(), costs.costs.end(), 0.0);
+    if (total == 0 or costs.size() < static_cast<size_t>(n_ranks))
+        return costs.ranks;
+
+    std::vector<int> assignment(costs.size());
+    double prefix = 0;
+    int previous = -1;
+    for(size_t i = 0; i < costs.size(); ++i)
+    {
+        // the middle of the block decides its piece
+        double middle = prefix + costs.costs[i] / 2;
+        int rank = std::min(n_ranks - 1, static_cast<int>(middle * n_ranks / total));
+
+        // no piece is skipped, and enough blocks are left for the pieces after this one
+        int n_left = static_cast<int>(costs.size() - i);
+        rank = std::max(previous, std::min(previous + 1, rank));
+        rank = std::max(rank, n_ranks - n_left);
+
+        assignment[i] = rank;
+        previous = rank;
+        prefix += costs.costs[i];
+    }
+
+    return assignment;
+}
+
+/**
+ *
+ * @param cost cost(b) of a block of master
+ * @return costs of all blocks on all ranks
+ */
+template<class Block, class Cost>
+BlockCosts gather_block_costs(diy::Master& master, const Cost& cost)
+{
+    std::vector<int> local_gids;
+    std::vector<double> local_costs;
+    for(int i = 0; i < master.size(); ++i)
+    {
+        local_gids.push_back(master.gid(i));
+        local_costs.push_back(cost(master.block<Block>(i)));
+    }
+
+    std::vector<std::vector<int>> all_gids;
+    std::vector<std::vector<double>> all_costs;
+    diy::mpi::all_gather(master.communicator(), local_gids, all_gids);
+    diy::mpi::all_gather(master.communicator(), local_costs, all_costs);
+
+    std::map<int, std::pair<int, double>> by_gid;
+    for(size_t rank = 0; rank < all_gids.size(); ++rank)
+        for(size_t j = 0; j < all_gids[rank].size(); ++j)
+            by_gid[all_gids[rank][j]] = { static_cast<int>(rank), all_costs[rank][j] };
+
+    BlockCosts result;
+    for(const auto& gid_rank_cost : by_gid)
+    {
+        result.gids.push_back(gid_rank_cost.first);
+        result.ranks.push_back(gid_rank_cost.second.first);
+        result.costs.push_back(gid_rank_cost.second.second);
+    }
+    return result;
+}
+
+/**
+ *
+ * move every block of master to the rank given by assignment, with its link, and update all links
+ *
+ * @param costs all blocks, as returned by gather_block_costs
+ * @param assignment new rank for every block in costs
+ * @param save save(b, bb) writes everything a block needs on the new rank
+ * @param load load(gid, link, bb) creates a block from what save wrote; link is the block's link
+ * @return number of local blocks that were sent to other ranks
+ */
+template<class Block, class Save, class Load>
+int migrate_blocks(diy::Master& master, const BlockCosts& costs, const std::vector<int>& assignment,
+        const Save& save, const Load& load)
+{
+    const diy::mpi::communicator& comm = master.communicator();
+    const int tag = 0;
+
+    std::unordered_map<int, int> new_rank;
+    for(size_t i = 0; i < costs.size(); ++i)
+        new_rank[costs.gids[i]] = assignment[i];
+
+    // blocks stay in the order of their gids, as after reading
+    std::vector<std::pair<int, std::pair<Block*, diy::Link*>>> kept;
+    std::map<int, diy::MemoryBuffer> outgoing;
+    int n_sent = 0;
+
+    for(int i = 0; i < master.size(); ++i)
+    {
+        int gid = master.gid(i);
+        int rank = new_rank.at(gid);
+        auto* b = master.block<Block>(i);
+        diy::Link* l = master.link(i);
+
+        if (rank == comm.rank())
+        {
+            // master deletes the link on release, keep a copy
+            diy::MemoryBuffer link_buffer;
+            diy::LinkFactory::save(link_buffer, l);
+            link_buffer.reset();
+            kept.emplace_back(gid, std::make_pair(b, diy::LinkFactory::load(link_buffer)));
+        } else
+        {
+            diy::MemoryBuffer& out = outgoing[rank];
+            diy::save(out, gid);
+            diy::LinkFactory::save(out, l);
+            save(b, out);
+            n_sent++;
+        }
+    }
+
+    // master destroys the blocks it owns in clear, so take all of them out first
+    for(int i = 0; i < master.size(); ++i)
+    {
+        bool is_sent = new_rank.at(master.gid(i)) != comm.rank();
+        void* b = master.release(i);
+        if (is_sent)
+            Block::destroy(b);
+    }
+    master.clear();
+
+    std::vector<diy::mpi::request> requests;
+    for(auto& rank_buffer : outgoing)
+        requests.push_back(comm.isend(rank_buffer.first, tag, rank_buffer.second.buffer));
+
+    std::set<int> senders;
+    for(size_t i = 0; i < costs.size(); ++i)
+    {
+        if (assignment[i] == comm.rank() and costs.ranks[i] != comm.rank())
+            senders.insert(costs.ranks[i]);
+    }
+
+    for(int sender : senders)
+    {
+        diy::MemoryBuffer in;
+        comm.recv(sender, tag, in.buffer);
+        while(in.position < in.buffer.size())
+        {
+            int gid;
+            diy::load(in, gid);
+            diy::Link* l = diy::LinkFactory::load(in);
+            kept.emplace_back(gid, std::make_pair(load(gid, l, in), l));
+        }
+    }
+
+    for(diy::mpi::request& request : requests)
+        request.wait();
+
+    std::sort(kept.begin(), kept.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for(auto& gid_block_link : kept)
+    {
+        diy::Link* l = gid_block_link.second.second;
+        for(diy::BlockID& nbr : l->neighbors())
+            nbr.proc = new_rank.at(nbr.gid);
+        master.add(gid_block_link.first, gid_block_link.second.first, l);
+    }
+
+    return n_sent;
+}
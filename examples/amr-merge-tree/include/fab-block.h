@@ -1,11 +1,80 @@
 #pragma once
 
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
 #include <diy/serialization.hpp>
 #include <diy/grid.hpp>
 #include <diy/vertices.hpp>
 #include <reeber/format.h>
 #include <reeber/amr_helper.h>
+#include <reeber/linear-combination.h>
+
+
+// per-block statistics of a field, accumulated by load_field
+template<class T>
+struct FieldStats
+{
+    T sum { 0 };                // all values
+    T sum_finite { 0 };         // values that are neither nan nor inf
+    long int n { 0 };
+    long int n_nans { 0 };
+    long int n_infs { 0 };
+    long int n_negs { 0 };
+    long int n_finite { 0 };
+
+    FieldStats& operator+=(const FieldStats& other)
+    {
+        sum += other.sum;
+        sum_finite += other.sum_finite;
+        n += other.n;
+        n_nans += other.n_nans;
+        n_infs += other.n_infs;
+        n_negs += other.n_negs;
+        n_finite += other.n_finite;
+        return *this;
+    }
+};
+
+// Single pass over a field of size n that has just been read into src:
+// copies it into copy (if not null), stores it into function (init_function) or adds it to function (otherwise),
+// if add_to_function is set; returns its statistics. If init_function is set, but add_to_function is not,
+// function is zeroed. The loop body has no data-dependent branches, so it vectorizes.
+template<class T>
+FieldStats<T> load_field(const T* src, size_t n, T* copy, T* function, bool init_function, bool add_to_function)
+{
+    FieldStats<T> stats;
+    stats.n = n;
+
+    T sum = 0, sum_finite = 0;
+    long int n_nans = 0, n_infs = 0, n_negs = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        T x = src[i];
+        bool is_nan = x != x;
+        bool is_inf = std::abs(x) == std::numeric_limits<T>::infinity();
+        sum += x;
+        sum_finite += (is_nan or is_inf) ? T(0) : x;
+        n_nans += is_nan;
+        n_infs += is_inf;
+        n_negs += x < 0;
+
+        // flags are loop-invariant, the compiler hoists the checks out of the loop
+        if (copy)
+            copy[i] = x;
+        if (function)
+            function[i] = (init_function ? T(0) : function[i]) + (add_to_function ? x : T(0));
+    }
 
+    stats.sum = sum;
+    stats.sum_finite = sum_finite;
+    stats.n_nans = n_nans;
+    stats.n_infs = n_infs;
+    stats.n_negs = n_negs;
+    stats.n_finite = n - n_nans - n_infs;
+    return stats;
+}
 
 template<class T, unsigned D>
 struct FabBlock
@@ -14,6 +83,7 @@ struct FabBlock
     using Vertex = diy::Point<int, D>;
     using Grid = diy::Grid<T, D>;
     using GridRef = diy::GridRef<T, D>;
+    using Function = reeber::LinearCombination<T, D>;
 
     FabBlock() :
             fab(fab_storage_.data(), fab_storage_.shape(), fab_storage_.c_order())
@@ -37,13 +107,27 @@ struct FabBlock
 
     ~FabBlock()
     {
-        for (auto& fab : extra_fabs_)
-            delete[] fab.data();
+        bool fab_is_extra = false;
+        for (auto& extra_fab : extra_fabs_)
+        {
+            fab_is_extra = fab_is_extra or extra_fab.data() == fab.data();
+            if (extra_fab.data() != fab_storage_.data())
+                delete[] extra_fab.data();
+        }
 
-        if (fab.data() != fab_storage_.data())
+        if (fab.data() != fab_storage_.data() and not fab_is_extra)
             delete[] fab.data();
     }
 
+    // function for merge tree computation: if n_function_fields_ > 0, sum of the first n_function_fields_
+    // extra fabs (evaluated lazily, no summed copy is stored), otherwise fab
+    Function function() const
+    {
+        if (n_function_fields_ == 0)
+            return Function(fab);
+        return Function(std::vector<GridRef>(extra_fabs_.begin(), extra_fabs_.begin() + n_function_fields_));
+    }
+
     static void* create()
     {
         return new FabBlock;
@@ -65,6 +149,7 @@ struct FabBlock
 
     std::vector<std::string> extra_names_; // vector of names additional components
     std::vector<diy::GridRef<T, D>> extra_fabs_; // vector of additional components' data
+    int n_function_fields_ { 0 };                // if positive, fab only provides the shape, see function()
 
 };
 
@@ -75,7 +160,15 @@ FabBlock<T, D>::save(const void* b_, diy::BinaryBuffer& bb)
     auto* b = static_cast<const FabBlock<T, D>*>(b_);
     diy::save(bb, b->fab.shape());
     diy::save(bb, b->fab.c_order());
-    diy::save(bb, b->fab.data(), b->fab.size());
+    if (b->n_function_fields_ == 0)
+    {
+        diy::save(bb, b->fab.data(), b->fab.size());
+    } else
+    {
+        std::vector<T> values(b->fab.size());
+        b->function().evaluate(0, values.size(), values.data());
+        diy::save(bb, values.data(), values.size());
+    }
 }
 
 template<class T, unsigned D>
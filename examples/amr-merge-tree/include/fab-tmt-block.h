@@ -1,6 +1,9 @@
 #pragma once
 
 #include <utility>
+#include <algorithm>
+#include <unordered_set>
+#include <memory>
 #include <numeric>
 #include <boost/functional/hash.hpp>
 
@@ -16,9 +19,14 @@
 #include "reeber/triplet-merge-tree.h"
 #include "reeber/triplet-merge-tree-serialization.h"
 #include "reeber/grid.h"
+#include "reeber/linear-combination.h"
 #include "reeber/grid-serialization.h"
 #include "reeber/masked-box.h"
+#include "reeber/amr-link-index.h"
 #include "reeber/edges.h"
+#include "reeber/amr-boundary-cells.h"
+#include "reeber/flat-containers.h"
+#include "reeber/flat-containers-serialization.h"
 
 #include "fab-block.h"
 #include "reeber/amr_helper.h"
@@ -32,10 +40,12 @@ struct FabTmtBlock
 
     using Grid = r::Grid<Real, D>;
     using GridRef = r::GridRef<Real, D>;
+    using Function = r::LinearCombination<Real, D>;       // sum of function fields, evaluated on the fly
     // index of point: first = index inside box, second = index of a box
     using AmrVertexId = r::AmrVertexId;
     using Value = typename Grid::Value;
     using MaskedBox = r::MaskedBox<D>;
+    using MaskValue = typename MaskedBox::MaskValue;
     using Vertex = typename MaskedBox::Position;
     using TripletMergeTree = r::TripletMergeTree<r::AmrVertexId, Value>;
     using AmrVertexContainer = std::vector<AmrVertexId>;
@@ -47,9 +57,12 @@ struct FabTmtBlock
 
     using AmrEdge = r::AmrEdge;
     using AmrEdgeContainer = r::AmrEdgeContainer;
+    using BoundaryCells = r::AmrBoundaryCells<>;
     using AmrEdgeSet = std::set<AmrEdge>;
-    using VertexEdgesMap = std::map<AmrVertexId, AmrEdgeContainer>;
-    using VertexVertexMap = std::map<AmrVertexId, AmrVertexId>;
+    // per-vertex bookkeeping: flat hash maps, no allocation per vertex
+    using VertexEdgesMap = r::FlatHashMap<AmrVertexId, AmrEdgeContainer>;
+    using VertexVertexMap = r::FlatHashMap<AmrVertexId, AmrVertexId>;
+    using DeepestSet = r::SortedVectorSet<AmrVertexId>;
     using VertexSizeMap = std::map<AmrVertexId, int>;
 
     using GidContainer = std::set<int>;
@@ -166,14 +179,43 @@ struct FabTmtBlock
     // if relative threshold is given, we cannot determine
     // LOW values in constructor. Instead, we mark all unmasked vertices
     // ACTIVE and save the average of their values in local_sum_ and the number in local_n_unmasked_
-    // Pointer to grid data is saved in fab_ and after all blocks exchange their local averages
+    // Function (references to grid data) is saved in fab_ and after all blocks exchange their local averages
     // we resume initialization
     Real sum_ { 0 };
     size_t n_unmasked_ { 0 };
     size_t n_active_ { 0 };
     size_t n_masked_ { 0 };
     size_t n_low_ { 0 };
-    GridRef fab_;
+    Function fab_;
+
+    // the counters above, accumulated per task in the parallel mask passes (set_mask, set_low) and added up
+    struct MaskCounts
+    {
+        Real sum { 0 };
+        size_t n_unmasked { 0 };
+        size_t n_active { 0 };
+        size_t n_masked { 0 };
+        size_t n_low { 0 };
+
+        MaskCounts& operator+=(const MaskCounts& other)
+        {
+            sum += other.sum;
+            n_unmasked += other.n_unmasked;
+            n_active += other.n_active;
+            n_masked += other.n_masked;
+            n_low += other.n_low;
+            return *this;
+        }
+    };
+
+    void add_mask_counts(const MaskCounts& counts)
+    {
+        sum_ += counts.sum;
+        n_unmasked_ += counts.n_unmasked;
+        n_active_ += counts.n_active;
+        n_masked_ += counts.n_masked;
+        n_low_ += counts.n_low;
+    }
 
     // this vector is not serialized, because we send trees component-wise
     std::vector<Component> components_;
@@ -181,8 +223,8 @@ struct FabTmtBlock
     diy::DiscreteBounds domain_ { D };
 
     int done_ { 0 };
-    int n_debug_printed_bdry_ { 0 };
-    int n_debug_printed_core_ { 0 };
+    // no active cells: link is empty, block skips send_boundary_cells_to_neighbors, delete_low_edges and all rounds
+    bool retired_ { false };
 
     //    // will be changed in each communication round
     //    // only for baseiline algorithm
@@ -192,13 +234,24 @@ struct FabTmtBlock
     // only for baseiline algorithm
     AmrEdgeContainer initial_edges_;
 
-    std::map<int, AmrEdgeContainer> gid_to_outgoing_edges_;
+    r::FlatHashMap<int, AmrEdgeContainer> gid_to_outgoing_edges_;
 
     std::set<int> new_receivers_;
     std::set<int> processed_receivers_;
 
     GidVector original_link_gids_;
 
+    // link deltas: number of link entries already sent to each receiver (the link only grows at the end)
+    std::map<int, int> link_sent_size_;
+
+    // gid -> index in the link, for the first link_indexed_size_ entries; not serialized, rebuilt by index_link
+    std::unordered_map<int, int> link_gid_to_idx_;
+    int link_indexed_size_ { 0 };
+
+    // edges sent since the counters were last collected: plain serialization size and encoded size, not serialized
+    size_t edge_bytes_raw_ { 0 };
+    size_t edge_bytes_sent_ { 0 };
+
     bool negate_;
 
     // to store information about local connected component in a serializable way
@@ -206,8 +259,9 @@ struct FabTmtBlock
     VertexVertexMap current_vertex_to_deepest_;
     VertexVertexMap final_vertex_to_deepest_;
 
-    std::set<AmrVertexId> original_deepest_;
-    std::set<AmrVertexId> current_deepest_;
+    DeepestSet original_deepest_;
+    DeepestSet current_deepest_;    // one vertex of original_deepest_ per component of current_merge_tree_
+    size_t n_pending_ { 0 };        // edges received in this round that start in our components and lead to blocks we have not heard from; reset when a round starts
 
     // tracking how connected components merge - disjoint sets data structure
 //    VertexVertexMap components_disjoint_set_parent_;
@@ -249,7 +303,7 @@ struct FabTmtBlock
     const GidVector& get_original_link_gids() const
     { return original_link_gids_; }
 
-    FabTmtBlock(diy::GridRef<Real, D>& fab_grid,
+    FabTmtBlock(const Function& fab_grid,
                 int _ref,
                 int _level,
                 const diy::DiscreteBounds& _domain,
@@ -261,11 +315,11 @@ struct FabTmtBlock
                 bool _negate,
                 bool is_absolute_threshold) :
             gid(_gid),
-            local_(project_point<D>(core.min), project_point<D>(core.max), project_point<D>(bounds.min),
-                   project_point<D>(bounds.max), _ref, _level, gid, fab_grid.c_order()),
+            local_(point_from_dynamic_point<D>(core.min), point_from_dynamic_point<D>(core.max), point_from_dynamic_point<D>(bounds.min),
+                   point_from_dynamic_point<D>(bounds.max), _ref, _level, gid, fab_grid.c_order()),
             current_merge_tree_(_negate),
             original_tree_(_negate),
-            fab_(fab_grid.data(), fab_grid.shape(), fab_grid.c_order()),
+            fab_(fab_grid),
             domain_(_domain),
             processed_receivers_({ gid }),
             negate_(_negate)
@@ -274,12 +328,16 @@ struct FabTmtBlock
 
         std::string debug_prefix = "FabTmtBlock ctor, gid = " + std::to_string(gid);
 
-        if (debug) fmt::print("{} setting mask, pointer = {}\n", debug_prefix, (void*)fab_grid.data());
+        if (debug) fmt::print("{} setting mask, shape = {}, n_grids = {}\n", debug_prefix, fab_grid.shape(), fab_grid.n_grids());
+
+        r::AmrLinkIndex<D> link_index(amr_link, local_.level(), local_.refinement(), local_.mask_from(),
+                                      local_.mask_shape(), domain_, local_.c_order());
 
-        //  mask coordinates here
-        diy::for_each(local_.mask_shape(), [this, amr_link, rho, is_absolute_threshold](const Vertex& v) {
-            this->set_mask(v, amr_link, rho, is_absolute_threshold);
-        });
+        //  mask coordinates here; cells are processed in parallel with TBB
+        add_mask_counts(local_.template transform_mask<MaskCounts>(
+                [this, amr_link, &link_index, rho, is_absolute_threshold](const Vertex& v, MaskCounts& counts) {
+                    return this->set_mask(v, amr_link, link_index, rho, is_absolute_threshold, counts);
+                }));
 
         int max_gid = 0;
         for (int i = 0; i < amr_link->size(); ++i)
@@ -287,7 +345,7 @@ struct FabTmtBlock
             max_gid = std::max(max_gid, amr_link->target(i).gid);
         }
 
-        if (debug) fmt::print("TMT constructed gid = {}, local = {}, max_gid = {}, avg = {} / {} = {}, fab_ = {}\n", gid, local_, max_gid, sum_, n_active_,  sum_ / n_active_,  (void*)(fab_.data()));
+        if (debug) fmt::print("TMT constructed gid = {}, local = {}, max_gid = {}, avg = {} / {} = {}, fab_.shape = {}\n", gid, local_, max_gid, sum_, n_active_,  sum_ / n_active_,  fab_.shape());
 
         if (debug) local_.check_mask_validity(max_gid);
 
@@ -297,10 +355,19 @@ struct FabTmtBlock
         }
     }
 
-    FabTmtBlock() :
-            fab_(nullptr, diy::Point<int, D>::zero())
+    FabTmtBlock()
     {}
 
+    // block on the rank it migrates to, see load_state: only the geometry of local_ is set (from the link),
+    // the mask is not computed and there is no function
+    FabTmtBlock(int _gid, diy::AMRLink *amr_link, bool c_order) :
+            gid(_gid),
+            local_(point_from_dynamic_point<D>(amr_link->core().min), point_from_dynamic_point<D>(amr_link->core().max),
+                   point_from_dynamic_point<D>(amr_link->bounds().min), point_from_dynamic_point<D>(amr_link->bounds().max),
+                   amr_link->refinement()[0], amr_link->level(), gid, c_order)
+    {
+    }
+
     void init(Real absolute_rho, diy::AMRLink *amr_link);
 
     void sparsify_prune_original_tree();
@@ -310,14 +377,19 @@ struct FabTmtBlock
     // compare w.r.t negate_ flag
     bool cmp(Real a, Real b) const;
 
-    void set_low(const diy::Point<int, D>& v_bounds,
-                 const Real& absolute_rho);
+    // set_low and set_mask return the new mask value of v_mask instead of setting it,
+    // and count into counts instead of the block counters; see MaskedBox::transform_mask
+    MaskValue set_low(const diy::Point<int, D>& v_mask,
+                      const Real& absolute_rho,
+                      MaskCounts& counts) const;
 
 
-    void set_mask(const diy::Point<int, D>& v_mask,
-                  diy::AMRLink *l,
-                  const Real& rho,
-                  bool is_absolute_threshold);
+    MaskValue set_mask(const diy::Point<int, D>& v_mask,
+                       diy::AMRLink *l,
+                       const r::AmrLinkIndex<D>& link_index,
+                       const Real& rho,
+                       bool is_absolute_threshold,
+                       MaskCounts& counts);
 
     const TripletMergeTree& get_merge_tree() const
     { return current_merge_tree_; }
@@ -365,10 +437,19 @@ struct FabTmtBlock
 
     void compute_final_connected_components();
 
-    void delete_low_edges(int sender_gid, AmrEdgeContainer& edges_from_sender);
+    // active cells of this block with edges to receiver, what delete_low_edges of receiver needs
+    BoundaryCells boundary_cells(int receiver_gid) const;
+
+    void delete_low_edges(int sender_gid, const BoundaryCells& cells_from_sender);
 
     void adjust_outgoing_edges();
 
+    // true, if the block has active cells with edges to other blocks, i.e., takes part in the rounds
+    bool is_communicating() const
+    { return n_active_ > 0 and not gid_to_outgoing_edges_.empty(); }
+
+    void retire_neighbors(const std::unordered_set<int>& communicating_gids);
+
 //    void adjust_original_gids(int sender_gid, FabTmtBlock::GidVector& edges_from_sender);
 
     // disjoint-sets related methods
@@ -394,7 +475,13 @@ struct FabTmtBlock
 
 #endif
 
-    int is_done_simple(const std::vector<FabTmtBlock::AmrVertexId>& vertices_to_check);
+    // after trees were merged: keep one original deepest vertex per current component, return their current deepest vertices
+    std::unordered_set<AmrVertexId> update_current_deepest();
+
+    // v: source of a received edge whose target we do not have; pending, if v is in one of our components
+    void add_pending_edge(const AmrVertexId& v, const std::unordered_set<AmrVertexId>& our_deepest);
+
+    int is_done_simple() const;
 
     void compute_local_integral();
 
@@ -424,9 +511,21 @@ struct FabTmtBlock
         delete static_cast<FabTmtBlock *>(b);
     }
 
+    // estimate of the work of the block in the rounds, for rebalancing:
+    // active cells, nodes of the local tree and outgoing edges; retired blocks cost nothing
+    double cost() const;
+
     static void save(const void *b, diy::BinaryBuffer& bb);
 
     static void load(void *b, diy::BinaryBuffer& bb);
+
+    // complete state after init, to move the block to another rank (save and load write the output,
+    // which leaves out what is needed only in the rounds); mask and function are not needed after init and not moved;
+    // components are moved by root, or whole with AMR_MT_SEND_COMPONENTS
+    static void save_state(const void *b, diy::BinaryBuffer& bb);
+
+    // new block on the receiving rank, amr_link is its link
+    static FabTmtBlock* load_state(int gid, diy::AMRLink *amr_link, diy::BinaryBuffer& bb);
 };
 
 
@@ -8,13 +8,13 @@ bool FabTmtBlock<Real, D>::cmp(Real a, Real b) const
 }
 
 template<class Real, unsigned D>
-void FabTmtBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
+typename FabTmtBlock<Real, D>::MaskValue FabTmtBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
         diy::AMRLink* l,
+        const r::AmrLinkIndex<D>& link_index,
         const Real& rho,
-        bool is_absolute_threshold)
+        bool is_absolute_threshold,
+        MaskCounts& counts)
 {
-    using Position = diy::Point<int, D>;
-
     int debug_gid = local_.gid();
 
     bool debug = false; //gid == 24316;
@@ -47,18 +47,16 @@ void FabTmtBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
 
     if (debug)
     {
-        if (n_debug_printed_core_ < 10 and not is_on_boundary and is_in_core)
+        if (not is_on_boundary and is_in_core)
         {
-            n_debug_printed_core_++;
             fmt::print(
                     "PRINTING CORE gid = {}, in set_mask, v_mask = {}, v_idx = {}, value = {}, is_ghost = {}, is_on_boundary = {}, is_in_core = {}\n",
                     debug_gid, v_mask,
                     v_idx,
                     value, is_ghost, is_on_boundary, is_in_core);
         }
-        if (n_debug_printed_bdry_ < 10 and is_on_boundary)
+        if (is_on_boundary)
         {
-            n_debug_printed_bdry_++;
             fmt::print(
                     "PRINTING BDRY gid = {}, in set_mask, v_mask = {}, v_idx = {}, value = {}, is_ghost = {}, is_on_boundary = {}, is_in_core = {}\n",
                     debug_gid, v_mask,
@@ -68,91 +66,38 @@ void FabTmtBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
     }
 
     // initialization, actual mask to be set later
+    MaskValue result;
     if (is_ghost)
     {
         if (debug)
         { fmt::print("in set_mask, gid = {}, v_mask = {}, GHOST detected\n", debug_gid, v_mask); }
-        local_.set_mask(v_mask, MaskedBox::GHOST);
+        result = MaskedBox::GHOST;
     } else
     {
-        local_.set_mask(v_mask, MaskedBox::ACTIVE);
+        result = MaskedBox::ACTIVE;
     }
 
-    const int v_ref = local_.refinement();
-    const int v_level = local_.level();
-
-    Position v_glob = wrap_point(v_mask + local_.mask_from(), domain_, v_ref, true);
-
-//    if (debug)
-//    {
-//        fmt::print("in set_mask, gid = {}, unwrapped v_glob = {}, wrapped = {}, v_idx = {}, domain = [{} - {}], local = {}\n", local_.gid(),
-//                   v_mask + local_.mask_from(), v_glob, v_idx, domain_.min, domain_.max, local_);
-//    }
-
-
     bool mask_set{false};
 
-    // loop over neighbouring blocks one level above
-    for(int i = 0; i < l->size(); ++i)
-        if (l->level(i) == v_level + 1 && neighbor_contains<D>(i, l, v_glob, v_ref))
-        {
-            if (debug)
-            {
-                fmt::print("Is masked ABOVE {} , is_ghost = {}, gid = {}, v_idx = {}\n", local_.gid(), is_ghost,
-                        l->target(i).gid, v_idx);
-            }
-            mask_set = true;
-            local_.set_mask(v_mask, l->target(i).gid);
-            if (not is_ghost)
-                n_masked_++;
-            break;
-        }
-
-    // real cells can only be masked by blocks above, only ghost cells need to look at same level and below
-    if (not mask_set and is_ghost)
-    {
-        // loop over neighbours on the same level
-        for(int i = 0; i < l->size(); ++i)
-        {
-            if (l->level(i) == v_level && neighbor_contains<D>(i, l, v_glob, v_ref))
-            {
-                if (debug)
-                {
-                    fmt::print("Is masked SAME {} , is_ghost = {}, gid = {}, v_idx = {}\n", l->target(i).gid, is_ghost,
-                            local_.gid(), v_idx);
-                }
-                mask_set = true;
-                local_.set_mask(v_mask, l->target(i).gid);
-                if (not is_ghost)
-                    n_masked_++;
-                break;
-            }
-        }
-    }
-
-    // loop over neighbours one level below. This is not actual masking,
-    // but we save this info in ghost cells to get outgoing edges.
-    if (not mask_set and is_ghost)
+    // blocks one level above mask real and ghost cells, blocks on the same level and one level below
+    // only ghost cells (this is not actual masking, but we save this info in ghost cells to get outgoing edges)
+    int owner_idx = link_index.owner(v_mask, is_ghost);
+    if (owner_idx >= 0)
     {
-        for(int i = 0; i < l->size(); ++i)
+        if (debug)
         {
-            if (l->level(i) == v_level - 1 && neighbor_contains<D>(i, l, v_glob, v_ref))
-            {
-                if (debug)
-                {
-                    fmt::print("Is masked FAKE {} , is_ghost = {}, gid = {}, v_idx = {}\n", l->target(i).gid, is_ghost,
-                            local_.gid(), v_idx);
-                }
-                mask_set = true;
-                local_.set_mask(v_mask, l->target(i).gid);
-                break;
-            }
+            fmt::print("Is masked by {}, level = {}, is_ghost = {}, gid = {}, v_idx = {}\n", l->target(owner_idx).gid,
+                    l->level(owner_idx), is_ghost, local_.gid(), v_idx);
         }
+        mask_set = true;
+        result = l->target(owner_idx).gid;
+        if (not is_ghost)
+            counts.n_masked++;
     }
 
     if (not mask_set and is_low)
     {
-        local_.set_mask(v_mask, MaskedBox::LOW);
+        result = MaskedBox::LOW;
     }
 
     if (is_ghost and is_in_core)
@@ -162,43 +107,48 @@ void FabTmtBlock<Real, D>::set_mask(const diy::Point<int, D>& v_mask,
     {
         // we need to store local sum and local number of unmasked vertices in a block
         // and use this later to mark low vertices
-        n_unmasked_++;
-        auto v_local = local_.local_position_from_mask(v_mask);
-        sum_ += value;
+        counts.n_unmasked++;
+        counts.sum += value;
     }
 
     if (debug)
     {
         fmt::print("in set_mask, is_ghost = {}, final mask = {}, {}, gid = {}, v_mask = {},  v_idx = {}\n",
-                is_ghost, local_.pretty_mask_value(v_mask), local_.mask(v_mask), local_.gid(), v_mask, v_idx);
+                is_ghost, local_.pretty_mask_value(result), result, local_.gid(), v_mask, v_idx);
     }
 
-    if (is_ghost and local_.mask(v_mask) == gid)
+    if (is_ghost and result == gid)
     {
         fmt::print("in set_mask, is_ghost = {}, final mask = {}, {}, gid = {}, v_mask = {},  v_idx = {}\n",
-                is_ghost, local_.pretty_mask_value(v_mask), local_.mask(v_mask), local_.gid(), v_mask, v_idx);
+                is_ghost, local_.pretty_mask_value(result), result, local_.gid(), v_mask, v_idx);
         fmt::print("Error, same gid in mask\n");
         throw std::runtime_error("Bad mask");
     }
+
+    return result;
 }
 
+// only ACTIVE cells, all of them in the core, change
 template<class Real, unsigned D>
-void FabTmtBlock<Real, D>::set_low(const diy::Point<int, D>& v_bounds,
-        const Real& absolute_threshold)
+typename FabTmtBlock<Real, D>::MaskValue FabTmtBlock<Real, D>::set_low(const diy::Point<int, D>& v_mask,
+        const Real& absolute_threshold,
+        MaskCounts& counts) const
 {
-    auto v_mask = local_.mask_position_from_local(v_bounds);
-    if (local_.mask(v_mask) != MaskedBox::ACTIVE)
-        return;
+    MaskValue m = local_.mask(v_mask);
+    if (m != MaskedBox::ACTIVE)
+        return m;
+    auto v_bounds = local_.local_position_from_mask(v_mask);
     bool is_low = cmp(absolute_threshold,
             fab_(v_bounds)); //   negate_ ? fab_(v_bounds) < absolute_threshold : fab_(v_bounds) > absolute_threshold;
     if (is_low)
     {
-        n_low_++;
-        local_.set_mask(v_mask, MaskedBox::LOW);
+        counts.n_low++;
+        return MaskedBox::LOW;
     } else
     {
-        n_active_++;
+        counts.n_active++;
 //        if (gid == 0) fmt::print("HERE ACTIVE: {}\n", local_.global_position_from_local(v_bounds));
+        return m;
     }
 }
 
@@ -208,9 +158,9 @@ void FabTmtBlock<Real, D>::init(Real absolute_rho, diy::AMRLink* amr_link)
     bool debug = false; //gid == 1 or gid == 100;
     std::string debug_prefix = "In FabTmtBlock::init, gid = " + std::to_string(gid);
 
-    diy::for_each(local_.bounds_shape(), [this, absolute_rho](const Vertex& v_bounds) {
-        this->set_low(v_bounds, absolute_rho);
-    });
+    add_mask_counts(local_.template transform_mask<MaskCounts>([this, absolute_rho](const Vertex& v_mask, MaskCounts& counts) {
+        return this->set_low(v_mask, absolute_rho, counts);
+    }));
 
     if (debug)
         fmt::print("{}, absolute_rho = {}, n_active = {}, n_masked = {}, total_size = {}, level = {}\n", debug_prefix,
@@ -281,7 +231,7 @@ void FabTmtBlock<Real, D>::sparsify_local_tree(const FabTmtBlock::AmrVertexSet&
 template<unsigned D>
 r::AmrEdgeContainer
 get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& local, diy::AMRLink* l,
-        const diy::DiscreteBounds& domain, bool debug = false)
+        const diy::DiscreteBounds& domain, bool debug = false, const r::AmrLinkIndex<D>* link_index = nullptr)
 {
     using Position = diy::Point<int, D>;
 
@@ -294,12 +244,22 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
 
     r::AmrEdgeContainer result;
 
+    // without a prebuilt index, index the link here
+    std::unique_ptr<r::AmrLinkIndex<D>> own_link_index;
+    if (not link_index)
+    {
+        own_link_index.reset(new r::AmrLinkIndex<D>(l));
+        link_index = own_link_index.get();
+    }
+
+    const Position period = domain_period<D>(domain, local.refinement());
+
     for(const Position& neighb_v_glob : local.outer_edge_link(v_glob))
     {
 
         Position neighb_v_bounds = neighb_v_glob - local.bounds_from();
 
-        Position wrapped_neighb_vert_glob = wrap_point(neighb_v_glob, domain, local.refinement());
+        Position wrapped_neighb_vert_glob = wrap_point(neighb_v_glob, period);
 
         if (debug)
         {
@@ -312,16 +272,8 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
         Position neighb_v_mask = local.mask_position_from_local(neighb_v_bounds);
         int masking_gid = local.mask(neighb_v_mask);
 
-        size_t link_idx = 0;
-        bool link_idx_found = false;
-        for(; link_idx < (size_t) l->size(); ++link_idx)
-        {
-            if (l->target(link_idx).gid == masking_gid)
-            {
-                link_idx_found = true;
-                break;
-            }
-        }
+        int link_idx = link_index->link_index(masking_gid);
+        bool link_idx_found = link_idx >= 0;
 
         //assert(link_idx_found);
         if (not link_idx_found)
@@ -330,11 +282,11 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
             throw std::runtime_error("masking_gid not found in link");
         }
 
-        auto nb_level = l->level(link_idx);
-        Position nb_from = point_from_dynamic_point<D>(l->bounds(link_idx).min);
-        Position nb_to = point_from_dynamic_point<D>(l->bounds(link_idx).max);
-        // TODO: vector refinement
-        int nb_refinement = l->refinement(link_idx)[0];
+        const LinkBox<D>& nb = link_index->box(link_idx);
+        auto nb_level = nb.level;
+        const Position& nb_from = nb.bounds_from;
+        const Position& nb_to = nb.bounds_to;
+        int nb_refinement = nb.refinement;
 
         if (debug)
         {
@@ -350,8 +302,7 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
         {
             // neighbour is on the same level or below me, neighbouring vertex corresponds
             // to the unique vertex in a neighbouring block
-            size_t neighb_vertex_idx = get_vertex_id(wrapped_neighb_vert_glob, local.refinement(), link_idx, l,
-                    local.mask_grid().c_order());
+            size_t neighb_vertex_idx = get_vertex_id(wrapped_neighb_vert_glob, local.refinement(), nb, local.c_order());
 
             result.emplace_back(v_glob_idx, reeber::AmrVertexId{masking_gid, neighb_vertex_idx});
 
@@ -364,9 +315,11 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
 
         } else if (nb_level > local.level())
         {
+            RefinementRatio ratio(nb_refinement, local.refinement());
+            Position nb_period = ratio.refine(period);
+
             Position masking_box_from, masking_box_to;
-            std::tie(masking_box_from, masking_box_to) = refine_vertex(neighb_v_glob, local.refinement(),
-                    nb_refinement);
+            std::tie(masking_box_from, masking_box_to) = refine_vertex(neighb_v_glob, ratio);
             if (debug)
                 fmt::print(
                         "In get_vertex_edges, v_glob = {}, masking_gid = {}, masking_box_from = {}, masking_box_to = {}\n",
@@ -379,10 +332,7 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
             {
                 for(Position covering_position_glob : covering_box.position_link(masking_position))
                 {
-                    Position covering_position_coarsened = wrap_point(
-                            coarsen_point(covering_position_glob, nb_refinement,
-                                    local.refinement()),
-                            domain, local.refinement());
+                    Position covering_position_coarsened = wrap_point(ratio.coarsen(covering_position_glob), period);
                     if (debug)
                     {
                         fmt::print(
@@ -394,11 +344,9 @@ get_vertex_edges(const diy::Point<int, D>& v_glob, const reeber::MaskedBox<D>& l
                     if (covering_position_coarsened == v_glob)
                     {
 
-                        Position masking_position_global = wrap_point(masking_position, domain, nb_refinement);
+                        Position masking_position_global = wrap_point(masking_position, nb_period);
                         r::AmrVertexId masking_vertex_idx{masking_gid,
-                                                          get_vertex_id(masking_position_global, nb_refinement,
-                                                                  link_idx, l,
-                                                                  local.mask_grid().c_order())};
+                                                          get_vertex_id(masking_position_global, nb_refinement, nb, local.c_order())};
 
                         if (debug)
                         {
@@ -428,26 +376,39 @@ void FabTmtBlock<Real, D>::compute_outgoing_edges(diy::AMRLink* l, VertexEdgesMa
         fmt::print("In compute_outgoing_edges for block = {}, link size = {}, unique = {}\n", gid, l->size(),
                 receivers.size());
 
-    for(const Vertex& v_glob : local_.active_global_positions())
-    {
-        auto v_idx = local_.get_vertex_from_global_position(v_glob);
-//        debug = (gid == 0 or gid == 1) and (v_idx == 64 or v_idx == 4486);
-//        debug = (v_idx.gid == 0 and v_idx.vertex == 64) or (v_idx.gid == 1 and v_idx.vertex == 4486);
-//        debug = (v_glob[0] == 0 and v_glob[1] == 0 and v_glob[2] == 6);
+    r::AmrLinkIndex<D> link_index(l);
 
-        AmrEdgeContainer out_edges = get_vertex_edges(v_glob, local_, l, domain(), debug);
+    // edges are found slab by slab of the core (in parallel, with TBB) and stored in the order of slabs,
+    // same as a single pass over active_global_positions
+    using VertexEdges = std::pair<AmrVertexId, AmrEdgeContainer>;
+    const int slab_from = local_.core_from()[0];
+    std::vector<std::vector<VertexEdges>> slab_edges(local_.core_shape()[0]);
 
-        if (debug)
+    r::for_each(0, slab_edges.size(), [&](size_t slab)
+    {
+        for(const Vertex& v_glob : local_.active_global_positions_in_slab(slab_from + static_cast<int>(slab)))
         {
-            for(auto&& e : out_edges)
-            {
-                fmt::print("outogoing edge e = {} {}\n", std::get<0>(e), std::get<1>(e));
-            }
+            AmrEdgeContainer out_edges = get_vertex_edges(v_glob, local_, l, domain(), debug, &link_index);
+            if (not out_edges.empty())
+                slab_edges[slab].emplace_back(local_.get_vertex_from_global_position(v_glob), std::move(out_edges));
         }
+    });
 
-        if (not out_edges.empty())
+    for(const auto& edges_in_slab : slab_edges)
+    {
+        for(const VertexEdges& v_edges : edges_in_slab)
         {
-            vertex_to_outgoing_edges[local_.get_vertex_from_global_position(v_glob)] = out_edges;
+            const AmrEdgeContainer& out_edges = v_edges.second;
+
+            if (debug)
+            {
+                for(auto&& e : out_edges)
+                {
+                    fmt::print("outogoing edge e = {} {}\n", std::get<0>(e), std::get<1>(e));
+                }
+            }
+
+            vertex_to_outgoing_edges[v_edges.first] = out_edges;
             std::copy(out_edges.begin(), out_edges.end(), std::back_inserter(initial_edges_));
             for(const AmrEdge& e : out_edges)
             {
@@ -470,11 +431,25 @@ void FabTmtBlock<Real, D>::compute_outgoing_edges(diy::AMRLink* l, VertexEdgesMa
 //        original_link_gids_.erase(iter);
 //}
 
+template<class Real, unsigned D>
+typename FabTmtBlock<Real, D>::BoundaryCells FabTmtBlock<Real, D>::boundary_cells(int receiver_gid) const
+{
+    BoundaryCells result;
+    auto iter = gid_to_outgoing_edges_.find(receiver_gid);
+    if (iter != gid_to_outgoing_edges_.end())
+    {
+        for(const AmrEdge& e : iter->second)
+            result.add(std::get<0>(e).vertex);
+    }
+    result.sort();
+    return result;
+}
+
 // delete edges from this block that end in a low vertex of a neighbor block.
-// edges_from_gid: outogoing eddes we receive from a neigbor block
-// subtract them from the edges we keep in gid_to_outgoing_edges_
+// cells_from_sender: active cells of the neighbor with edges to this block;
+// an edge is kept, if it ends in one of them (the neighbor has the reverse edge then)
 template<class Real, unsigned D>
-void FabTmtBlock<Real, D>::delete_low_edges(int sender_gid, FabTmtBlock::AmrEdgeContainer& edges_from_sender)
+void FabTmtBlock<Real, D>::delete_low_edges(int sender_gid, const BoundaryCells& cells_from_sender)
 {
     bool debug = false; //gid == 1 or gid == 100;
 
@@ -488,45 +463,57 @@ void FabTmtBlock<Real, D>::delete_low_edges(int sender_gid, FabTmtBlock::AmrEdge
         return;  // we don't expect any edges from gid
     }
 
-    // edges from neighbor come reversed, correct that
-    std::transform(edges_from_sender.begin(), edges_from_sender.end(), edges_from_sender.begin(),
-            &reeber::reverse_amr_edge);
+    AmrEdgeContainer& my_edges = iter->second;
+    int old_n_edges = my_edges.size();
+
+    // sorted and without duplicates, as before
+    std::sort(my_edges.begin(), my_edges.end());
+    my_edges.erase(std::unique(my_edges.begin(), my_edges.end()), my_edges.end());
+    my_edges.erase(std::remove_if(my_edges.begin(), my_edges.end(),
+            [&cells_from_sender](const AmrEdge& e) { return not cells_from_sender.contains(std::get<1>(e).vertex); }),
+            my_edges.end());
 
-//    if (debug) fmt::print("in FabTmtBlock::delete_low_edges, transform OK, n_edges_from_sender = {}\n", edges_from_sender.size());
+    int new_n_edges = my_edges.size();
 
-    // put edges into set to find the set difference
-    std::set<AmrEdge> my_edges{iter->second.begin(), iter->second.end()};
-    std::set<AmrEdge> neighbor_edges{edges_from_sender.begin(), edges_from_sender.end()};
+    if (my_edges.empty())
+        gid_to_outgoing_edges_.erase(iter);
+    if (debug)
+        fmt::print(
+                "in Block::delete_low_edges, gid = {}, sender_gid = {}, erase OK, old_n_edges = {}, new_n_edges = {}\n",
+                gid, sender_gid, old_n_edges, new_n_edges);
+}
 
-    int old_n_edges = my_edges.size();
+// forget the neighbors that do not take part in the rounds (and everything, if we do not);
+// the link itself is pruned by the caller, edges to the forgotten neighbors would be deleted
+// by delete_low_edges anyway, because these neighbors have no cells to send back
+template<class Real, unsigned D>
+void FabTmtBlock<Real, D>::retire_neighbors(const std::unordered_set<int>& communicating_gids)
+{
+    bool debug = false;
 
-    iter->second.clear();
+    bool is_retained = communicating_gids.count(gid) == 1;
+    auto is_retired = [is_retained, &communicating_gids](int g) { return not is_retained or communicating_gids.count(g) == 0; };
 
-//    if (debug) fmt::print("In delete_low_edges in block with gid = {}, sender = {}, clear OK, my_edges.size = {}, neighbor_edges.size = {}\n", gid, sender_gid, my_edges.size(), neighbor_edges.size());
+    size_t old_n_receivers = new_receivers_.size();
 
-    //if (debug)
-    //{
-    //    for(auto e : my_edges)
-    //    {
-    //        fmt::print("my gid = {}, sender_gid = {}, my_edge = {}\n", gid, sender_gid, e);
-    //    }
-    //    for(auto e : neighbor_edges)
-    //    {
-    //        fmt::print("my gid = {}, sender_gid = {}, edge_from_sender = {}\n", gid, sender_gid, e);
-    //    }
-    // }
+    for(auto iter = gid_to_outgoing_edges_.begin(); iter != gid_to_outgoing_edges_.end();)
+        iter = is_retired(iter->first) ? gid_to_outgoing_edges_.erase(iter) : std::next(iter);
 
-    std::set_intersection(my_edges.begin(), my_edges.end(), neighbor_edges.begin(), neighbor_edges.end(),
-            std::back_inserter(iter->second));
+    for(auto iter = new_receivers_.begin(); iter != new_receivers_.end();)
+        iter = is_retired(*iter) ? new_receivers_.erase(iter) : std::next(iter);
 
-    int new_n_edges = iter->second.size();
+    original_link_gids_.erase(std::remove_if(original_link_gids_.begin(), original_link_gids_.end(), is_retired),
+            original_link_gids_.end());
+
+    if (n_active_ == 0)
+    {
+        retired_ = true;
+        done_ = 1;
+    }
 
-    if (iter->second.empty())
-        gid_to_outgoing_edges_.erase(iter);
     if (debug)
-        fmt::print(
-                "in Block::delete_low_edges, gid = {}, sender_gid = {}, erase OK, old_n_edges = {}, new_n_edges = {}\n",
-                gid, sender_gid, old_n_edges, new_n_edges);
+        fmt::print("In retire_neighbors, gid = {}, retained = {}, retired = {}, #receivers: {} -> {}\n",
+                gid, is_retained, retired_, old_n_receivers, new_receivers_.size());
 }
 
 template<class Real, unsigned D>
@@ -757,10 +744,14 @@ void FabTmtBlock<Real, D>::compute_original_connected_components(const VertexEdg
     }
 #endif
 
+    // bulk insert: one sort instead of a sorted insertion per vertex
+    std::vector<AmrVertexId> deepest;
+    deepest.reserve(original_vertex_to_deepest_.size());
     for(const auto& vertex_deepest_pair : original_vertex_to_deepest_)
     {
-        original_deepest_.insert(vertex_deepest_pair.second);
+        deepest.push_back(vertex_deepest_pair.second);
     }
+    original_deepest_.insert(deepest.begin(), deepest.end());
     current_deepest_ = original_deepest_;
 }
 
@@ -921,48 +912,52 @@ Real FabTmtBlock<Real, D>::scaling_factor() const
 }
 
 template<class Real, unsigned D>
-int FabTmtBlock<Real, D>::is_done_simple(const std::vector<FabTmtBlock::AmrVertexId>& vertices_to_check)
+std::unordered_set<r::AmrVertexId> FabTmtBlock<Real, D>::update_current_deepest()
 {
-    // check that all edge outgoing from the current region
-    // do not start in any component of our original local tree
-
 //        bool debug = (gid == 0);
     bool debug = false;
 
-    if (n_active_ == 0)
-        return 1;
-
-    if (debug)
-        fmt::print("Enter is_done_simple, gid = {}, #vertices = {}, round = {}\n",
-                gid, vertices_to_check.size(), round_);
-    std::set<AmrVertexId> cur_deepest_of_original_deepest;
-    for(const AmrVertexId v : original_deepest_)
+    // current_deepest_ keeps one original deepest vertex per component of the current tree;
+    // components only merge, so original deepest vertices that end up in one component are dropped
+    // and the loop gets shorter with every round
+    std::unordered_set<AmrVertexId> cur_deepest_of_original_deepest;
+    DeepestSet representatives;
+    for(const AmrVertexId v : current_deepest_)
     {
         if (current_merge_tree_.contains(v))
         {
             Neighbor nv = current_merge_tree_[v];
             AmrVertexId cur_deepest = current_merge_tree_.find_deepest(nv)->vertex;
-            cur_deepest_of_original_deepest.insert(cur_deepest);
+            if (cur_deepest_of_original_deepest.insert(cur_deepest).second)
+                representatives.insert(v);
         } else
         {
-            fmt::print("ALARM is_done_simple, gid = {}, orginal deepst =  {} not found in tree\n", gid, v);
+            fmt::print("ALARM update_current_deepest, gid = {}, orginal deepst =  {} not found in tree\n", gid, v);
             throw std::runtime_error("Here");
         }
     }
+    current_deepest_.swap(representatives);
 
     if (debug)
-        fmt::print("is_done_simple, gid = {}, #vertices = {}, round = {}, cur_deepest_of_original_deepest = {}\n", gid,
-                vertices_to_check.size(), round_, cur_deepest_of_original_deepest.size());
-    for(const AmrVertexId& v : vertices_to_check)
-    {
-        Neighbor nv = current_merge_tree_[v];
-        AmrVertexId dnv = current_merge_tree_.find_deepest(nv)->vertex;
+        fmt::print("update_current_deepest, gid = {}, round = {}, cur_deepest_of_original_deepest = {}\n", gid,
+                round_, cur_deepest_of_original_deepest.size());
 
-        if (cur_deepest_of_original_deepest.count(dnv))
-            return 0;
-    }
-    if (debug) fmt::print("is_done_simple, gid = {}, returning 1\n", gid);
-    return 1;
+    return cur_deepest_of_original_deepest;
+}
+
+template<class Real, unsigned D>
+void FabTmtBlock<Real, D>::add_pending_edge(const AmrVertexId& v, const std::unordered_set<AmrVertexId>& our_deepest)
+{
+    Neighbor nv = current_merge_tree_[v];
+    n_pending_ += our_deepest.count(current_merge_tree_.find_deepest(nv)->vertex);
+}
+
+template<class Real, unsigned D>
+int FabTmtBlock<Real, D>::is_done_simple() const
+{
+    // all edges outgoing from the current region that start in a component of our original local tree
+    // lead to blocks that we have already sent our tree to
+    return n_pending_ == 0;
 }
 
 template<class Real, unsigned D>
@@ -1069,6 +1064,14 @@ int FabTmtBlock<Real, D>::are_all_components_done() const
 }
 #endif
 
+template<class Real, unsigned D>
+double FabTmtBlock<Real, D>::cost() const
+{
+    if (retired_)
+        return 0;
+    return static_cast<double>(n_active_ + current_merge_tree_.size() + initial_edges_.size());
+}
+
 template<class Real, unsigned D>
 void FabTmtBlock<Real, D>::save(const void* b, diy::BinaryBuffer& bb)
 {
@@ -1090,6 +1093,8 @@ void FabTmtBlock<Real, D>::save(const void* b, diy::BinaryBuffer& bb)
 //    diy::save(bb, block->components_disjoint_set_parent_);
 //    diy::save(bb, block->components_disjoint_set_size_);
     diy::save(bb, block->round_);
+    diy::save(bb, block->link_sent_size_);
+    diy::save(bb, block->retired_);
 }
 
 template<class Real, unsigned D>
@@ -1113,5 +1118,102 @@ void FabTmtBlock<Real, D>::load(void* b, diy::BinaryBuffer& bb)
 //    diy::load(bb, block->components_disjoint_set_parent_);
 //    diy::load(bb, block->components_disjoint_set_size_);
     diy::load(bb, block->round_);
+    diy::load(bb, block->link_sent_size_);
+    diy::load(bb, block->retired_);
+}
+
+template<class Real, unsigned D>
+void FabTmtBlock<Real, D>::save_state(const void* b, diy::BinaryBuffer& bb)
+{
+    const FabTmtBlock* block = static_cast<const FabTmtBlock*>(b);
+
+    diy::save(bb, block->local_.c_order());
+    save(b, bb);
+
+    diy::save(bb, block->sum_);
+    diy::save(bb, block->n_unmasked_);
+    diy::save(bb, block->n_active_);
+    diy::save(bb, block->n_masked_);
+    diy::save(bb, block->n_low_);
+    diy::save(bb, block->done_);
+
+#ifdef AMR_MT_SEND_COMPONENTS
+    // components carry their own neighbors, edges and trees
+    diy::save(bb, block->components_.size());
+    for(const Component& c : block->components_)
+    {
+        diy::save(bb, c.root_);
+        diy::save(bb, c.current_neighbors_);
+        diy::save(bb, c.processed_neighbors_);
+        diy::save(bb, c.outgoing_edges_);
+        diy::save(bb, c.merge_tree_);
+    }
+#else
+    std::vector<AmrVertexId> component_roots;
+    for(const Component& c : block->components_)
+        component_roots.push_back(c.root_);
+    diy::save(bb, component_roots);
+#endif
+
+    diy::save(bb, block->gid_to_outgoing_edges_);
+    diy::save(bb, block->current_vertex_to_deepest_);
+    diy::save(bb, block->final_vertex_to_deepest_);
+    diy::save(bb, block->original_deepest_);
+    diy::save(bb, block->current_deepest_);
+    diy::save(bb, block->n_pending_);
+    diy::save(bb, block->local_integral_);
+    diy::save(bb, block->local_diagrams_);
+    diy::save(bb, block->edge_bytes_raw_);
+    diy::save(bb, block->edge_bytes_sent_);
 }
 
+template<class Real, unsigned D>
+FabTmtBlock<Real, D>* FabTmtBlock<Real, D>::load_state(int gid, diy::AMRLink* amr_link, diy::BinaryBuffer& bb)
+{
+    bool c_order;
+    diy::load(bb, c_order);
+
+    FabTmtBlock* block = new FabTmtBlock(gid, amr_link, c_order);
+
+    load(block, bb);
+
+    diy::load(bb, block->sum_);
+    diy::load(bb, block->n_unmasked_);
+    diy::load(bb, block->n_active_);
+    diy::load(bb, block->n_masked_);
+    diy::load(bb, block->n_low_);
+    diy::load(bb, block->done_);
+
+    block->components_.clear();
+#ifdef AMR_MT_SEND_COMPONENTS
+    size_t n_components;
+    diy::load(bb, n_components);
+    block->components_.resize(n_components);
+    for(Component& c : block->components_)
+    {
+        diy::load(bb, c.root_);
+        diy::load(bb, c.current_neighbors_);
+        diy::load(bb, c.processed_neighbors_);
+        diy::load(bb, c.outgoing_edges_);
+        diy::load(bb, c.merge_tree_);
+    }
+#else
+    std::vector<AmrVertexId> component_roots;
+    diy::load(bb, component_roots);
+    for(const AmrVertexId& root : component_roots)
+        block->components_.emplace_back(root);
+#endif
+
+    diy::load(bb, block->gid_to_outgoing_edges_);
+    diy::load(bb, block->current_vertex_to_deepest_);
+    diy::load(bb, block->final_vertex_to_deepest_);
+    diy::load(bb, block->original_deepest_);
+    diy::load(bb, block->current_deepest_);
+    diy::load(bb, block->n_pending_);
+    diy::load(bb, block->local_integral_);
+    diy::load(bb, block->local_diagrams_);
+    diy::load(bb, block->edge_bytes_raw_);
+    diy::load(bb, block->edge_bytes_sent_);
+
+    return block;
+}
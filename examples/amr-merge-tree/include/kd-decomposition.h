@@ -0,0 +1,322 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#include <diy/mpi.hpp>
+#include <diy/types.hpp>
+#include <diy/link.hpp>
+#include <diy/assigner.hpp>
+#include <diy/decomposition.hpp>
+
+#include <reeber/format.h>
+
+// Decomposition of a regular domain into boxes with about the same number of active cells.
+// For clustered fields a few regular boxes hold most of the active cells,
+// and the blocks that own them do most of the work in every round.
+// Active cells are counted on a coarse grid (one coarse cell per coarse^D cells of the domain),
+// then a kd-tree splits the domain along the longest side of a box, so that both halves get
+// a share of the active cells proportional to their number of blocks.
+
+// how read_from_npy_file and read_from_hdf5_file decompose the domain
+struct DecompositionParams
+{
+    bool kd { false };              // kd-tree of active cells instead of regular boxes
+    int coarse { 16 };              // side of a coarse cell, in cells
+    double rho { 0 };               // threshold, same meaning as for the blocks
+    bool absolute { false };        // rho is absolute, not a multiple of the mean
+    bool negate { false };          // active cells are below rho
+};
+
+using DiscreteBoundsVector = std::vector<diy::DiscreteBounds>;
+
+/**
+ *
+ * @param counts active cells in every coarse cell, c_order, coarse_shape[0] is the slowest dimension
+ * @param coarse_shape number of coarse cells in every dimension
+ * @return core of every block, indexed by gid; the two halves of every split get consecutive gids
+ */
+template<unsigned D>
+DiscreteBoundsVector kd_decompose(const diy::DiscreteBounds& domain, int nblocks, int coarse,
+        const std::vector<double>& counts, const std::array<int, D>& coarse_shape)
+{
+    using Coarse = std::array<int, D>;
+
+    size_t n_coarse_cells = 1;
+    for(unsigned i = 0; i < D; ++i)
+        n_coarse_cells *= coarse_shape[i];
+
+    if (n_coarse_cells < static_cast<size_t>(nblocks))
+        throw std::runtime_error(fmt::format("kd decomposition: {} coarse cells for {} blocks, use smaller coarse cells",
+                n_coarse_cells, nblocks));
+
+    auto count = [&counts, &coarse_shape](const Coarse& c) {
+        size_t idx = 0;
+        for(unsigned i = 0; i < D; ++i)
+            idx = idx * coarse_shape[i] + c[i];
+        return counts[idx];
+    };
+
+    DiscreteBoundsVector result(nblocks, diy::DiscreteBounds(D));
+
+    // lo, hi: inclusive coarse box, gets gids [gid_from, gid_from + n)
+    std::function<void(Coarse, Coarse, int, int)> split = [&](Coarse lo, Coarse hi, int gid_from, int n)
+    {
+        if (n == 1)
+        {
+            diy::DiscreteBounds& core = result[gid_from];
+            for(unsigned i = 0; i < D; ++i)
+            {
+                core.min[i] = domain.min[i] + lo[i] * coarse;
+                core.max[i] = std::min(domain.max[i], domain.min[i] + (hi[i] + 1) * coarse - 1);
+            }
+            return;
+        }
+
+        // a box has at least as many coarse cells as blocks, so its longest side has at least two
+        unsigned axis = 0;
+        for(unsigned i = 1; i < D; ++i)
+            if (hi[i] - lo[i] > hi[axis] - lo[axis])
+                axis = i;
+
+        int length = hi[axis] - lo[axis] + 1;
+        size_t cross = 1;
+        for(unsigned i = 0; i < D; ++i)
+            if (i != axis)
+                cross *= hi[i] - lo[i] + 1;
+
+        // active cells in every slice of the box orthogonal to axis
+        std::vector<double> slices(length, 0);
+        Coarse c = lo;
+        while(true)
+        {
+            slices[c[axis] - lo[axis]] += count(c);
+
+            unsigned i = D;
+            while(i > 0 and c[i - 1] == hi[i - 1])
+            {
+                c[i - 1] = lo[i - 1];
+                --i;
+            }
+            if (i == 0)
+                break;
+            ++c[i - 1];
+        }
+
+        // no active cells: split the volume
+        double total = std::accumulate(slices.begin(), slices.end(), 0.0);
+        if (total == 0)
+        {
+            std::fill(slices.begin(), slices.end(), static_cast<double>(cross));
+            total = static_cast<double>(length) * cross;
+        }
+
+        // cut as close to the middle of the active cells as possible
+        double target = total * (n / 2) / n;
+        double prefix = slices[0];
+        int best_left = 1;
+        double best_prefix = prefix;
+        for(int left = 2; left < length; ++left)
+        {
+            prefix += slices[left - 1];
+            if (std::abs(prefix - target) < std::abs(best_prefix - target))
+            {
+                best_left = left;
+                best_prefix = prefix;
+            }
+        }
+
+        // blocks follow the active cells, but every block needs a coarse cell
+        size_t left_cells = best_left * cross;
+        size_t right_cells = (length - best_left) * cross;
+        int min_n_left = static_cast<int>(std::max<long long>(1, n - static_cast<long long>(right_cells)));
+        int max_n_left = static_cast<int>(std::min<long long>(n - 1, static_cast<long long>(left_cells)));
+        int n_left = static_cast<int>(std::lround(n * best_prefix / total));
+        n_left = std::max(min_n_left, std::min(max_n_left, n_left));
+        int n_right = n - n_left;
+
+        Coarse left_hi = hi;
+        left_hi[axis] = lo[axis] + best_left - 1;
+        Coarse right_lo = lo;
+        right_lo[axis] = lo[axis] + best_left;
+
+        split(lo, left_hi, gid_from, n_left);
+        split(right_lo, hi, gid_from + n_left, n_right);
+    };
+
+    Coarse lo, hi;
+    for(unsigned i = 0; i < D; ++i)
+    {
+        lo[i] = 0;
+        hi[i] = coarse_shape[i] - 1;
+    }
+    split(lo, hi, 0, nblocks);
+
+    return result;
+}
+
+// true, if a and b share a face, an edge or a corner, possibly across the periodic boundary
+template<unsigned D>
+bool boxes_touch(const diy::DiscreteBounds& a, const diy::DiscreteBounds& b, const diy::DiscreteBounds& domain,
+        const diy::RegularDecomposer<diy::DiscreteBounds>::BoolVector& wrap)
+{
+    for(unsigned i = 0; i < D; ++i)
+    {
+        int period = domain.max[i] - domain.min[i] + 1;
+        bool touch = false;
+        for(int shift : { 0, -period, period })
+        {
+            if (shift and not wrap[i])
+                continue;
+            if (b.min[i] + shift <= a.max[i] + 1 and a.min[i] <= b.max[i] + shift + 1)
+                touch = true;
+        }
+        if (not touch)
+            return false;
+    }
+    return true;
+}
+
+// directions in which core touches the domain boundary and wraps, as the readers record them
+inline void add_domain_wraps(diy::AMRLink* amr_link, const diy::DiscreteBounds& core, const diy::DiscreteBounds& domain,
+        const diy::RegularDecomposer<diy::DiscreteBounds>::BoolVector& wrap)
+{
+    for (int dir_x : { -1, 0, 1 })
+    {
+        if (!wrap[0] && dir_x) continue;
+        if (dir_x < 0 && core.min[0] != domain.min[0]) continue;
+        if (dir_x > 0 && core.max[0] != domain.max[0]) continue;
+
+        for (int dir_y : { -1, 0, 1 })
+        {
+            if (!wrap[1] && dir_y) continue;
+            if (dir_y < 0 && core.min[1] != domain.min[1]) continue;
+            if (dir_y > 0 && core.max[1] != domain.max[1]) continue;
+
+            for (int dir_z : { -1, 0, 1 })
+            {
+                if (dir_x == 0 and dir_y == 0 and dir_z == 0)
+                    continue;
+
+                if (!wrap[2] && dir_z) continue;
+                if (dir_z < 0 && core.min[2] != domain.min[2]) continue;
+                if (dir_z > 0 && core.max[2] != domain.max[2]) continue;
+                amr_link->add_wrap(diy::Direction{ dir_x, dir_y, dir_z });
+            }
+        }
+    }
+}
+
+/**
+ *
+ * link of block gid of a kd decomposition, no ghosts: bounds are cores, as in the regular readers
+ * a block whose core spans the whole periodic domain in some dimension is its own neighbor, as with RegularDecomposer
+ */
+template<unsigned D>
+diy::AMRLink* kd_link(int gid, const DiscreteBoundsVector& cores, const diy::DiscreteBounds& domain,
+        const diy::RegularDecomposer<diy::DiscreteBounds>::BoolVector& wrap, const diy::Assigner& assigner)
+{
+    const diy::DiscreteBounds& core = cores[gid];
+    diy::AMRLink* amr_link = new diy::AMRLink(D, 0, 1, core, core);
+
+    for(int nbr_gid = 0; nbr_gid < static_cast<int>(cores.size()); ++nbr_gid)
+    {
+        const diy::DiscreteBounds& nbr_core = cores[nbr_gid];
+
+        if (nbr_gid == gid)
+        {
+            bool touches_itself = false;
+            for(unsigned i = 0; i < D; ++i)
+                touches_itself = touches_itself or (wrap[i] and core.min[i] == domain.min[i] and core.max[i] == domain.max[i]);
+            if (not touches_itself)
+                continue;
+        } else if (not boxes_touch<D>(core, nbr_core, domain, wrap))
+            continue;
+
+        amr_link->add_neighbor(diy::BlockID { nbr_gid, assigner.rank(nbr_gid) });
+        amr_link->add_bounds(0, 1, nbr_core, nbr_core);
+    }
+
+    add_domain_wraps(amr_link, core, domain, wrap);
+
+    return amr_link;
+}
+
+/**
+ *
+ * count active cells on the coarse grid and split the domain by them;
+ * every rank reads one box of a regular decomposition of the domain into world.size() boxes
+ *
+ * @param read read(box, data) reads the function on box into data, c_order; collective
+ * @return core of every block, indexed by gid
+ */
+template<unsigned D, class Real, class Read>
+DiscreteBoundsVector kd_decompose_active_cells(const diy::mpi::communicator& world, const diy::DiscreteBounds& domain,
+        int nblocks, const DecompositionParams& params, const Read& read)
+{
+    using Decomposer = diy::RegularDecomposer<diy::DiscreteBounds>;
+
+    Decomposer decomposer(D, domain, world.size());
+    diy::DiscreteBounds box(D);
+    decomposer.fill_bounds(box, world.rank());
+
+    std::array<int, D> shape, coarse_shape;
+    size_t box_size = 1;
+    size_t n_coarse_cells = 1;
+    for(unsigned i = 0; i < D; ++i)
+    {
+        shape[i] = box.max[i] - box.min[i] + 1;
+        box_size *= shape[i];
+        coarse_shape[i] = (domain.max[i] - domain.min[i] + params.coarse) / params.coarse;
+        n_coarse_cells *= coarse_shape[i];
+    }
+
+    std::vector<Real> data(box_size);
+    read(box, data.data());
+
+    double threshold = params.rho;
+    if (not params.absolute)
+    {
+        double local_sum = std::accumulate(data.begin(), data.end(), 0.0);
+        double local_n = static_cast<double>(box_size);
+        double sum, n;
+        diy::mpi::all_reduce(world, local_sum, sum, std::plus<double>());
+        diy::mpi::all_reduce(world, local_n, n, std::plus<double>());
+        threshold = params.rho * sum / n;
+    }
+
+    // a cell is low, as in FabTmtBlock::set_low, if cmp(threshold, value)
+    std::vector<double> local_counts(n_coarse_cells, 0);
+    std::array<int, D> p {};
+    for(size_t k = 0; k < box_size; ++k)
+    {
+        Real value = data[k];
+        bool is_low = params.negate ? threshold > value : threshold < value;
+        if (not is_low)
+        {
+            size_t idx = 0;
+            for(unsigned i = 0; i < D; ++i)
+                idx = idx * coarse_shape[i] + (box.min[i] + p[i] - domain.min[i]) / params.coarse;
+            local_counts[idx] += 1;
+        }
+
+        // c_order: last dimension is the fastest
+        for(unsigned i = D; i > 0; --i)
+        {
+            if (++p[i - 1] < shape[i - 1])
+                break;
+            p[i - 1] = 0;
+        }
+    }
+    std::vector<Real>().swap(data);
+
+    std::vector<double> counts;
+    diy::mpi::all_reduce(world, local_counts, counts, std::plus<double>());
+
+    return kd_decompose<D>(domain, nblocks, params.coarse, counts, coarse_shape);
+}
@@ -9,6 +9,8 @@
 #include <diy/link.hpp>
 #include <reeber/format.h>
 
+#include "kd-decomposition.h"
+
 void read_from_hdf5_file(std::string infn,
                          std::vector<std::string> all_var_names, // HDF5 only: all fields that will be read from plotfile
                          int n_mt_vars,                          // sum of first n_mt_vars in all_var_names will be stored in fab of FabBlock,
@@ -18,4 +20,5 @@ void read_from_hdf5_file(std::string infn,
                          diy::Master& master_reader,
                          diy::ContiguousAssigner& assigner,
                          diy::MemoryBuffer& header,
-                         diy::DiscreteBounds& domain);
+                         diy::DiscreteBounds& domain,
+                         const DecompositionParams& decomposition = DecompositionParams());
@@ -18,6 +18,7 @@
 #include <dlog/log.h>
 
 #include "fab-block.h"
+#include "kd-decomposition.h"
 
 template<unsigned D>
 void read_from_npy_file(std::string infn,
@@ -27,7 +28,8 @@ void read_from_npy_file(std::string infn,
                         diy::ContiguousAssigner& assigner,
                         diy::MemoryBuffer& header,
                         diy::DiscreteBounds& domain,
-                        diy::RegularDecomposer<diy::DiscreteBounds>::BoolVector wrap)
+                        diy::RegularDecomposer<diy::DiscreteBounds>::BoolVector wrap,
+                        const DecompositionParams& decomposition = DecompositionParams())
 {
     using FabBlockR = FabBlock<Real, D>;
 
@@ -56,16 +58,7 @@ void read_from_npy_file(std::string infn,
         domain.max[i] = reader.shape()[i] - 1;
     }
 
-    Decomposer decomposer(D, domain, nblocks,
-                          Decomposer::BoolVector { false, false, false },   // share_face
-                          wrap,
-                          Decomposer::CoordinateVector { 0, 0, 0 });        // no ghosts -- cannot read ghost data correctly
-
-    decomposer.decompose(world.rank(), assigner, [&master_reader, &wrap, &reader, one](int gid,
-                                                                       const Decomposer::Bounds& core,
-                                                                       const Decomposer::Bounds& bounds,
-                                                                       const Decomposer::Bounds& domain,
-                                                                       const Decomposer::Link& link) {
+    auto read_block = [&reader, one](const Decomposer::Bounds& core, const Decomposer::Bounds& bounds) {
         auto* b = new FabBlockR;
 
         auto shape_4d = bounds.max - bounds.min + one;
@@ -83,6 +76,33 @@ void read_from_npy_file(std::string infn,
 
         reader.read(core, b->fab.data());
 
+        return b;
+    };
+
+    if (decomposition.kd)
+    {
+        DiscreteBoundsVector cores = kd_decompose_active_cells<D, Real>(world, domain, nblocks, decomposition,
+                [&reader](const diy::DiscreteBounds& box, Real* data) { reader.read(box, data); });
+
+        std::vector<int> gids;
+        assigner.local_gids(world.rank(), gids);
+        for(int gid : gids)
+            master_reader.add(gid, read_block(cores[gid], cores[gid]), kd_link<D>(gid, cores, domain, wrap, assigner));
+        return;
+    }
+
+    Decomposer decomposer(D, domain, nblocks,
+                          Decomposer::BoolVector { false, false, false },   // share_face
+                          wrap,
+                          Decomposer::CoordinateVector { 0, 0, 0 });        // no ghosts -- cannot read ghost data correctly
+
+    decomposer.decompose(world.rank(), assigner, [&master_reader, &wrap, &read_block](int gid,
+                                                                       const Decomposer::Bounds& core,
+                                                                       const Decomposer::Bounds& bounds,
+                                                                       const Decomposer::Bounds& domain,
+                                                                       const Decomposer::Link& link) {
+        auto* b = read_block(core, bounds);
+
         // copy link
         diy::AMRLink* amr_link = new diy::AMRLink(D, 0, 1, link.core(), bounds);
         for (int i = 0; i < link.size(); ++i)
@@ -93,32 +113,8 @@ void read_from_npy_file(std::string infn,
             amr_link->add_bounds(0, 1, nbr_core, nbr_bounds);
         }
 
-        // record wrap
-        for (int dir_x : { -1, 0, 1 })
-        {
-            if (!wrap[0] && dir_x) continue;
-            if (dir_x < 0 && core.min[0] != domain.min[0]) continue;
-            if (dir_x > 0 && core.max[0] != domain.max[0]) continue;
-
-            for (int dir_y : { -1, 0, 1 })
-            {
-                if (!wrap[1] && dir_y) continue;
-                if (dir_y < 0 && core.min[1] != domain.min[1]) continue;
-                if (dir_y > 0 && core.max[1] != domain.max[1]) continue;
-
-                for (int dir_z : { -1, 0, 1 })
-                {
-                    if (dir_x == 0 and dir_y == 0 and dir_z == 0)
-                        continue;
-
-                    if (!wrap[2] && dir_z) continue;
-                    if (dir_z < 0 && core.min[2] != domain.min[2]) continue;
-                    if (dir_z > 0 && core.max[2] != domain.max[2]) continue;
-        // TODO! fix wrap
-                    amr_link->add_wrap(diy::Direction{ dir_x, dir_y, dir_z });
-                }
-            }
-        }
+        add_domain_wraps(amr_link, core, domain, wrap);
+
         master_reader.add(gid, b, amr_link);
     });
 }
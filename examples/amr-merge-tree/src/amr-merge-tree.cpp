@@ -36,6 +36,7 @@
 #endif
 
 #include "amr-plot-reader.h"
+#include "amr-rebalance.h"
 
 
 // block-independent types
@@ -130,14 +131,17 @@ void read_from_file(std::string infn,
         diy::MemoryBuffer& header,
         diy::DiscreteBounds& domain,
         bool split,
-        int nblocks)
+        int nblocks,
+        bool wrap,
+        const DecompositionParams& decomposition)
 {
     if (not file_exists(infn))
         throw std::runtime_error("Cannot read file " + infn);
 
     if (ends_with(infn, ".npy"))
     {
-        read_from_npy_file<DIM>(infn, world, nblocks, master_reader, assigner, header, domain);
+        read_from_npy_file<DIM>(infn, world, nblocks, master_reader, assigner, header, domain,
+                { wrap, wrap, wrap }, decomposition);
     } else
     {
         if (split)
@@ -241,7 +245,8 @@ int main(int argc, char** argv)
     int nblocks = world.size();
     std::string prefix = "./DIY.XXXXXX";
     int in_memory = -1;
-    int threads = 1;
+    int jobs = 1;
+    int threads = r::task_scheduler_init::automatic;
     std::string profile_path;
     std::string log_level = "info";
 
@@ -252,6 +257,8 @@ int main(int argc, char** argv)
     int n_runs = 1;
 
     std::string fields_to_read;
+    std::string rebalance = "none";
+    DecompositionParams decomposition;
 
     using namespace opts;
 
@@ -260,14 +267,17 @@ int main(int argc, char** argv)
     ops
             >> Option('b', "blocks", nblocks, "number of blocks to use")
             >> Option('m', "memory", in_memory, "maximum blocks to store in memory")
-            >> Option('j', "jobs", threads, "threads to use during the computation")
+            >> Option('j', "jobs", jobs, "threads to use during the computation")
             >> Option('s', "storage", prefix, "storage prefix")
             >> Option('i', "rho", rho, "iso threshold")
             >> Option('x', "mincells", min_cells, "minimal number of cells to output halo")
             >> Option('f', "fields", fields_to_read, "comma-separated list of fields to read")
             >> Option('r', "runs", n_runs, "number of runs")
+            >> Option("rebalance", rebalance, "move blocks between ranks after init by their cost: none, greedy or contiguous")
+            >> Option("kd-coarse", decomposition.coarse, "side of the coarse cells that count active cells for --kd")
             >> Option('p', "profile", profile_path, "path to keep the execution profile")
-            >> Option('l', "log", log_level, "log level");
+            >> Option('l', "log", log_level, "log level")
+            >> Option('t', "threads", threads, "number of threads to use (with TBB)");
 
     bool absolute =
             ops >> Present('a', "absolute", "use absolute values for thresholds (instead of multiples of mean)");
@@ -276,8 +286,10 @@ int main(int argc, char** argv)
     // ignored for now, wrap is always assumed
     bool wrap = ops >> opts::Present('w', "wrap", "wrap");
     bool split = ops >> opts::Present("split", "use split IO");
+    decomposition.kd = ops >> opts::Present("kd", "decompose npy input by a kd-tree of active cells (instead of regular boxes); ignored for plotfiles and diy block files");
 
     bool print_stats = ops >> opts::Present("stats", "print statistics");
+    bool async = ops >> opts::Present("async", "asynchronous merge rounds (iexchange) instead of bulk-synchronous ones");
     std::string input_filename, output_filename, output_diagrams_filename, output_integral_filename;
 
     std::vector<std::string> all_var_names = split_by_delim(fields_to_read,
@@ -299,6 +311,13 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (rebalance != "none" and rebalance != "greedy" and rebalance != "contiguous")
+    {
+        if (world.rank() == 0)
+            fmt::print("Unknown rebalance method: {}\n", rebalance);
+        return 1;
+    }
+
     //-----------
 
     bool write_diag = (ops >> PosOption(output_diagrams_filename));
@@ -311,6 +330,9 @@ int main(int argc, char** argv)
 
     diy::FileStorage storage(prefix);
 
+    // with TBB, blocks are constructed and initialized by TBB tasks, see foreach_block_parallel
+    r::task_scheduler_init init(threads);
+
     diy::Master master_reader(world, 1, in_memory, &FabBlockR::create, &FabBlockR::destroy);
     diy::ContiguousAssigner assigner(world.size(), nblocks);
     diy::MemoryBuffer header;
@@ -375,7 +397,10 @@ int main(int argc, char** argv)
         read_amr_plotfile(input_filename, all_var_names, n_mt_vars, world, nblocks, master_reader, header, cell_volume, domain);
     } else
     {
-        read_from_file(input_filename, world, master_reader, assigner, header, domain, split, nblocks);
+        decomposition.rho = rho;
+        decomposition.absolute = absolute;
+        decomposition.negate = negate;
+        read_from_file(input_filename, world, master_reader, assigner, header, domain, split, nblocks, wrap, decomposition);
     }
 
     world.barrier();
@@ -387,7 +412,7 @@ int main(int argc, char** argv)
     for(int n_run = 0; n_run < n_runs; ++n_run)
     {
 
-        diy::Master master(world, threads, in_memory, &Block::create, &Block::destroy, &storage, &Block::save,
+        diy::Master master(world, jobs, in_memory, &Block::create, &Block::destroy, &storage, &Block::save,
                 &Block::load);
         timer.restart();
         timer_all.restart();
@@ -395,9 +420,14 @@ int main(int argc, char** argv)
         // copy FabBlocks to FabTmtBlocks
         // in FabTmtConstructor mask will be set and local trees will be computed
         // FabBlock can be safely discarded afterwards
+        // blocks are constructed in parallel (with TBB), master.add is not thread-safe, so they are added afterwards
+
+        std::vector<Block*> new_blocks(master_reader.size(), nullptr);
+        std::vector<AMRLink*> new_links(master_reader.size(), nullptr);
 
-        master_reader.foreach(
-                [&master, domain, rho, negate, absolute](FabBlockR* b, const diy::Master::ProxyWithLink& cp) {
+        foreach_block_parallel<FabBlockR>(master_reader, in_memory == -1,
+                [&master_reader, &new_blocks, &new_links, domain, rho, negate, absolute](FabBlockR* b,
+                        const diy::Master::ProxyWithLink& cp) {
                     auto* l = static_cast<AMRLink*>(cp.link());
                     AMRLink* new_link = new AMRLink(*l);
 
@@ -406,13 +436,17 @@ int main(int argc, char** argv)
                     int local_ref = l->refinement()[0];
                     int local_lev = l->level();
 
-                    master.add(cp.gid(),
-                            new Block(b->fab, local_ref, local_lev, domain, l->bounds(), l->core(), cp.gid(),
-                                    new_link, rho, negate, absolute),
-                            new_link);
-
+                    int lid = master_reader.lid(cp.gid());
+                    new_links[lid] = new_link;
+                    new_blocks[lid] = new Block(b->function(), local_ref, local_lev, domain, l->bounds(), l->core(),
+                            cp.gid(), new_link, rho, negate, absolute);
                 });
 
+        for(int i = 0; i < master_reader.size(); ++i)
+        {
+            master.add(master_reader.gid(i), new_blocks[i], new_links[i]);
+        }
+
         auto time_for_local_computation = timer.elapsed();
 
 #ifdef DO_DETAILED_TIMING
@@ -486,11 +520,12 @@ int main(int argc, char** argv)
             }
 
             timer.restart();
-            master.foreach([absolute_rho](Block* b, const diy::Master::ProxyWithLink& cp) {
-                AMRLink* l = static_cast<AMRLink*>(cp.link());
-                b->init(absolute_rho, l);
-                cp.collectives()->clear();
-            });
+            foreach_block_parallel<Block>(master, in_memory == -1,
+                    [absolute_rho](Block* b, const diy::Master::ProxyWithLink& cp) {
+                        AMRLink* l = static_cast<AMRLink*>(cp.link());
+                        b->init(absolute_rho, l);
+                        cp.collectives()->clear();
+                    });
 
 #ifdef DO_DETAILED_TIMING
             time_to_init_blocks = timer.elapsed();
@@ -506,11 +541,55 @@ int main(int argc, char** argv)
 
         int global_n_undone = 1;
 
-        master.foreach(&send_edges_to_neighbors<DIM>);
+        int local_n_retired = retire_inactive_blocks<DIM>(master);
+        int n_retired = 0;
+        diy::mpi::all_reduce(world, local_n_retired, n_retired, std::plus<int>());
+
+        LOG_SEV_IF(world.rank() == 0, info) << "Retired blocks without active cells: " << n_retired
+                                                                << ", time elapsed " << timer.elapsed();
+        dlog::flush();
+
+        if (rebalance != "none" and in_memory != -1)
+        {
+            LOG_SEV_IF(world.rank() == 0, warning) << "Rebalancing needs all blocks in memory, skipped";
+        } else if (rebalance != "none")
+        {
+            dlog::Timer rebalance_timer;
+
+            BlockCosts costs = gather_block_costs<Block>(master, [](const Block* b) { return b->cost(); });
+
+            std::vector<int> assignment = (rebalance == "greedy") ? assign_greedy(costs, world.size())
+                                                                  : assign_contiguous(costs, world.size());
+
+            int local_n_moved = migrate_blocks<Block>(master, costs, assignment,
+                    [](const Block* b, diy::BinaryBuffer& bb) { Block::save_state(b, bb); },
+                    [](int gid, diy::Link* l, diy::BinaryBuffer& bb) {
+                        return Block::load_state(gid, static_cast<AMRLink*>(l), bb);
+                    });
+            int n_moved = 0;
+            diy::mpi::all_reduce(world, local_n_moved, n_moved, std::plus<int>());
+
+            LOG_SEV_IF(world.rank() == 0, info) << "Rebalanced blocks (" << rebalance
+                                                << "), load imbalance (max / average cost): "
+                                                << load_imbalance(costs, costs.ranks, world.size()) << " -> "
+                                                << load_imbalance(costs, assignment, world.size())
+                                                << ", blocks moved: " << n_moved
+                                                << ", time elapsed " << rebalance_timer.elapsed();
+            dlog::flush();
+        }
+
+        master.foreach(&send_boundary_cells_to_neighbors<DIM>);
         master.exchange();
         master.foreach(&delete_low_edges<DIM>);
 
         LOG_SEV_IF(world.rank() == 0, info)  << "edges symmetrized, time elapsed " << timer.elapsed();
+
+        if (print_stats)
+        {
+            auto edge_bytes = collect_edge_bytes<DIM>(master);
+            LOG_SEV_IF(world.rank() == 0, info) << "STAT edges symmetrized, edge bytes: raw = " << edge_bytes.first
+                                                << ", sent as boundary cells = " << edge_bytes.second;
+        }
         auto time_for_communication = timer.elapsed();
 
 #ifdef DO_DETAILED_TIMING
@@ -583,6 +662,52 @@ int main(int argc, char** argv)
 #endif
 
         int rounds = 0;
+        if (async)
+        {
+            master.iexchange<Block>(&amr_tmt_async<Real, DIM>);
+
+            // iexchange returns when no messages are in flight; every block must be done by then
+            int local_n_undone = 0;
+            master.foreach([&local_n_undone](Block* b, const diy::Master::ProxyWithLink& cp) {
+                local_n_undone += (b->done_ == 0);
+            });
+            diy::mpi::all_reduce(world, local_n_undone, global_n_undone, std::plus<int>());
+
+            if (global_n_undone)
+            {
+                LOG_SEV_IF(world.rank() == 0, error) << "ASYNC: " << global_n_undone << " blocks not done after iexchange, do not proceed";
+                dlog::flush();
+                if (read_plotfile)
+                    amrex::Finalize();
+                return 1;
+            }
+
+            // histogram of the number of rounds (calls with incoming trees) per block
+            int local_max_rounds = 0, max_rounds = 0;
+            master.foreach([&local_max_rounds](Block* b, const diy::Master::ProxyWithLink& cp) {
+                local_max_rounds = std::max(local_max_rounds, b->round_);
+            });
+            diy::mpi::all_reduce(world, local_max_rounds, max_rounds, diy::mpi::maximum<int>());
+
+            std::vector<int> local_round_histogram(max_rounds + 1, 0), round_histogram;
+            master.foreach([&local_round_histogram](Block* b, const diy::Master::ProxyWithLink& cp) {
+                local_round_histogram[b->round_]++;
+                LOG_SEV(debug) << "ASYNC block " << b->gid << ", rounds = " << b->round_ << ", done = " << b->done_;
+            });
+            diy::mpi::all_reduce(world, local_round_histogram, round_histogram, std::plus<int>());
+
+            for(int k = 0; k <= max_rounds; ++k)
+                LOG_SEV_IF(world.rank() == 0 and round_histogram[k] > 0, info) << "ASYNC rounds = " << k << ", # blocks = " << round_histogram[k];
+
+            if (print_stats)
+            {
+                auto edge_bytes = collect_edge_bytes<DIM>(master);
+                LOG_SEV_IF(world.rank() == 0, info) << "STAT ASYNC edge bytes: raw = " << edge_bytes.first
+                                                    << ", encoded = " << edge_bytes.second;
+            }
+            dlog::flush();
+        }
+
         while(global_n_undone)
         {
             rounds++;
@@ -613,26 +738,27 @@ int main(int argc, char** argv)
 #ifdef DO_DETAILED_TIMING
             timer_tmt_exchange.restart();
 #endif
-            master.exchange();
+            // to compute total number of undone blocks; retired blocks are always done
+            int local_n_undone = 0;
+            master.foreach([&local_n_undone](Block* b, const diy::Master::ProxyWithLink& cp) {
+                local_n_undone += (not b->retired_ and b->done_ != 1);
+            });
+            diy::mpi::all_reduce(world, local_n_undone, global_n_undone, std::plus<int>());
 
 #ifdef DO_DETAILED_TIMING
             tmt_exchange_2_time += timer_tmt_exchange.elapsed();
 #endif
-            // to compute total number of undone blocks
-            global_n_undone = master.proxy(master.loaded_block()).read<int>();
             LOG_SEV_IF(world.rank() == 0, info) << "MASTER round " << rounds << ", global_n_undone = "
                                                                    << global_n_undone;
 
             if (print_stats)
             {
-                int local_n_undone = 0;
-                master.foreach(
-                        [&local_n_undone](Block* b, const diy::Master::ProxyWithLink& cp) {
-                            local_n_undone += (b->done_ != 1);
-                        });
-
                 LOG_SEV(info) << "STAT MASTER round " << rounds << ", rank = " << world.rank() << ", local_n_undone = "
                                                       << local_n_undone;
+
+                auto edge_bytes = collect_edge_bytes<DIM>(master);
+                LOG_SEV_IF(world.rank() == 0, info) << "STAT MASTER round " << rounds << ", edge bytes: raw = "
+                                                    << edge_bytes.first << ", encoded = " << edge_bytes.second;
             }
 
             dlog::flush();
@@ -655,32 +781,33 @@ int main(int argc, char** argv)
         size_t local_n_blocks = 0;
 
         {
-            master.foreach([&local_n_active, &local_n_blocks, &local_n_components](Block* b,
-                    const diy::Master::ProxyWithLink& cp) {
+            Real local_value = 0;
+            size_t local_vertices = 0;
+            size_t local_n_low = 0;
+
+            master.foreach([&local_value, &local_vertices, &local_n_low, &local_n_active, &local_n_blocks,
+                    &local_n_components](Block* b, const diy::Master::ProxyWithLink& cp) {
 //            fmt::print("PRINT ADF gid = {}, mt.size = {}\n", b->gid, b->current_merge_tree_.size());
                 auto sum_n_vertices_pair = b->get_local_stats();
-                int n_low = b->n_low_;
-                int n_active = b->n_active_;
-                cp.collectives()->clear();
-                cp.all_reduce(sum_n_vertices_pair.first, std::plus<Real>());
-                cp.all_reduce(sum_n_vertices_pair.second, std::plus<size_t>());
-                cp.all_reduce(n_low, std::plus<size_t>());
-                cp.all_reduce(n_active, std::plus<size_t>());
 
-                local_n_active += n_active;
+                local_value += sum_n_vertices_pair.first;
+                local_vertices += sum_n_vertices_pair.second;
+                local_n_low += b->n_low_;
+                local_n_active += b->n_active_;
                 local_n_blocks += 1;
                 local_n_components += b->original_deepest_.size();
 
             });
 
-            master.exchange();
-
-            const diy::Master::ProxyWithLink& proxy = master.proxy(master.loaded_block());
-
-            Real total_value = proxy.get<Real>();
-            size_t total_vertices = proxy.get<size_t>();
-            size_t total_n_low = proxy.get<size_t>();
-            size_t total_n_active = proxy.get<size_t>();
+            // ranks can be left without blocks, so reduce over world, not over the blocks
+            Real total_value = 0;
+            size_t total_vertices = 0;
+            size_t total_n_low = 0;
+            size_t total_n_active = 0;
+            diy::mpi::all_reduce(world, local_value, total_value, std::plus<Real>());
+            diy::mpi::all_reduce(world, local_vertices, total_vertices, std::plus<size_t>());
+            diy::mpi::all_reduce(world, local_n_low, total_n_low, std::plus<size_t>());
+            diy::mpi::all_reduce(world, local_n_active, total_n_active, std::plus<size_t>());
 
             LOG_SEV_IF(world.rank() == 0, info) << "Total value = " << total_value << ", total # vertices = "
                                                                     << total_vertices
@@ -792,26 +919,28 @@ int main(int argc, char** argv)
             timer.restart();
         }
 
-        master.foreach([](Block* b, const diy::Master::ProxyWithLink& cp) {
-            auto sum_n_vertices_pair = b->get_local_stats();
-            int n_low = b->n_low_;
-            int n_active = b->n_active_;
-            cp.collectives()->clear();
-            cp.all_reduce(sum_n_vertices_pair.first, std::plus<Real>());
-            cp.all_reduce(sum_n_vertices_pair.second, std::plus<size_t>());
-            cp.all_reduce(n_low, std::plus<size_t>());
-            cp.all_reduce(n_active, std::plus<size_t>());
+        Real local_value = 0;
+        size_t local_vertices = 0;
+        size_t local_n_low = 0;
+        size_t local_n_active_cells = 0;
 
+        master.foreach([&local_value, &local_vertices, &local_n_low, &local_n_active_cells](Block* b,
+                const diy::Master::ProxyWithLink& cp) {
+            auto sum_n_vertices_pair = b->get_local_stats();
+            local_value += sum_n_vertices_pair.first;
+            local_vertices += sum_n_vertices_pair.second;
+            local_n_low += b->n_low_;
+            local_n_active_cells += b->n_active_;
         });
 
-        master.exchange();
-
-        const diy::Master::ProxyWithLink& proxy = master.proxy(master.loaded_block());
-
-        Real total_value = proxy.get<Real>();
-        size_t total_vertices = proxy.get<size_t>();
-        size_t total_n_low = proxy.get<size_t>();
-        size_t total_n_active = proxy.get<size_t>();
+        Real total_value = 0;
+        size_t total_vertices = 0;
+        size_t total_n_low = 0;
+        size_t total_n_active = 0;
+        diy::mpi::all_reduce(world, local_value, total_value, std::plus<Real>());
+        diy::mpi::all_reduce(world, local_vertices, total_vertices, std::plus<size_t>());
+        diy::mpi::all_reduce(world, local_n_low, total_n_low, std::plus<size_t>());
+        diy::mpi::all_reduce(world, local_n_active_cells, total_n_active, std::plus<size_t>());
 
         LOG_SEV_IF(world.rank() == 0, info) << "Total value = " << total_value << ", total # vertices = "
                                                                 << total_vertices
@@ -910,49 +1039,22 @@ int main(int argc, char** argv)
 #ifdef DO_DETAILED_TIMING
         if (n_run == n_runs - 1 or n_run == 0)
         {
-
-            master.foreach(
-                    [time_to_construct_blocks, time_to_init_blocks, time_to_get_average, tmt_send_time, tmt_exchange_1_time, tmt_receive_time, tmt_exchange_2_time](
-                            Block* b, const diy::Master::ProxyWithLink& cp) {
-                        cp.collectives()->clear();
-
-                        cp.all_reduce(time_to_construct_blocks, diy::mpi::maximum<DurationType>());
-                        cp.all_reduce(time_to_init_blocks, diy::mpi::maximum<DurationType>());
-                        cp.all_reduce(time_to_get_average, diy::mpi::maximum<DurationType>());
-                        cp.all_reduce(tmt_send_time, diy::mpi::maximum<DurationType>());
-                        cp.all_reduce(tmt_exchange_1_time, diy::mpi::maximum<DurationType>());
-                        cp.all_reduce(tmt_receive_time, diy::mpi::maximum<DurationType>());
-                        cp.all_reduce(tmt_exchange_2_time, diy::mpi::maximum<DurationType>());
-
-                        cp.all_reduce(time_to_construct_blocks, diy::mpi::minimum<DurationType>());
-                        cp.all_reduce(time_to_init_blocks, diy::mpi::minimum<DurationType>());
-                        cp.all_reduce(time_to_get_average, diy::mpi::minimum<DurationType>());
-                        cp.all_reduce(tmt_send_time, diy::mpi::minimum<DurationType>());
-                        cp.all_reduce(tmt_exchange_1_time, diy::mpi::minimum<DurationType>());
-                        cp.all_reduce(tmt_receive_time, diy::mpi::minimum<DurationType>());
-                        cp.all_reduce(tmt_exchange_2_time, diy::mpi::minimum<DurationType>());
-
-                    });
-
-            master.exchange();
-
-            const diy::Master::ProxyWithLink& proxy = master.proxy(master.loaded_block());
-
-            max_time_to_construct_blocks = proxy.get<DurationType>();
-            max_time_to_init_blocks = proxy.get<DurationType>();
-            max_time_to_get_average = proxy.get<DurationType>();
-            max_tmt_send_time = proxy.get<DurationType>();
-            max_tmt_exchange_1_time = proxy.get<DurationType>();
-            max_tmt_receive_time = proxy.get<DurationType>();
-            max_tmt_exchange_2_time = proxy.get<DurationType>();
-
-            min_time_to_construct_blocks = proxy.get<DurationType>();
-            min_time_to_init_blocks = proxy.get<DurationType>();
-            min_time_to_get_average = proxy.get<DurationType>();
-            min_tmt_send_time = proxy.get<DurationType>();
-            min_tmt_exchange_1_time = proxy.get<DurationType>();
-            min_tmt_receive_time = proxy.get<DurationType>();
-            min_tmt_exchange_2_time = proxy.get<DurationType>();
+            // the timings are per rank, reduce over world
+            diy::mpi::all_reduce(world, time_to_construct_blocks, max_time_to_construct_blocks, diy::mpi::maximum<DurationType>());
+            diy::mpi::all_reduce(world, time_to_init_blocks, max_time_to_init_blocks, diy::mpi::maximum<DurationType>());
+            diy::mpi::all_reduce(world, time_to_get_average, max_time_to_get_average, diy::mpi::maximum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_send_time, max_tmt_send_time, diy::mpi::maximum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_exchange_1_time, max_tmt_exchange_1_time, diy::mpi::maximum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_receive_time, max_tmt_receive_time, diy::mpi::maximum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_exchange_2_time, max_tmt_exchange_2_time, diy::mpi::maximum<DurationType>());
+
+            diy::mpi::all_reduce(world, time_to_construct_blocks, min_time_to_construct_blocks, diy::mpi::minimum<DurationType>());
+            diy::mpi::all_reduce(world, time_to_init_blocks, min_time_to_init_blocks, diy::mpi::minimum<DurationType>());
+            diy::mpi::all_reduce(world, time_to_get_average, min_time_to_get_average, diy::mpi::minimum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_send_time, min_tmt_send_time, diy::mpi::minimum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_exchange_1_time, min_tmt_exchange_1_time, diy::mpi::minimum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_receive_time, min_tmt_receive_time, diy::mpi::minimum<DurationType>());
+            diy::mpi::all_reduce(world, tmt_exchange_2_time, min_tmt_exchange_2_time, diy::mpi::minimum<DurationType>());
 
             LOG_SEV_IF(world.rank() == 0, info) << "max_time_to_construct_blocks = " << max_time_to_construct_blocks;
             LOG_SEV_IF(world.rank() == 0, info) << "min_time_to_construct_blocks = " << min_time_to_construct_blocks;
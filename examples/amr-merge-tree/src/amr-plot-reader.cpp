@@ -90,27 +90,13 @@ void read_amr_plotfile(std::string infile,
         refinements.push_back(refinements.back() * plotfile.refRatio(level));
     }
 
-    Real* fab_ptr_copy{nullptr};
-
-    Real total_sum = 0;
-    Real total_sum_wo = 0;
-    long int n_nans = 0;
-    long int n_infs = 0;
-    long int n_negs = 0;
-    long int n_wo = 0;
-
-    Real total_sum_1 = 0;
-    long int n_nans_1 = 0;
-    long int n_infs_1 = 0;
-    long int n_negs_1 = 0;
-    long int n_wo_1 = 0;
+    FieldStats<Real> stats_0;       // first field
+    FieldStats<Real> stats_1;       // all other fields
     long int n_additions = 0;
 
     long long int total_fab_vertices = 0;
     long long int total_a_vertices = 0;
 
-    std::map<int, Real*> gid_to_fab;
-
     std::map<int, std::vector<Real*>> gid_to_extra_pointers;
 
     for(size_t var_idx = 0; var_idx < all_var_names.size(); ++var_idx)
@@ -169,10 +155,6 @@ void read_amr_plotfile(std::string infile,
                 long long int fab_size = a_shape[0] * a_shape[1] * a_shape[2];
                 if (var_idx == 0)
                 {
-                    fab_ptr_copy = new Real[fab_size];
-                    gid_to_fab[gid] = fab_ptr_copy;
-                    memcpy(fab_ptr_copy, fab_ptr, sizeof(Real) * fab_size);
-
                     // allocate memory for all fields that we store in FabBlock
                     // actual copying for next fields will happen later
                     std::vector<Real*> extra_pointers;
@@ -184,23 +166,16 @@ void read_amr_plotfile(std::string infile,
                     }
 
                     gid_to_extra_pointers[gid] = extra_pointers;
-                    memcpy(extra_pointers[0], fab_ptr, sizeof(Real) * fab_size);
 
-                    for(int i = 0; i < fab_size; ++i)
-                    {
-                        total_sum += fab_ptr[i];
-                        n_nans += std::isnan(fab_ptr[i]);
-                        n_infs += std::isinf(fab_ptr[i]);
-                        n_negs += (fab_ptr[i] < 0);
-                        if (not std::isnan(fab_ptr[i]) and not std::isinf(fab_ptr[i]))
-                        {
-                            total_sum_wo += fab_ptr[i];
-                            n_wo += 1;
-                        }
-                    }
-                    if (debug) { fmt::print("FIELD 0 rank = {}, gid = {}, sum = {}, fabs_size = {}, avg_in_fab = {}, n_nans = {}, n_infs = {}, n_negs = {}, n_wo = {}, avg_wo = {}\n", world.rank(), gid, total_sum, fab_size, total_sum / fab_size, n_nans, n_infs, n_negs, n_wo, total_sum_wo / n_wo); }
+                    // first field is always part of the function; fab aliases its copy,
+                    // the sum with the other function fields is evaluated lazily, see FabBlock::function()
+                    stats_0 += load_field<Real>(fab_ptr, fab_size, extra_pointers[0], nullptr, false, false);
+
+                    if (debug) { fmt::print("FIELD 0 rank = {}, gid = {}, sum = {}, fabs_size = {}, avg_in_fab = {}, n_nans = {}, n_infs = {}, n_negs = {}, n_wo = {}, avg_wo = {}\n", world.rank(), gid, stats_0.sum, fab_size, stats_0.sum / fab_size, stats_0.n_nans, stats_0.n_infs, stats_0.n_negs, stats_0.n_finite, stats_0.sum_finite / stats_0.n_finite); }
 
-                    master_reader.add(gid, new Block(fab_ptr_copy, all_var_names, extra_pointers, a_shape), link);
+                    auto* block = new Block(extra_pointers[0], all_var_names, extra_pointers, a_shape);
+                    block->n_function_fields_ = std::max(1, std::min(n_mt_vars, static_cast<int>(all_var_names.size())));
+                    master_reader.add(gid, block, link);
 
                     // record wrap
                     for(int dir_x : {-1, 0, 1})
@@ -282,29 +257,13 @@ void read_amr_plotfile(std::string infile,
                 {
                     Real* block_extra_ptr = gid_to_extra_pointers.at(gid).at(var_idx);
 
-                    Real* block_fab_ptr = gid_to_fab.at(gid);
                     bool add_to_fab = (static_cast<decltype(n_mt_vars)>(var_idx) < n_mt_vars);
-                    if (debug) fmt::print("Adding next field, block_fab_ptr = {}, fab_ptr = {}, gid = {}, fab_size = {}\n", (void*) block_fab_ptr, (void*) fab_ptr, gid, fab_size);
-                    for(int i = 0; i < fab_size; ++i)
-                    {
-                        total_sum_1 += fab_ptr[i];
-                        n_nans_1 += std::isnan(fab_ptr[i]);
-                        n_infs_1 += std::isinf(fab_ptr[i]);
-                        n_negs_1 += (fab_ptr[i] < 0);
-                        if (not std::isnan(fab_ptr[i]) and not std::isinf(fab_ptr[i]))
-                        {
-                            n_wo_1 += 1;
-                        }
+                    if (debug) fmt::print("Adding next field, block_extra_ptr = {}, fab_ptr = {}, gid = {}, fab_size = {}\n", (void*) block_extra_ptr, (void*) fab_ptr, gid, fab_size);
+                    stats_1 += load_field<Real>(fab_ptr, fab_size, block_extra_ptr, nullptr, false, false);
+                    if (add_to_fab)
+                        n_additions += fab_size;
 
-                        if (add_to_fab)
-                        {
-                            block_fab_ptr[i] += fab_ptr[i];
-                            n_additions += 1;
-                        }
-
-                        block_extra_ptr[i] = fab_ptr[i];
-                    }
-                    if (debug) fmt::print( "Added next field, block_fab_ptr = {}, fab_ptr = {}, gid = {}, n_nans_1 = {}, n_negs_1 = {}, n_infs_1 = {}, totao_sum_1 = {}\n", (void*) block_fab_ptr, (void*) fab_ptr, gid, n_nans_1, n_negs_1, n_infs_1, total_sum_1);
+                    if (debug) fmt::print( "Added next field, block_extra_ptr = {}, fab_ptr = {}, gid = {}, n_nans_1 = {}, n_negs_1 = {}, n_infs_1 = {}, totao_sum_1 = {}\n", (void*) block_extra_ptr, (void*) fab_ptr, gid, stats_1.n_nans, stats_1.n_negs, stats_1.n_infs, stats_1.sum);
                 }
             } // loop over tiles
         } // loop over all_var_names
@@ -26,7 +26,8 @@ void read_from_hdf5_file(std::string infn,
                          diy::Master& master_reader,
                          diy::ContiguousAssigner& assigner,
                          diy::MemoryBuffer& header,
-                         diy::DiscreteBounds& domain)
+                         diy::DiscreteBounds& domain,
+                         const DecompositionParams& decomposition)
 {
     constexpr unsigned D = 3;
     using FabBlockR = FabBlock<Real, D>;
@@ -50,17 +51,8 @@ void read_from_hdf5_file(std::string infn,
     }
 
     Decomposer::BoolVector wrap { true, true, true };               // TODO
-    Decomposer decomposer(D, domain, nblocks,
-                          Decomposer::BoolVector { false, false, false },   // share_face
-                          wrap,
-                          Decomposer::CoordinateVector { 0, 0, 0 });        // ghosts
 
-    decomposer.decompose(world.rank(), assigner, [&master_reader, &wrap, &datasets, &all_var_names, n_mt_vars, one]
-                                                                      (int gid,
-                                                                       const Decomposer::Bounds& core,
-                                                                       const Decomposer::Bounds& bounds,
-                                                                       const Decomposer::Bounds& domain,
-                                                                       const Decomposer::Link& link) {
+    auto read_block = [&datasets, &all_var_names, n_mt_vars, one](int gid, const Decomposer::Bounds& core) {
         auto* b = new FabBlockR;
 
         // we never want ghosts
@@ -69,8 +61,13 @@ void read_from_hdf5_file(std::string infn,
         auto shape_4d = my_bounds.max - my_bounds.min + one;
         typename FabBlockR::Shape shape(&shape_4d[0]);       // quick and hacky
         bool c_order = true;
-        b->fab_storage_ = decltype(b->fab_storage_)(shape, c_order);
-        b->fab = decltype(b->fab)(b->fab_storage_.data(), shape, c_order);
+        b->n_function_fields_ = std::min(n_mt_vars, static_cast<int>(all_var_names.size()));
+        if (b->n_function_fields_ == 0)
+        {
+            b->fab_storage_ = decltype(b->fab_storage_)(shape, c_order);
+            std::fill(b->fab_storage_.data(), b->fab_storage_.data() + b->fab_storage_.size(), Real(0));
+            b->fab = decltype(b->fab)(b->fab_storage_.data(), shape, c_order);
+        }
 
 //#ifdef ZARIJA
 //        // pretend that the 1st and only field is particle_mass_density
@@ -87,28 +84,80 @@ void read_from_hdf5_file(std::string infn,
             from[i] = core.min[i];
             size[i] = core.max[i] - core.min[i] + 1;
         }
+        // core_grid and all fabs are in c_order, so the fields can be copied linearly;
+        // the function for MT computation (sum of the first n_mt_vars fields) is not stored, see FabBlock::function()
+        FieldStats<Real> stats;
         for (size_t i = 0; i < all_var_names.size(); ++i)
         {
-            Real* extra_fab = new Real[b->fab.size()];
+            Real* extra_fab = new Real[core_grid.size()];
             b->extra_fabs_.emplace_back(extra_fab, shape, c_order);
             b->extra_names_.push_back(all_var_names[i]);
 
             datasets[i].select(from, size).read(core_grid.data());
 
-            auto& g = b->extra_fabs_.back();
-            diy::for_each(shape, [&](const typename FabBlockR::Shape& p) {
-                g(p) = core_grid(p);
-            });
+            // copy the field and compute its stats in one pass
+            auto field_stats = load_field<Real>(core_grid.data(), core_grid.size(), extra_fab, nullptr, false, false);
+            if (static_cast<int>(i) < n_mt_vars)
+                stats += field_stats;
         }
 
-        // fill the field for MT computation
-        diy::for_each(shape, [&](const typename FabBlockR::Shape& p) {
-            b->fab(p) = 0;
-        });
-        for (int i = 0; i < n_mt_vars; ++i)
-            diy::for_each(shape, [&](const typename FabBlockR::Shape& p) {
-                b->fab(p) += b->extra_fabs_[i](p);
-            });
+        // fab only provides shape and order, values live in the extra fabs
+        if (b->n_function_fields_ > 0)
+            b->fab = b->extra_fabs_[0];
+
+        LOG_SEV(debug) << "[" << gid << "] function fields: sum = " << stats.sum << ", nans = " << stats.n_nans
+                       << ", infs = " << stats.n_infs << ", negative = " << stats.n_negs;
+
+        return b;
+    };
+
+    if (decomposition.kd)
+    {
+        // function for the active cells: sum of the first n_mt_vars fields, as in FabBlock::function()
+        int n_function_fields = std::min(n_mt_vars, static_cast<int>(all_var_names.size()));
+        DiscreteBoundsVector cores = kd_decompose_active_cells<D, Real>(world, domain, nblocks, decomposition,
+                [&datasets, n_function_fields, one](const diy::DiscreteBounds& box, Real* data) {
+                    auto shape_4d = box.max - box.min + one;
+                    typename FabBlockR::Shape shape(&shape_4d[0]);
+                    diy::Grid<Real, D> field(shape);
+                    std::fill(data, data + field.size(), Real(0));
+
+                    std::vector<size_t> from(D), size(D);
+                    for (unsigned i = 0; i < D; ++i)
+                    {
+                        from[i] = box.min[i];
+                        size[i] = box.max[i] - box.min[i] + 1;
+                    }
+                    for (int i = 0; i < n_function_fields; ++i)
+                    {
+                        datasets[i].select(from, size).read(field.data());
+                        for (size_t k = 0; k < field.size(); ++k)
+                            data[k] += field.data()[k];
+                    }
+                });
+
+        std::vector<int> gids;
+        assigner.local_gids(world.rank(), gids);
+        for(int gid : gids)
+            master_reader.add(gid, read_block(gid, cores[gid]), kd_link<D>(gid, cores, domain, wrap, assigner));
+        return;
+    }
+
+    Decomposer decomposer(D, domain, nblocks,
+                          Decomposer::BoolVector { false, false, false },   // share_face
+                          wrap,
+                          Decomposer::CoordinateVector { 0, 0, 0 });        // ghosts
+
+    decomposer.decompose(world.rank(), assigner, [&master_reader, &wrap, &read_block]
+                                                                      (int gid,
+                                                                       const Decomposer::Bounds& core,
+                                                                       const Decomposer::Bounds& bounds,
+                                                                       const Decomposer::Bounds& domain,
+                                                                       const Decomposer::Link& link) {
+        auto* b = read_block(gid, core);
+
+        // we never want ghosts
+        auto my_bounds = core;
 
         // copy link
         diy::AMRLink* amr_link = new diy::AMRLink(D, 0, 1, link.core(), my_bounds);
@@ -121,32 +170,8 @@ void read_from_hdf5_file(std::string infn,
             amr_link->add_bounds(0, 1, nbr_core, nbr_bounds);
         }
 
-        // record wrap
-        for (int dir_x : { -1, 0, 1 })
-        {
-            if (!wrap[0] && dir_x) continue;
-            if (dir_x < 0 && core.min[0] != domain.min[0]) continue;
-            if (dir_x > 0 && core.max[0] != domain.max[0]) continue;
-
-            for (int dir_y : { -1, 0, 1 })
-            {
-                if (!wrap[1] && dir_y) continue;
-                if (dir_y < 0 && core.min[1] != domain.min[1]) continue;
-                if (dir_y > 0 && core.max[1] != domain.max[1]) continue;
-
-                for (int dir_z : { -1, 0, 1 })
-                {
-                    if (dir_x == 0 and dir_y == 0 and dir_z == 0)
-                        continue;
-
-                    if (!wrap[2] && dir_z) continue;
-                    if (dir_z < 0 && core.min[2] != domain.min[2]) continue;
-                    if (dir_z > 0 && core.max[2] != domain.max[2]) continue;
-        // TODO! fix wrap
-                    amr_link->add_wrap(diy::Direction{ dir_x, dir_y, dir_z });
-                }
-            }
-        }
+        add_domain_wraps(amr_link, core, domain, wrap);
+
         master_reader.add(gid, b, amr_link);
     });
 }
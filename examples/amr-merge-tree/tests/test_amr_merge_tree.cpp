@@ -2,6 +2,9 @@
 
 #include <sstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <set>
 
 #include <diy/master.hpp>
 #include <diy/io/block.hpp>
@@ -11,9 +14,16 @@
 
 #include "fab-block.h"
 #include "fab-tmt-block.h"
+#include "amr-rebalance.h"
+#include "amr-merge-tree-send-simple.h"
+#include "kd-decomposition.h"
 #include "reader-interfaces.h"
 #include "diy/vertices.hpp"
 #include "reeber/grid.h"
+#include "reeber/amr-edge-codec.h"
+#include "reeber/amr-boundary-cells.h"
+#include "reeber/flat-containers.h"
+#include "reeber/flat-containers-serialization.h"
 
 TEST_CASE("Small check", "[masked_box][dim2]")
 {
@@ -153,6 +163,448 @@ TEST_CASE("Small check", "[masked_box][dim2]")
     }
 }
 
+TEST_CASE("Packed mask", "[masked_box][dim2]")
+{
+    using PackedMask = reeber::PackedMask<2>;
+    using MaskedBox = reeber::MaskedBox<2>;
+    using Position = PackedMask::Position;
+
+    for(bool c_order : {true, false})
+    {
+        PackedMask pm(Position({7, 5}), c_order);
+
+        REQUIRE(pm.size() == 35);
+
+        diy::for_each(pm.shape(), [&pm](const Position& p) { pm.set(p, MaskedBox::UNINIT); });
+        REQUIRE(pm.count(PackedMask::UNINIT) == 35);
+        REQUIRE(pm.n_owned() == 0);
+
+        pm.set(Position({0, 0}), MaskedBox::LOW);
+        pm.set(Position({6, 4}), 17);
+        pm.set(Position({3, 2}), MaskedBox::ACTIVE);
+        pm.set(Position({1, 4}), 0);
+
+        REQUIRE(pm(Position({0, 0})) == MaskedBox::LOW);
+        REQUIRE(pm(Position({6, 4})) == 17);
+        REQUIRE(pm(Position({3, 2})) == MaskedBox::ACTIVE);
+        REQUIRE(pm(Position({1, 4})) == 0);
+        REQUIRE(pm(Position({2, 2})) == MaskedBox::UNINIT);
+        REQUIRE(pm.n_owned() == 2);
+        REQUIRE(pm.count(PackedMask::UNINIT) == 31);
+
+        // overwriting gid with special value must clear the side table
+        pm.set(Position({6, 4}), MaskedBox::NOT_IN_DOMAIN);
+        REQUIRE(pm(Position({6, 4})) == MaskedBox::NOT_IN_DOMAIN);
+        REQUIRE(pm.n_owned() == 1);
+
+        auto unpacked = pm.unpack();
+        diy::for_each(pm.shape(), [&pm, &unpacked](const Position& p) { REQUIRE(unpacked(p) == pm(p)); });
+
+        for(size_t i = 0; i < pm.size(); ++i)
+            REQUIRE(pm.index(pm.vertex(i)) == i);
+    }
+}
+
+TEST_CASE("Packed mask transform", "[masked_box][dim2]")
+{
+    using PackedMask = reeber::PackedMask<2>;
+    using MaskedBox = reeber::MaskedBox<2>;
+    using Position = PackedMask::Position;
+
+    // more cells than one run of transform
+    PackedMask pm(Position({60, 50}));
+    diy::for_each(pm.shape(), [&pm](const Position& p) { pm.set(p, MaskedBox::ACTIVE); });
+    pm.set(Position({10, 10}), 5);
+    pm.set(Position({59, 49}), 6);
+
+    // every 7th cell is owned by gid i % 3, other cells become LOW, if they were ACTIVE; count new owned cells
+    size_t n_owned = pm.transform<size_t>([&pm](size_t i, size_t& count) {
+        if (i % 7 == 0)
+        {
+            count++;
+            return static_cast<int>(i % 3);
+        }
+        return pm(i) == MaskedBox::ACTIVE ? MaskedBox::LOW : pm(i);
+    });
+
+    REQUIRE(n_owned == (pm.size() + 6) / 7);
+    REQUIRE(pm.n_owned() == n_owned + 2);
+    for(size_t i = 0; i < pm.size(); ++i)
+    {
+        if (i % 7 == 0)
+            REQUIRE(pm(i) == static_cast<int>(i % 3));
+        else if (i == pm.index(Position({10, 10})))
+            REQUIRE(pm(i) == 5);
+        else if (i == pm.index(Position({59, 49})))
+            REQUIRE(pm(i) == 6);
+        else
+            REQUIRE(pm(i) == MaskedBox::LOW);
+    }
+
+    // owned cells that get a special value leave the side table
+    pm.transform<size_t>([](size_t, size_t&) { return MaskedBox::GHOST; });
+    REQUIRE(pm.n_owned() == 0);
+    REQUIRE(pm.count(PackedMask::GHOST) == pm.size());
+}
+
+TEST_CASE("Linear combination of fields", "[FabTmtBlock][dim2]")
+{
+    using Grid = reeber::Grid<double, 2>;
+    using GridRef = reeber::GridRef<double, 2>;
+    using Function = reeber::LinearCombination<double, 2>;
+    using Vertex = Grid::Vertex;
+
+    Grid a(Vertex({4, 3})), b(Vertex({4, 3}));
+    for(size_t i = 0; i < a.size(); ++i)
+    {
+        a.data()[i] = i;
+        b.data()[i] = 10.0 * i;
+    }
+
+    Function single(GridRef(a.data(), a.shape(), a.c_order()));
+    Function sum(std::vector<GridRef> { a, b });
+    Function weighted(std::vector<GridRef> { a, b }, { 2.0, -1.0 });
+
+    REQUIRE(sum.shape() == a.shape());
+    REQUIRE(sum.n_grids() == 2);
+
+    diy::for_each(a.shape(), [&](const Vertex& v) {
+        REQUIRE(single(v) == a(v));
+        REQUIRE(sum(v) == a(v) + b(v));
+        REQUIRE(weighted(v) == 2.0 * a(v) - b(v));
+        REQUIRE(sum(sum.index(v)) == sum(v));
+    });
+
+    std::vector<double> values(sum.size());
+    sum.evaluate(0, values.size(), values.data());
+    for(size_t i = 0; i < values.size(); ++i)
+        REQUIRE(values[i] == 11.0 * i);
+
+    Grid c(Vertex({3, 4}));
+    REQUIRE_THROWS(Function(std::vector<GridRef> { a, c }));
+}
+
+TEST_CASE("Amr edge codec", "[FabTmtBlock][edges]")
+{
+    using Codec = reeber::AmrEdgeCodec;
+    using AmrVertexId = reeber::AmrVertexId;
+    using AmrEdge = reeber::AmrEdge;
+    using AmrEdgeContainer = reeber::AmrEdgeContainer;
+
+    AmrEdgeContainer edges;
+    for(size_t i = 0; i < 50; ++i)
+        edges.emplace_back(AmrVertexId(3, 100 + i), AmrVertexId(i % 5 ? 7 : 2, 1000 - 2 * i));
+    edges.emplace_back(AmrVertexId(3, 0), AmrVertexId(7, AmrVertexId::max_vertex()));
+
+    Codec::Bytes bytes;
+    Codec::encode(edges, bytes);
+    REQUIRE(bytes.size() < Codec::raw_size(edges) / 4);
+
+    // groups in the order of their first edge, order within a group kept
+    AmrEdgeContainer expected;
+    std::copy_if(edges.begin(), edges.end(), std::back_inserter(expected), [](const AmrEdge& e) { return std::get<1>(e).gid == 2; });
+    std::copy_if(edges.begin(), edges.end(), std::back_inserter(expected), [](const AmrEdge& e) { return std::get<1>(e).gid == 7; });
+
+    AmrEdgeContainer decoded;
+    Codec::decode(bytes.data(), bytes.size(), decoded);
+    REQUIRE(decoded == expected);
+
+    diy::MemoryBuffer bb;
+    Codec::save(bb, edges);
+    Codec::save(bb, AmrEdgeContainer());
+    bb.reset();
+    Codec::load(bb, decoded);
+    REQUIRE(decoded == expected);
+    Codec::load(bb, decoded);
+    REQUIRE(decoded.empty());
+
+    bytes.pop_back();
+    REQUIRE_THROWS(Codec::decode(bytes.data(), bytes.size(), decoded));
+}
+
+TEST_CASE("Amr boundary cells", "[FabTmtBlock][edges]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+
+    reeber::AmrBoundaryCells<AmrVertexId> cells;
+    for(size_t i = 0; i < 50; ++i)
+        cells.add(1000 - 2 * (i % 25), AmrVertexId(3, i % 25));
+    cells.add(std::numeric_limits<std::uint64_t>::max(), AmrVertexId(3, 7));
+    cells.sort();
+    REQUIRE(cells.size() == 26);
+
+    diy::MemoryBuffer bb;
+    cells.save(bb);
+    reeber::AmrBoundaryCells<reeber::NoValue> vertices_only;
+    vertices_only.add(5);
+    size_t vertices_only_bytes = vertices_only.save(bb);
+    REQUIRE(vertices_only_bytes == sizeof(size_t) + 2);
+    bb.reset();
+
+    reeber::AmrBoundaryCells<AmrVertexId> loaded;
+    loaded.load(bb);
+    REQUIRE(loaded.size() == 26);
+    REQUIRE(loaded.contains(952));
+    REQUIRE(loaded.value(952) == AmrVertexId(3, 24));
+    REQUIRE(loaded.value(1000) == AmrVertexId(3, 0));
+    REQUIRE(loaded.value(std::numeric_limits<std::uint64_t>::max()) == AmrVertexId(3, 7));
+    REQUIRE(not loaded.contains(951));
+    REQUIRE_THROWS(loaded.value(951));
+
+    reeber::AmrBoundaryCells<reeber::NoValue> loaded_vertices_only;
+    loaded_vertices_only.load(bb);
+    REQUIRE(loaded_vertices_only.contains(5));
+    REQUIRE(loaded_vertices_only.size() == 1);
+}
+
+TEST_CASE("AmrVertexId ordering", "[FabTmtBlock]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+
+    // ordered by (vertex, gid), packed or not
+    std::vector<AmrVertexId> ids { { 0, 0 }, { 5, 0 }, { 1, 1 }, { 7, 1 }, { 0, 1000000 }, { 3, 1000000 } };
+    REQUIRE(std::is_sorted(ids.begin(), ids.end()));
+    for(size_t i = 1; i < ids.size(); ++i)
+    {
+        REQUIRE(ids[i - 1] < ids[i]);
+        REQUIRE(ids[i] > ids[i - 1]);
+        REQUIRE(ids[i - 1] != ids[i]);
+    }
+
+    AmrVertexId v(3, 1000000);
+    REQUIRE(v.gid == 3);
+    REQUIRE(v.vertex == 1000000);
+    REQUIRE(v == ids.back());
+    REQUIRE(std::hash<AmrVertexId>()(v) == std::hash<AmrVertexId>()(ids.back()));
+
+    AmrVertexId none;
+    REQUIRE(none.gid == -1);
+    REQUIRE(none.vertex == AmrVertexId::no_vertex());
+    REQUIRE(AmrVertexId(0, AmrVertexId::max_vertex()) < none);
+    REQUIRE(AmrVertexId(2, AmrVertexId::max_vertex()).vertex == AmrVertexId::max_vertex());
+    REQUIRE(AmrVertexId(-1, 0) < none);
+    REQUIRE(AmrVertexId(-1, 0) < AmrVertexId(0, 0));
+
+    v.gid = 4;
+    v.vertex = 12;
+    REQUIRE(v == AmrVertexId(4, 12));
+}
+
+TEST_CASE("Flat containers", "[FabTmtBlock]")
+{
+    using AmrVertexId = reeber::AmrVertexId;
+    using Map = reeber::FlatHashMap<AmrVertexId, AmrVertexId>;
+    using Set = reeber::SortedVectorSet<AmrVertexId>;
+
+    Map m;
+    std::map<AmrVertexId, AmrVertexId> expected;
+    for(size_t i = 0; i < 1000; ++i)
+    {
+        AmrVertexId k(i % 7, (i * 37) % 400);
+        m[k] = AmrVertexId(1, i);
+        expected[k] = AmrVertexId(1, i);
+    }
+    REQUIRE(m.size() == expected.size());
+
+    // insert does not overwrite
+    REQUIRE(not m.insert(std::make_pair(AmrVertexId(0, 0), AmrVertexId(5, 5))).second);
+    REQUIRE(m.at(AmrVertexId(0, 0)) == expected[AmrVertexId(0, 0)]);
+
+    // erase while iterating
+    for(auto iter = m.cbegin(); iter != m.cend();)
+        iter = (iter->first.vertex % 2 == 0) ? m.erase(iter) : std::next(iter);
+    for(auto iter = expected.cbegin(); iter != expected.cend();)
+        iter = (iter->first.vertex % 2 == 0) ? expected.erase(iter) : std::next(iter);
+
+    std::map<AmrVertexId, AmrVertexId> result(m.begin(), m.end());
+    REQUIRE(result == expected);
+    REQUIRE(m.find(AmrVertexId(0, 0)) == m.end());
+    REQUIRE_THROWS(m.at(AmrVertexId(0, 0)));
+
+    // same layout as std::map
+    diy::MemoryBuffer bb;
+    diy::save(bb, m);
+    bb.reset();
+    std::map<AmrVertexId, AmrVertexId> loaded;
+    diy::load(bb, loaded);
+    REQUIRE(loaded == expected);
+
+    Set s;
+    std::set<AmrVertexId> expected_set;
+    for(size_t i = 0; i < 100; ++i)
+    {
+        AmrVertexId v(i % 3, (i * 13) % 50);
+        REQUIRE(s.insert(v).second == expected_set.insert(v).second);
+    }
+    REQUIRE(std::equal(s.begin(), s.end(), expected_set.begin(), expected_set.end()));
+    REQUIRE(s.count(*expected_set.begin()) == 1);
+    REQUIRE(s.count(AmrVertexId(5, 0)) == 0);
+}
+
+TEST_CASE("Merge keeps the nodes of the first tree", "[merge]")
+{
+    using Tree = reeber::TripletMergeTree<int, double>;
+    std::vector<std::tuple<int, int>> no_edges;
+
+    // the larger vertex map is kept in place, precedence must not depend on it
+    Tree mt1, mt2;
+    mt1.add(0, 1.0);
+    for(int v = 0; v < 10; ++v)
+        mt2.add(v, 2.0);
+    reeber::merge(mt1, mt2, no_edges, true);
+    REQUIRE(mt1.size() == 10);
+    REQUIRE(mt1[0]->value == 1.0);
+
+    // k-way: mt, then trees in order; the largest map is one of the trees
+    for(int largest = 0; largest < 3; ++largest)
+    {
+        Tree mt;
+        mt.add(0, 10.0);
+        std::vector<Tree> trees(3);
+        for(int i = 0; i < 3; ++i)
+        {
+            trees[i].add(0, 20.0 + i);
+            trees[i].add(1, 30.0 + i);
+        }
+        for(int v = 100; v < 110; ++v)
+            trees[largest].add(v, 1.0);
+
+        reeber::merge(mt, trees, no_edges, true);
+        REQUIRE(mt.size() == 12);
+        REQUIRE(mt[0]->value == 10.0);
+        REQUIRE(mt[1]->value == 30.0);
+    }
+}
+
+TEST_CASE("Block rebalancing", "[rebalance]")
+{
+    BlockCosts costs;
+    costs.gids  = { 0, 1, 2, 3, 4, 5 };
+    costs.ranks = { 0, 0, 0, 0, 1, 1 };
+    costs.costs = { 8, 1, 4, 3, 0, 4 };
+
+    int n_ranks = 2;
+    REQUIRE(load_imbalance(costs, costs.ranks, n_ranks) == Approx(16.0 / 10.0));
+
+    std::vector<int> greedy = assign_greedy(costs, n_ranks);
+    REQUIRE(greedy == std::vector<int>({ 0, 1, 1, 0, 1, 1 }));
+    REQUIRE(load_imbalance(costs, greedy, n_ranks) == Approx(1.1));
+
+    std::vector<int> contiguous = assign_contiguous(costs, n_ranks);
+    REQUIRE(contiguous == std::vector<int>({ 0, 0, 1, 1, 1, 1 }));
+    REQUIRE(std::is_sorted(contiguous.begin(), contiguous.end()));
+
+    // no work, nothing moves
+    costs.costs.assign(costs.size(), 0);
+    REQUIRE(load_imbalance(costs, costs.ranks, n_ranks) == 0);
+    REQUIRE(assign_greedy(costs, n_ranks) == costs.ranks);
+    REQUIRE(assign_contiguous(costs, n_ranks) == costs.ranks);
+
+    // every rank keeps at least one block, even if one block outweighs all others
+    costs.gids  = { 0, 1, 2, 3 };
+    costs.ranks = { 0, 1, 2, 3 };
+    costs.costs = { 10, 1, 1, 1 };
+    n_ranks = 4;
+    REQUIRE(assign_contiguous(costs, n_ranks) == std::vector<int>({ 0, 1, 2, 3 }));
+    REQUIRE(assign_greedy(costs, n_ranks) == std::vector<int>({ 0, 1, 2, 3 }));
+
+    costs.costs = { 0, 0, 5, 5 };
+    for(const std::vector<int>& assignment : { assign_greedy(costs, n_ranks), assign_contiguous(costs, n_ranks) })
+    {
+        std::vector<int> sorted = assignment;
+        std::sort(sorted.begin(), sorted.end());
+        REQUIRE(sorted == std::vector<int>({ 0, 1, 2, 3 }));
+    }
+
+    // fewer blocks than ranks, nothing moves
+    n_ranks = 5;
+    REQUIRE(assign_greedy(costs, n_ranks) == costs.ranks);
+    REQUIRE(assign_contiguous(costs, n_ranks) == costs.ranks);
+}
+
+TEST_CASE("Asynchronous rounds finish an isolated component", "[FabTmtBlock][async]")
+{
+    using Block = FabTmtBlock<Real, 2>;
+    using Grid = reeber::Grid<Real, 2>;
+    using Vertex = Grid::Vertex;
+    using Point = diy::DynamicPoint<int, 4>;
+
+    // one block, no neighbors, all cells active: a single component that never receives anything
+    diy::DiscreteBounds domain { Point { 0, 0, 0, 0 }, Point { 3, 3, 0, 0 } };
+    Grid grid(Vertex({ 4, 4 }));
+    std::fill(grid.data(), grid.data() + grid.size(), 1.0);
+
+    diy::mpi::communicator world;
+    diy::Master master(world, 1, -1, &Block::create, &Block::destroy);
+
+    auto* link = new diy::AMRLink(2, 0, 1, domain, domain);
+    Block::Function function(Block::GridRef(grid.data(), grid.shape(), grid.c_order()));
+    auto* b = new Block(function, 1, 0, domain, domain, domain, 0, link, 20000.0, false, true);
+    REQUIRE(b->n_active_ == 16);
+    master.add(0, b, link);
+
+    // same steps as amr-merge-tree --async
+    retire_inactive_blocks<2>(master);
+    master.foreach(&send_boundary_cells_to_neighbors<2>);
+    master.exchange();
+    master.foreach(&delete_low_edges<2>);
+    master.iexchange<Block>(&amr_tmt_async<Real, 2>);
+
+    b = master.block<Block>(0);
+    REQUIRE(not b->retired_);
+    REQUIRE(b->done_ == 1);
+    REQUIRE(b->round_ == 0);
+}
+
+TEST_CASE("Kd decomposition of active cells", "[kd]")
+{
+    diy::DiscreteBounds domain(3);
+    domain.min = { 0, 0, 0, 0 };
+    domain.max = { 63, 47, 39, 0 };
+
+    // 8 x 6 x 5 coarse cells, all active cells in the first two layers along x
+    int coarse = 8;
+    std::array<int, 3> coarse_shape { 8, 6, 5 };
+    std::vector<double> counts(8 * 6 * 5, 0);
+    for(size_t i = 0; i < 2 * 6 * 5; ++i)
+        counts[i] = 10;
+
+    for(int nblocks : { 1, 2, 5, 16, 240 })
+    {
+        DiscreteBoundsVector cores = kd_decompose<3>(domain, nblocks, coarse, counts, coarse_shape);
+        REQUIRE(cores.size() == static_cast<size_t>(nblocks));
+
+        // cores cover the domain exactly once
+        std::vector<int> covered(64 * 48 * 40, 0);
+        for(const diy::DiscreteBounds& core : cores)
+            for(int x = core.min[0]; x <= core.max[0]; ++x)
+                for(int y = core.min[1]; y <= core.max[1]; ++y)
+                    for(int z = core.min[2]; z <= core.max[2]; ++z)
+                        covered[(x * 48 + y) * 40 + z]++;
+        REQUIRE(std::all_of(covered.begin(), covered.end(), [](int c) { return c == 1; }));
+    }
+
+    // the cut halves the active cells
+    DiscreteBoundsVector cores = kd_decompose<3>(domain, 2, coarse, counts, coarse_shape);
+    REQUIRE(cores[0].max[0] == 7);
+    REQUIRE(cores[1].min[0] == 8);
+
+    REQUIRE_THROWS(kd_decompose<3>(domain, 241, coarse, counts, coarse_shape));
+
+    diy::RegularDecomposer<diy::DiscreteBounds>::BoolVector wrap { true, true, true }, no_wrap { false, false, false };
+    diy::DiscreteBounds a(3), b(3);
+    a.min = { 0, 0, 0, 0 };
+    a.max = { 7, 47, 39, 0 };
+    b.min = { 56, 0, 0, 0 };
+    b.max = { 63, 47, 39, 0 };
+    REQUIRE(boxes_touch<3>(a, b, domain, wrap));
+    REQUIRE(not boxes_touch<3>(a, b, domain, no_wrap));
+    b.min[0] = 8;
+    REQUIRE(boxes_touch<3>(a, b, domain, no_wrap));
+    b.min[0] = 9;
+    REQUIRE(not boxes_touch<3>(a, b, domain, no_wrap));
+}
+
 TEST_CASE("Check masked_box in 2 dimensions", "[masked_box][dim2]")
 {
     using MaskedBox = reeber::MaskedBox<2>;
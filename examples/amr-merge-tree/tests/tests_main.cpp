@@ -1,2 +1,11 @@
-#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_RUNNER
 #include "catch/catch.hpp"
+
+#include <diy/mpi.hpp>
+
+// some tests run diy::Master, MPI must be initialized once for all of them
+int main(int argc, char* argv[])
+{
+    diy::mpi::environment env(argc, argv);
+    return Catch::Session().run(argc, argv);
+}
@@ -89,14 +89,7 @@ struct EnqueueEdges
                                 }
                             }
                             if (neighbor != -1)
-                            {
-                                if ((b->*edge_maps)[neighbor].find(std::make_tuple(u_, v)) != (b->*edge_maps)[neighbor].end())
-                                {
-                                    Neighbor u_node_old = (b->*mt)[std::get<1>((b->*edge_maps)[neighbor][std::make_tuple(u_, v)])];
-                                    if ((b->*mt).cmp(u_node, u_node_old)) (b->*edge_maps)[neighbor][std::make_tuple(u_, v)] = std::make_tuple(u_node->value, u);
-                                }
-                                else (b->*edge_maps)[neighbor][std::make_tuple(u_, v)] = std::make_tuple(u_node->value, u);
-                            }
+                                (b->*edge_maps)[neighbor].append(std::make_tuple(u_, v), std::make_tuple(u_node->value, u));
                             else LOG_SEV(warning) << "Didn't find neighbor";
                         }
                         ++it;
@@ -104,6 +97,10 @@ struct EnqueueEdges
                 }
             }
 
+            // keep the lowest u per edge
+            for (auto& kv : b->*edge_maps)
+                kv.second.normalize([b,this](const std::tuple<Value, Index>& x, const std::tuple<Value, Index>& y) { return (b->*mt).cmp(x, y); });
+
             for (int i = 0; i < l->size(); i++) cp.enqueue(l->target(i), relabel[i]);
 
             cp.all_reduce(edge_count, std::plus<size_t>());
@@ -151,6 +148,8 @@ struct DequeueEdges
         cp.scratch(edge_count);
         size_t new_edge_count = 0;
 
+        auto lower = [b,this](const std::tuple<Value, Index>& x, const std::tuple<Value, Index>& y) { return (b->*mt).cmp(x, y); };
+
         std::unordered_map<Index, std::tuple<Value, Index>> relabel;
         for (int i = 0; i < l->size(); i++)
         {
@@ -170,25 +169,17 @@ struct DequeueEdges
                 v_node.vertex = v;
                 v_node.value = v_val;
 
-                if (new_edges.find(std::make_tuple(u_, v_)) != new_edges.end())
-                {
-                    Node cur_node;
-                    std::tie(cur_node.value, cur_node.vertex) = new_edges[std::make_tuple(u_, v_)];
-                    if ((b->*mt).cmp(u_node, v_node) && (b->*mt).cmp(v_node, cur_node))
-                        new_edges[std::make_tuple(u_, v_)] = std::make_tuple(v_node.value, v_node.vertex);
-                    else if ((b->*mt).cmp(v_node, u_node) && (b->*mt).cmp(u_node, cur_node))
-                        new_edges[std::make_tuple(u_, v_)] = std::make_tuple(u_node.value, u_node.vertex);
-                }
-                else
-                {
-                    if ((b->*mt).cmp(u_node, v_node)) new_edges[std::make_tuple(u_, v_)] = std::make_tuple(v_node.value, v_node.vertex);
-                    else new_edges[std::make_tuple(u_, v_)] = std::make_tuple(u_node.value, u_node.vertex);
-                }
+                // the edge goes through the higher of u and v; normalize() keeps the lowest such vertex per edge
+                if ((b->*mt).cmp(u_node, v_node)) new_edges.append(std::make_tuple(u_, v_), std::make_tuple(v_node.value, v_node.vertex));
+                else new_edges.append(std::make_tuple(u_, v_), std::make_tuple(u_node.value, u_node.vertex));
             }
+            new_edges.normalize(lower);
             (b->*edge_maps)[i].clear();
-            (b->*edges).insert(new_edges.begin(), new_edges.end());
+            for (auto& kv : new_edges)
+                (b->*edges).append(kv);
             new_edge_count += new_edges.size();
         }
+        (b->*edges).normalize(lower);
 
         cp.all_reduce(new_edge_count, std::plus<size_t>());
     }
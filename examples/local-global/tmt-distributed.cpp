@@ -22,6 +22,7 @@
 #include "reader-interfaces.h"
 #include "triplet-merge-tree-block.h"
 #include <reeber/distributed-tmt.h>
+#include <reeber/box-ownership.h>
 
 // debug only
 void save_grids(void* b_, const diy::Master::ProxyWithLink& cp, void*)
@@ -65,6 +66,7 @@ int main(int argc, char** argv)
     std::string prefix     = "./DIY.XXXXXX";
     int         in_memory  = -1;
     int         jobs       = 1;
+    int         k          = REEBER_MERGE_K;
 
     std::string profile_path;
     std::string log_level = "info";
@@ -75,6 +77,7 @@ int main(int argc, char** argv)
         >> Option('b', "blocks",    nblocks,      "number of blocks to use")
         >> Option('m', "memory",    in_memory,    "maximum blocks to store in memory")
         >> Option('j', "jobs",      jobs,         "threads to use during the computation")
+        >> Option('k', "k-way",     k,            "number of blocks merged per round of the reduction")
         >> Option('s', "storage",   prefix,       "storage prefix")
         >> Option('p', "profile",   profile_path, "path to keep the execution profile")
         >> Option('l', "log",       log_level,    "log level")
@@ -231,20 +234,19 @@ int main(int argc, char** argv)
                                &TripletMergeTreeBlock::edge_maps,
                                [&expand](TripletMergeTreeBlock* b)                          // topology
                                {
-                                   return expand(b->local);
+                                   return r::make_halo_box(b->local, expand(b->local));
                                },
                                [](TripletMergeTreeBlock* b) -> const decltype(b->grid)&     // function
                                { return b->grid; },
                                [&](TripletMergeTreeBlock* b)                                // gid generator
                                {
-                                   auto expanded = expand(b->local);
-                                   return [&decomposer,expanded](TripletMergeTreeBlock::Index i)
-                                          {
-                                            auto p = expanded.position(i);
-                                            int gid = decomposer.point_to_gid(p);
-                                            return gid;
-                                          };
-                               });
+                                   return r::make_box_ownership(b->local, expand(b->local), b->gid,
+                                                                [&decomposer](const TripletMergeTreeBlock::Box::Position& p)
+                                                                {
+                                                                  return decomposer.point_to_gid(p);
+                                                                });
+                               },
+                               diy::RegularSwapPartners(decomposer, k, true));
 
     // save the result
     timer.restart();
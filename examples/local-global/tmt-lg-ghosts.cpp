@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <string>
+#include <stdexcept>
 
 #include <dlog/stats.h>
 #include <dlog/log.h>
@@ -23,6 +24,7 @@
 #include "reader-interfaces.h"
 #include "edges.h"
 #include "triplet-merge-tree-block.h"
+#include <reeber/distributed-tmt.h>        // REEBER_MERGE_K
 
 // Load the specified chunk of data, compute local merge tree, add block to diy::Master
 struct LoadAdd
@@ -104,12 +106,32 @@ struct MergeSparsify
             MergeSparsify(bool wrap_):
                 wrap(wrap_)                                                         {}
 
+    // boxes follow each other along one dimension and agree in all the others
+    static bool contiguous(const std::vector<TripletMergeTreeBlock::Box>& boxes)
+    {
+        unsigned dim = boxes.front().dimension();
+        for (unsigned d = 0; d < dim; ++d)
+        {
+            bool along_d = true;
+            for (size_t i = 1; i < boxes.size() && along_d; ++i)
+                for (unsigned e = 0; e < dim; ++e)
+                {
+                    if (e == d)
+                        along_d = along_d && boxes[i].from()[e] == boxes[i-1].to()[e] + 1;
+                    else
+                        along_d = along_d && boxes[i].from()[e] == boxes[0].from()[e] && boxes[i].to()[e] == boxes[0].to()[e];
+                }
+            if (along_d)
+                return true;
+        }
+        return false;
+    }
+
     void    operator()(void* b_, const diy::ReduceProxy& srp, const diy::RegularSwapPartners& partners) const
     {
         typedef              TripletMergeTreeBlock::TripletMergeTree    TripletMergeTree;
         typedef              TripletMergeTreeBlock::Box                 Box;
         typedef              TripletMergeTreeBlock::EdgeMap             EdgeMap;
-        typedef              TripletMergeTreeBlock::Edge                Edge;
         typedef              TripletMergeTreeBlock::Index               Index;
 
         LOG_SEV(debug) << "Entered merge_sparsify()";
@@ -130,8 +152,7 @@ struct MergeSparsify
             std::vector<TripletMergeTree>  trees;
             for (int i = 0; i < in_size; ++i)
                 trees.emplace_back(b->mt.negate());
-            EdgeMap                        out_edges;
-            int out_pos = -1;
+            std::vector<EdgeMap>           trees_edges(in_size);
             for (int i = 0; i < in_size; ++i)
             {
               int nbr_gid = srp.in_link().target(i).gid;
@@ -139,13 +160,13 @@ struct MergeSparsify
               {
                   bounds[i].swap(b->global);
                   trees[i].swap(b->mt);
+                  trees_edges[i].swap(b->edges);
                   LOG_SEV(debug) << "  swapped in tree of size: " << trees[i].size();
               } else
               {
-                  out_pos = i;
                   srp.dequeue(nbr_gid, bounds[i]);
                   srp.dequeue(nbr_gid, trees[i]);
-                  srp.dequeue(nbr_gid, out_edges);
+                  srp.dequeue(nbr_gid, trees_edges[i]);
                   LOG_SEV(debug) << "  received tree of size: " << trees[i].size();
               }
             }
@@ -153,38 +174,57 @@ struct MergeSparsify
 
             dlog::prof >> "dequeue";
 
-            // merge boxes
+            // merge boxes (the k blocks of a round are contiguous along one dimension)
+            if (!contiguous(bounds))
+            {
+                LOG_SEV(error) << "[" << b->gid << "] boxes of round " << round << " are not contiguous along one dimension";
+                throw std::runtime_error("MergeSparsify: boxes are not contiguous");
+            }
             b->global.from() = bounds.front().from();
             b->global.to()   = bounds.back().to();
             LOG_SEV(debug) << "  boxes merged: " << b->global.from() << " - " << b->global.to() << " (" << b->global.grid_shape() << ')';
 
             // merge trees and move vertices
-            record_stats("Merging trees:", "{} and {}", trees[0].size(), trees[1].size());
+            size_t total_size = 0;
+            for (auto& t : trees)
+                total_size += t.size();
+            record_stats("Merging trees:", "{} trees, {} nodes", in_size, total_size);
 
             dlog::prof << "compute edges";
 
+            // an edge (u,v) inside the group is stored twice, as (u,v) by the block of u and as (v,u) by the block of v;
+            // take it from the block that comes first and find u - s - v, merging (s,v) or (u,s)
             std::vector<std::tuple<Index, Index>> edges;
-            std::vector<Edge> discard;
-            for (auto& kv : b->edges)
+            for (int i = 0; i < in_size; ++i)
             {
-                Index u, v;
-                std::tie(u,v) = kv.first;
-                if (bounds[out_pos].contains(v))
+                for (auto& kv : trees_edges[i])
                 {
-                    reeber::map_erase(out_edges, std::make_tuple(v, u));
-                    Index s = std::get<1>(kv.second);
-                    if (bounds[out_pos].contains(s)) edges.push_back(std::make_tuple(u, s));
-                    else edges.push_back(std::make_tuple(s,v));
-                    discard.push_back(kv.first);
+                    Index u, v;
+                    std::tie(u,v) = kv.first;
+
+                    int j = 0;
+                    while (j < in_size && !bounds[j].contains(v))
+                        ++j;
+
+                    if (j == in_size)               // still goes outside of the group
+                        b->edges.append(kv);
+                    else if (i < j)
+                    {
+                        Index s = std::get<1>(kv.second);
+                        if (bounds[i].contains(s)) edges.push_back(std::make_tuple(s, v));
+                        else edges.push_back(std::make_tuple(u, s));
+                    }
                 }
+                EdgeMap().swap(trees_edges[i]);
             }
-            for (Edge e : discard) reeber::map_erase(b->edges, e);
-            b->edges.insert(out_edges.begin(), out_edges.end());
+            b->edges.normalize([b](const EdgeMap::ValueVertex& x, const EdgeMap::ValueVertex& y) { return b->mt.cmp(x, y); });
 
             dlog::prof >> "compute edges";
 
+            // merge in link order, so that for a shared vertex the first tree's node wins, as with two trees;
+            // merge keeps the largest vertex map in place and moves the nodes of the others into it
             trees[0].swap(b->mt);
-            r::merge(b->mt, trees[1], edges);
+            r::merge(b->mt, trees, edges);
 
             trees.clear();
             LOG_SEV(debug) << "  trees merged: " << b->mt.size();
@@ -286,6 +326,7 @@ int main(int argc, char** argv)
     std::string prefix     = "./DIY.XXXXXX";
     int         in_memory  = -1;
     int         jobs       = 1;
+    int         k          = REEBER_MERGE_K;
 
     std::string profile_path;
     std::string log_level = "info";
@@ -296,6 +337,7 @@ int main(int argc, char** argv)
         >> Option('b', "blocks",    nblocks,      "number of blocks to use")
         >> Option('m', "memory",    in_memory,    "maximum blocks to store in memory")
         >> Option('j', "jobs",      jobs,         "threads to use during the computation")
+        >> Option('k', "k-way",     k,            "number of blocks merged per round of the reduction")
         >> Option('s', "storage",   prefix,       "storage prefix")
         >> Option('p', "profile",   profile_path, "path to keep the execution profile")
         >> Option('l', "log",       log_level,    "log level")
@@ -427,7 +469,6 @@ int main(int argc, char** argv)
     timer.restart();
 
     // perform the global swap-reduce
-    int k = 2;
     diy::RegularSwapPartners  partners(decomposer, k, true);
     diy::reduce(master, assigner, partners, MergeSparsify(wrap_));
 
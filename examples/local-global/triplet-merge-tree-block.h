@@ -9,6 +9,7 @@
 #include <reeber/box.h>
 #include <reeber/triplet-merge-tree-serialization.h>
 #include <reeber/edges.h>
+#include <reeber/edges-serialization.h>
 namespace r = reeber;
 
 #include "reeber-real.h"
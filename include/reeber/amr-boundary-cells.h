@@ -0,0 +1,135 @@
+#ifndef REEBER_AMR_BOUNDARY_CELLS_H
+#define REEBER_AMR_BOUNDARY_CELLS_H
+
+#include <cstdint>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include <diy/serialization.hpp>
+
+#include "amr-edge-codec.h"
+
+namespace reeber {
+
+    // Sparse face of a block: its active cells with edges to one neighbor, as (vertex index, value) pairs.
+    // A block sends it to the neighbor instead of its edges to the neighbor: edges between two blocks
+    // are found on both sides, so the neighbor keeps exactly the edges that end in one of these cells.
+    // Cells are sorted by vertex index; indices are written as varint deltas (as in AmrEdgeCodec),
+    // values follow in diy serialization, nothing is written for an empty Value (NoValue).
+    struct NoValue {};
+
+    template<class Value = NoValue>
+    class AmrBoundaryCells
+    {
+    public:
+        using Vertex = std::uint64_t;
+        using Byte = AmrEdgeCodec::Byte;
+        using Bytes = AmrEdgeCodec::Bytes;
+
+        // any order, duplicates allowed; call sort() before the lookups and save()
+        void add(Vertex v, const Value& value = Value())
+        {
+            vertices_.push_back(v);
+            values_.push_back(value);
+        }
+
+        // sort by vertex and drop duplicates (the first value of a vertex is kept)
+        void sort()
+        {
+            std::vector<size_t> order(vertices_.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return vertices_[a] < vertices_[b]; });
+
+            std::vector<Vertex> vertices;
+            std::vector<Value> values;
+            vertices.reserve(order.size());
+            values.reserve(order.size());
+            for(size_t i : order)
+            {
+                if (not vertices.empty() and vertices.back() == vertices_[i])
+                    continue;
+                vertices.push_back(vertices_[i]);
+                values.push_back(values_[i]);
+            }
+            vertices_.swap(vertices);
+            values_.swap(values);
+        }
+
+        size_t size() const { return vertices_.size(); }
+        bool empty() const { return vertices_.empty(); }
+
+        bool contains(Vertex v) const { return std::binary_search(vertices_.begin(), vertices_.end(), v); }
+
+        const Value& value(Vertex v) const
+        {
+            auto iter = std::lower_bound(vertices_.begin(), vertices_.end(), v);
+            if (iter == vertices_.end() or *iter != v)
+                throw std::out_of_range("AmrBoundaryCells: no such vertex");
+            return values_[iter - vertices_.begin()];
+        }
+
+        // save into bb (byte count, index bytes, values), return the number of bytes written
+        size_t save(diy::BinaryBuffer& bb) const
+        {
+            Bytes bytes;
+            bytes.reserve(8 + 2 * vertices_.size());
+            AmrEdgeCodec::put(bytes, vertices_.size());
+            Vertex prev = 0;
+            for(Vertex v : vertices_)
+            {
+                AmrEdgeCodec::put(bytes, v - prev);
+                prev = v;
+            }
+
+            diy::save(bb, bytes.size());
+            diy::save(bb, bytes.data(), bytes.size());
+            size_t n_bytes = sizeof(size_t) + bytes.size();
+
+            if (not std::is_empty<Value>::value)
+            {
+                diy::save(bb, values_);
+                n_bytes += sizeof(size_t) + values_.size() * sizeof(Value);
+            }
+
+            return n_bytes;
+        }
+
+        void load(diy::BinaryBuffer& bb)
+        {
+            size_t n_bytes;
+            diy::load(bb, n_bytes);
+            Bytes bytes(n_bytes);
+            diy::load(bb, bytes.data(), n_bytes);
+
+            const Byte* in = bytes.data();
+            const Byte* end = in + n_bytes;
+
+            std::uint64_t n = AmrEdgeCodec::get(in, end);
+            vertices_.resize(n);
+            Vertex v = 0;
+            for(std::uint64_t i = 0; i < n; ++i)
+            {
+                v += AmrEdgeCodec::get(in, end);
+                vertices_[i] = v;
+            }
+
+            if (in != end)
+                throw std::runtime_error("AmrBoundaryCells: trailing bytes");
+
+            if (not std::is_empty<Value>::value)
+                diy::load(bb, values_);
+            else
+                values_.assign(n, Value());
+        }
+
+    private:
+        std::vector<Vertex> vertices_;
+        std::vector<Value> values_;
+    };
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef REEBER_AMR_EDGE_CODEC_H
+#define REEBER_AMR_EDGE_CODEC_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <diy/serialization.hpp>
+
+#include "amr-vertex.h"
+
+namespace reeber {
+
+    // Compact encoding of AmrEdgeContainer for the AMR exchanges.
+    // Edges are grouped by (gid_u, gid_v); the groups appear in the order of their first edge,
+    // and within a group the order of the container is kept, so the decoded container
+    // is a stable partition of the original one (the same container, if it had one pair of gids).
+    // A group is written as
+    //      gid_u, gid_v, n_edges, then n_edges pairs (vertex_u - prev_u, vertex_v - prev_v),
+    // prev_u and prev_v start at 0 in every group;
+    // all numbers are varints (7 bits per byte), signed ones zigzag-encoded.
+    // Edges of one face share the gids and have near-consecutive vertex indices,
+    // so most edges take 2-4 bytes instead of sizeof(AmrEdge).
+    class AmrEdgeCodec
+    {
+    public:
+        using Byte = unsigned char;
+        using Bytes = std::vector<Byte>;
+
+        static void encode(const AmrEdgeContainer& edges, Bytes& out)
+        {
+            // order of edges, grouped by gids
+            std::vector<size_t> order(edges.size());
+            std::vector<size_t> group_of(edges.size());
+            std::vector<std::pair<int, int>> group_gids;
+            {
+                // (gids, group), sorted by gids; a block has few neighbors, so this stays small
+                std::vector<std::pair<std::pair<int, int>, size_t>> gids_to_group;
+                for(size_t i = 0; i < edges.size(); ++i)
+                {
+                    std::pair<int, int> gids { std::get<0>(edges[i]).gid, std::get<1>(edges[i]).gid };
+
+                    // consecutive edges usually share the gids
+                    if (i > 0 and gids == group_gids[group_of[i - 1]])
+                    {
+                        group_of[i] = group_of[i - 1];
+                        continue;
+                    }
+
+                    auto iter = std::lower_bound(gids_to_group.begin(), gids_to_group.end(),
+                            std::make_pair(gids, size_t(0)));
+                    if (iter == gids_to_group.end() or iter->first != gids)
+                    {
+                        iter = gids_to_group.emplace(iter, gids, group_gids.size());
+                        group_gids.push_back(gids);
+                    }
+                    group_of[i] = iter->second;
+                }
+            }
+
+            std::vector<size_t> group_size(group_gids.size(), 0);
+            for(size_t g : group_of)
+                group_size[g]++;
+
+            std::vector<size_t> group_start(group_gids.size() + 1, 0);
+            for(size_t g = 0; g < group_gids.size(); ++g)
+                group_start[g + 1] = group_start[g] + group_size[g];
+
+            {
+                std::vector<size_t> pos(group_start.begin(), group_start.end() - 1);
+                for(size_t i = 0; i < edges.size(); ++i)
+                    order[pos[group_of[i]]++] = i;
+            }
+
+            out.clear();
+            out.reserve(8 + 4 * edges.size());
+
+            put(out, group_gids.size());
+            for(size_t g = 0; g < group_gids.size(); ++g)
+            {
+                put(out, zigzag(group_gids[g].first));
+                put(out, zigzag(group_gids[g].second));
+                put(out, group_size[g]);
+
+                std::uint64_t prev_u = 0, prev_v = 0;
+                for(size_t k = group_start[g]; k < group_start[g + 1]; ++k)
+                {
+                    const AmrEdge& e = edges[order[k]];
+                    std::uint64_t u = std::get<0>(e).vertex, v = std::get<1>(e).vertex;
+                    put(out, zigzag(static_cast<std::int64_t>(u - prev_u)));
+                    put(out, zigzag(static_cast<std::int64_t>(v - prev_v)));
+                    prev_u = u;
+                    prev_v = v;
+                }
+            }
+        }
+
+        static void decode(const Byte* in, size_t n_bytes, AmrEdgeContainer& edges)
+        {
+            const Byte* end = in + n_bytes;
+
+            edges.clear();
+
+            std::uint64_t n_groups = get(in, end);
+            for(std::uint64_t g = 0; g < n_groups; ++g)
+            {
+                int gid_u = static_cast<int>(unzigzag(get(in, end)));
+                int gid_v = static_cast<int>(unzigzag(get(in, end)));
+                std::uint64_t n_edges = get(in, end);
+
+                std::uint64_t u = 0, v = 0;
+                for(std::uint64_t k = 0; k < n_edges; ++k)
+                {
+                    u += static_cast<std::uint64_t>(unzigzag(get(in, end)));
+                    v += static_cast<std::uint64_t>(unzigzag(get(in, end)));
+                    edges.emplace_back(AmrVertexId(gid_u, u), AmrVertexId(gid_v, v));
+                }
+            }
+
+            if (in != end)
+                throw std::runtime_error("AmrEdgeCodec: trailing bytes");
+        }
+
+        // bytes the plain diy serialization of the container would take
+        static size_t raw_size(const AmrEdgeContainer& edges)
+        {
+            return sizeof(size_t) + edges.size() * sizeof(AmrEdge);
+        }
+
+        // save encoded edges into bb (byte count, then bytes), return the number of bytes written
+        static size_t save(diy::BinaryBuffer& bb, const AmrEdgeContainer& edges)
+        {
+            Bytes bytes;
+            encode(edges, bytes);
+            diy::save(bb, bytes.size());
+            if (not bytes.empty())
+                diy::save(bb, bytes.data(), bytes.size());
+            return sizeof(size_t) + bytes.size();
+        }
+
+        static void load(diy::BinaryBuffer& bb, AmrEdgeContainer& edges)
+        {
+            size_t n_bytes;
+            diy::load(bb, n_bytes);
+            Bytes bytes(n_bytes);
+            if (n_bytes)
+                diy::load(bb, bytes.data(), n_bytes);
+            decode(bytes.data(), n_bytes, edges);
+        }
+
+        // varints, shared with AmrBoundaryCells
+        static std::uint64_t zigzag(std::int64_t x)
+        {
+            return (static_cast<std::uint64_t>(x) << 1) ^ static_cast<std::uint64_t>(x >> 63);
+        }
+
+        static std::int64_t unzigzag(std::uint64_t x)
+        {
+            return static_cast<std::int64_t>(x >> 1) ^ -static_cast<std::int64_t>(x & 1);
+        }
+
+        static void put(Bytes& out, std::uint64_t x)
+        {
+            while(x >= 0x80)
+            {
+                out.push_back(static_cast<Byte>(x | 0x80));
+                x >>= 7;
+            }
+            out.push_back(static_cast<Byte>(x));
+        }
+
+        static std::uint64_t get(const Byte*& in, const Byte* end)
+        {
+            std::uint64_t x = 0;
+            for(unsigned shift = 0; shift < 64; shift += 7)
+            {
+                if (in == end)
+                    throw std::runtime_error("AmrEdgeCodec: truncated input");
+                Byte b = *in++;
+                x |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+                if (b < 0x80)
+                    return x;
+            }
+            throw std::runtime_error("AmrEdgeCodec: bad varint");
+        }
+    };
+
+}
+
+#endif
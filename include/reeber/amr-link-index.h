@@ -0,0 +1,168 @@
+#ifndef REEBER_AMR_LINK_INDEX_H
+#define REEBER_AMR_LINK_INDEX_H
+
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+
+#include "diy/point.hpp"
+#include "diy/grid.hpp"
+#include "diy/vertices.hpp"
+#include "diy/link.hpp"
+
+#include "reeber/amr_helper.h"
+
+namespace reeber {
+
+    // Lookup structure over the neighbor boxes of an AMRLink, built once per block.
+    // Keeps the geometry of every link entry as LinkBox<D> and answers two questions without scanning the whole link:
+    //      link_index(gid): position of (the first entry of) gid in the link;
+    //      owner(p_mask, is_ghost): position in the link of the block that masks the mask cell p_mask,
+    //          same answer as the three neighbor_contains loops in set_mask: blocks one level above have priority,
+    //          then (for ghost cells only) blocks on the same level, then one level below;
+    //          among the blocks of one level the first one in the link wins.
+    // Owners are resolved by rasterizing every neighbor core, converted to the refinement of the block,
+    // into a table over the mask, so the cost is proportional to the mask size plus the overlaps,
+    // not to the number of cells times the number of neighbors.
+    template<unsigned D>
+    class AmrLinkIndex
+    {
+    public:
+        using Position = diy::Point<int, D>;
+
+        // gid lookups only
+        AmrLinkIndex(diy::AMRLink* l) :
+                link_(l)
+        {
+            index_link();
+        }
+
+        // gid and owner lookups for the mask [mask_from, mask_from + mask_shape) of a block on level level
+        AmrLinkIndex(diy::AMRLink* l,
+                     int level,
+                     int refinement,
+                     const Position& mask_from,
+                     const Position& mask_shape,
+                     const diy::DiscreteBounds& domain,
+                     bool c_order) :
+                link_(l),
+                mask_(nullptr, mask_shape, c_order),
+                owner_(mask_.size(), -1),
+                level_(level)
+        {
+            index_link();
+
+            Position period = domain_period<D>(domain, refinement);
+
+            // paint lowest priority first, so that blocks above and earlier link entries overwrite the rest
+            for(int level_shift : { -1, 0, 1 })
+                for(int i = l->size() - 1; i >= 0; --i)
+                    if (boxes_[i].level == level + level_shift)
+                        paint(boxes_[i], refinement, mask_from, period);
+        }
+
+        const LinkBox<D>& box(int link_idx) const { return boxes_[link_idx]; }
+
+        int link_index(int gid) const
+        {
+            auto iter = gid_to_link_idx_.find(gid);
+            return iter == gid_to_link_idx_.end() ? -1 : iter->second;
+        }
+
+        // returns -1, if the cell is not masked by any neighbor
+        int owner(const Position& p_mask, bool is_ghost) const
+        {
+            int result = owner_[mask_.index(p_mask)];
+            // real cells can only be masked by blocks above
+            if (result >= 0 and not is_ghost and boxes_[result].level != level_ + 1)
+                return -1;
+            return result;
+        }
+
+    private:
+        void index_link()
+        {
+            boxes_.reserve(link_->size());
+            for(int i = 0; i < link_->size(); ++i)
+            {
+                boxes_.emplace_back(link_, i);
+                gid_to_link_idx_.emplace(boxes_.back().gid, i);
+            }
+        }
+
+        // mark all mask cells whose wrapped global position is contained
+        // in the core of the neighbor nb (in the sense of neighbor_contains)
+        void paint(const LinkBox<D>& nb, int refinement, const Position& mask_from, const Position& period)
+        {
+            const Position& from = nb.core_from;
+            const Position& to = nb.core_to;
+            int nb_refinement = nb.refinement;
+            int link_idx = nb.link_idx;
+
+            // neighbor core in the coordinates of our level
+            Position lo, hi;
+            for(unsigned i = 0; i < D; ++i)
+            {
+                if (refinement < nb_refinement)
+                {
+                    // only the lower corner of the refined cell is checked, cf. neighbor_contains
+                    int scale = nb_refinement / refinement;
+                    lo[i] = ceil_div(from[i], scale);
+                    hi[i] = floor_div(to[i], scale);
+                } else if (refinement > nb_refinement)
+                {
+                    int scale = refinement / nb_refinement;
+                    lo[i] = scale * from[i];
+                    hi[i] = scale * (to[i] + 1) - 1;
+                } else
+                {
+                    lo[i] = from[i];
+                    hi[i] = to[i];
+                }
+                // wrap_point maps everything into [0, period)
+                lo[i] = std::max(lo[i], 0);
+                hi[i] = std::min(hi[i], period[i] - 1);
+                if (lo[i] > hi[i])
+                    return;
+            }
+
+            Position mask_to = mask_from + mask_.shape() - Position::one();
+
+            // preimages of the box under wrap_point: shifted by -period, 0 or +period in every direction
+            int n_shifts = 1;
+            for(unsigned i = 0; i < D; ++i)
+                n_shifts *= 3;
+
+            for(int shift_code = 0; shift_code < n_shifts; ++shift_code)
+            {
+                Position box_from, box_to;
+                bool is_empty = false;
+                for(unsigned i = 0, code = shift_code; i < D; ++i, code /= 3)
+                {
+                    int shift = (static_cast<int>(code % 3) - 1) * period[i];
+                    box_from[i] = std::max(lo[i] + shift, mask_from[i]) - mask_from[i];
+                    box_to[i] = std::min(hi[i] + shift, mask_to[i]) - mask_from[i];
+                    if (box_from[i] > box_to[i])
+                        is_empty = true;
+                }
+
+                if (is_empty)
+                    continue;
+
+                diy::for_each(box_to - box_from + Position::one(), [this, link_idx, &box_from](const Position& p) {
+                    this->owner_[this->mask_.index(p + box_from)] = link_idx;
+                });
+            }
+        }
+
+        diy::AMRLink* link_;
+        std::vector<LinkBox<D>> boxes_;
+        std::unordered_map<int, int> gid_to_link_idx_;
+        diy::GridRef<void*, D> mask_ { nullptr, Position::zero() };
+        std::vector<int> owner_;
+        int level_ { 0 };
+    };
+
+}
+
+#endif
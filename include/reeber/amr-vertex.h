@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stdexcept>
+#include <cstdint>
 #include <boost/functional/hash.hpp>
 
 #include <unordered_map>
@@ -10,14 +11,68 @@
 #include <diy/point.hpp>
 #include <diy/serialization.hpp>
 
+#ifdef REEBER_PACKED_AMR_VERTEX_ID
+#ifndef REEBER_AMR_GID_BITS
+#define REEBER_AMR_GID_BITS 24
+#endif
+#endif
+
 namespace reeber {
 
+    // With REEBER_PACKED_AMR_VERTEX_ID, gid and vertex are bit fields of a single 64-bit word:
+    // REEBER_AMR_GID_BITS bits of (signed) gid and the remaining bits of local vertex index.
+    // The members keep their names, so the code that reads and assigns them does not change,
+    // but they cannot be bound to non-const references.
+    // Ordering and hashing work on key(), which orders by (vertex, gid), as the unpacked version does.
+    // A default-constructed id has gid -1 and vertex no_vertex() in both modes;
+    // valid local indices are at most max_vertex().
     struct AmrVertexId {
+#ifdef REEBER_PACKED_AMR_VERTEX_ID
+        static constexpr unsigned gid_bits = REEBER_AMR_GID_BITS;
+        static constexpr unsigned vertex_bits = 64 - gid_bits;
+
+        static_assert(gid_bits > 1 and gid_bits <= 32, "REEBER_AMR_GID_BITS must be in [2, 32]");
+
+        int gid : gid_bits;
+        std::uint64_t vertex : vertex_bits;
+
+        static constexpr std::uint64_t no_vertex()      { return (std::uint64_t(1) << vertex_bits) - 1; }
+
+        AmrVertexId() :
+                gid(-1), vertex(no_vertex())
+        {}
+
+        AmrVertexId(int _gid, size_t _vertex) :
+                gid(_gid), vertex(_vertex)
+        {
+            assert(gid == _gid and vertex == _vertex);
+        }
+
+        // vertex in the high bits, gid with flipped sign bit (negative gids first) in the low bits
+        std::uint64_t key() const
+        {
+            std::uint64_t gid_mask = (std::uint64_t(1) << gid_bits) - 1;
+            std::uint64_t sign_bit = std::uint64_t(1) << (gid_bits - 1);
+            return (static_cast<std::uint64_t>(vertex) << gid_bits) | ((static_cast<std::uint64_t>(gid) & gid_mask) ^ sign_bit);
+        }
+
+        bool operator==(const AmrVertexId& other) const
+        {
+            return key() == other.key();
+        }
+
+        bool operator<(const AmrVertexId& other) const
+        {
+            return key() < other.key();
+        }
+#else
         int gid;
         size_t vertex;
 
+        static constexpr size_t no_vertex()             { return static_cast<size_t>(-1); }
+
         AmrVertexId() :
-                gid(-1), vertex(-1)
+                gid(-1), vertex(no_vertex())
         {}
 
         AmrVertexId(int _gid, size_t _vertex) :
@@ -31,14 +86,17 @@ namespace reeber {
             return std::tie(gid, vertex) == std::tie(other.gid, other.vertex);
         }
 
-        bool operator!=(const AmrVertexId& other) const
+        bool operator<(const AmrVertexId& other) const
         {
-            return !(*this == other);
+            return std::tie(vertex, gid) < std::tie(other.vertex, other.gid);
         }
+#endif
 
-        bool operator<(const AmrVertexId& other) const
+        static constexpr size_t max_vertex()            { return no_vertex() - 1; }
+
+        bool operator!=(const AmrVertexId& other) const
         {
-            return std::tie(vertex, gid) < std::tie(other.vertex, other.gid);
+            return !(*this == other);
         }
 
         bool operator>(const AmrVertexId& other) const
@@ -70,6 +128,10 @@ namespace reeber {
         }
     };
 
+#ifdef REEBER_PACKED_AMR_VERTEX_ID
+    static_assert(sizeof(AmrVertexId) == sizeof(std::uint64_t), "packed AmrVertexId must fit into 64 bits");
+#endif
+
     using AmrEdge = std::tuple<AmrVertexId, AmrVertexId>;
 
     inline AmrEdge reverse_amr_edge(const AmrEdge& e)
@@ -84,6 +146,26 @@ namespace reeber {
 
 namespace std {
 
+#ifdef REEBER_PACKED_AMR_VERTEX_ID
+    // multiplicative hash of the key, the high bits folded into the low ones for power-of-two tables
+    template<>
+    struct hash<reeber::AmrVertexId> {
+        std::size_t operator()(const reeber::AmrVertexId& id) const noexcept
+        {
+            std::uint64_t h = id.key() * 0x9E3779B97F4A7C15ull;
+            return h ^ (h >> 32);
+        }
+    };
+
+    template<>
+    struct hash<reeber::AmrEdge> {
+        std::size_t operator()(const reeber::AmrEdge& e) const
+        {
+            std::uint64_t h = (std::get<0>(e).key() * 0x9E3779B97F4A7C15ull) ^ (std::get<1>(e).key() * 0xC2B2AE3D27D4EB4Full);
+            return h ^ (h >> 32);
+        }
+    };
+#else
     template<>
     struct hash<reeber::AmrVertexId> {
         std::size_t operator()(const reeber::AmrVertexId& id) const noexcept
@@ -111,6 +193,8 @@ namespace std {
         }
     };
 
+#endif
+
     inline std::ostream& operator<<(std::ostream& os, const reeber::AmrEdge& e)
     {
         os << "(" << std::get<0>(e) << " <-> " << std::get<1>(e) << ")";
@@ -60,6 +60,60 @@ diy::Point<int, D> point_from_dynamic_point(const diy::DynamicPoint<int, DD>& pt
     return result;
 }
 
+// floor(a / b) and ceil(a / b) for b > 0, integer arithmetic only
+inline int floor_div(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+inline int ceil_div(int a, int b) { return -floor_div(-a, b); }
+
+// ratio between the refinements of two levels;
+// coarsening rounds down (also for negative, i.e. wrapped, coordinates) and is a shift,
+// if the ratio is a power of two (the usual case in AMR)
+class RefinementRatio
+{
+public:
+    explicit RefinementRatio(int ratio = 1) :
+            ratio_(ratio)
+    {
+        //assert(ratio >= 1);
+        for(int s = 0; (1 << s) <= ratio; ++s)
+            if ((1 << s) == ratio)
+                shift_ = s;
+    }
+
+    // ratio between point_refinement and target_refinement, point_refinement must be a multiple of target_refinement
+    RefinementRatio(int point_refinement, int target_refinement) :
+            RefinementRatio(point_refinement / target_refinement)
+    {
+    }
+
+    int ratio() const { return ratio_; }
+
+    bool is_power_of_two() const { return shift_ >= 0; }
+
+    int coarsen(int x) const { return shift_ >= 0 ? x >> shift_ : floor_div(x, ratio_); }
+
+    int refine(int x) const { return x * ratio_; }
+
+    template<class C, unsigned D>
+    diy::Point<C, D> coarsen(const diy::Point<C, D>& p) const
+    {
+        diy::Point<C, D> result;
+        for(unsigned i = 0; i < D; ++i)
+            result[i] = coarsen(p[i]);
+        return result;
+    }
+
+    template<class C, unsigned D>
+    diy::Point<C, D> refine(const diy::Point<C, D>& p) const
+    {
+        return ratio_ * p;
+    }
+
+private:
+    int ratio_ { 1 };
+    int shift_ { -1 };
+};
+
 // take point p from level with get_refinement = point_refinement
 // return coarsened point for get_refinement = target_refinement
 template<class C, unsigned int D>
@@ -72,6 +126,13 @@ inline diy::Point<C, D> coarsen_point(const diy::Point<C, D>& p, int point_refin
 
     //assert(point_refinement >= target_refinement and point_refinement % target_refinement == 0);
 
+    if (point_refinement % target_refinement == 0)
+        return RefinementRatio(point_refinement, target_refinement).coarsen(p);
+
+    if (target_refinement % point_refinement == 0)
+        return (target_refinement / point_refinement) * p;
+
+    // refinements are not nested
     double factor = (double) target_refinement / (double) point_refinement;
     diy::Point<C, D> result;
     for(unsigned int i = 0; i < D; ++i)
@@ -81,6 +142,27 @@ inline diy::Point<C, D> coarsen_point(const diy::Point<C, D>& p, int point_refin
     return result;
 }
 
+// shape of the domain (not refined; domain is assumed to start from origin) on the level with get_refinement ref
+template<unsigned D>
+inline diy::Point<int, D> domain_period(const diy::DiscreteBounds& domain, int ref)
+{
+    diy::Point<int, D> result;
+    for(unsigned i = 0; i < D; ++i)
+        result[i] = ref * (domain.max[i] + 1);
+    return result;
+}
+
+// take point p and the refined shape of the domain that starts from origin (see domain_period)
+// return true, if p is inside the domain
+template<class C, unsigned int D>
+inline bool point_in_domain(const diy::Point<C, D>& p, const diy::Point<int, D>& period)
+{
+    for(unsigned i = 0; i < D; ++i)
+        if (p[i] < 0 or p[i] >= period[i])
+            return false;
+    return true;
+}
+
 // take point p from level with get_refinement ref and domain (not refined; domains is assumed to start from origin)
 // return wrapped point
 template<class C, unsigned int D>
@@ -93,32 +175,37 @@ inline bool point_in_domain(const diy::Point<C, D>& p, const diy::DiscreteBounds
 }
 
 
-// take point p from level with get_refinement ref and domain (not refined; domains is assumed to start from origin)
+// take point p and the refined shape of the domain (see domain_period)
 // return wrapped point
 template<class C, unsigned int D>
-inline diy::Point<C, D>
-wrap_point(const diy::Point<C, D>& p, const diy::DiscreteBounds& domain, int ref, bool is_debug = false)
+inline diy::Point<C, D> wrap_point(const diy::Point<C, D>& p, const diy::Point<int, D>& period)
 {
-    // we assume that domain starts from the origin
-    //assert(domain.min == decltype(domain.min)::zero());
-
-    using Point = diy::Point<C, D>;
-
-    Point result = p;
+    diy::Point<C, D> result = p;
     for(unsigned i = 0; i < D; ++i)
     {
-        int d = ref * (domain.max[i] + 1);
         if (p[i] < 0)
         {
-            result[i] += d;
-        } else if (p[i] >= d)
+            result[i] += period[i];
+        } else if (p[i] >= period[i])
         {
-            result[i] -= d;
+            result[i] -= period[i];
         }
     }
     return result;
 }
 
+// take point p from level with get_refinement ref and domain (not refined; domains is assumed to start from origin)
+// return wrapped point
+template<class C, unsigned int D>
+inline diy::Point<C, D>
+wrap_point(const diy::Point<C, D>& p, const diy::DiscreteBounds& domain, int ref, bool is_debug = false)
+{
+    // we assume that domain starts from the origin
+    //assert(domain.min == decltype(domain.min)::zero());
+
+    return wrap_point(p, domain_period<D>(domain, ref));
+}
+
 // return the first D coordinates of p
 template<unsigned int D, class C>
 inline diy::Point<C, D> project_point(const typename diy::Point<C, DIY_MAX_DIM>& p)
@@ -139,22 +226,50 @@ inline diy::DynamicPoint<C, D> project_point(const typename diy::DynamicPoint<C,
     return result;
 }
 
+// geometry of the link_idx-th entry of an AMRLink in D dimensions;
+// converted from dynamic points once, so that per-vertex code does not touch the link
+template<unsigned D>
+struct LinkBox
+{
+    using Position = diy::Point<int, D>;
+
+    LinkBox() {}
+
+    LinkBox(diy::AMRLink* l, int _link_idx) :
+            link_idx(_link_idx),
+            gid(l->target(_link_idx).gid),
+            level(l->level(_link_idx)),
+            // TODO: vector refinement
+            refinement(l->refinement(_link_idx)[0]),
+            core_from(point_from_dynamic_point<D>(l->core(_link_idx).min)),
+            core_to(point_from_dynamic_point<D>(l->core(_link_idx).max)),
+            bounds_from(point_from_dynamic_point<D>(l->bounds(_link_idx).min)),
+            bounds_to(point_from_dynamic_point<D>(l->bounds(_link_idx).max))
+    {
+    }
+
+    int link_idx { -1 };
+    int gid { -1 };
+    int level { 0 };
+    int refinement { 1 };
+    Position core_from, core_to;
+    Position bounds_from, bounds_to;
+};
+
 // v: point in global coordinates from some level
 // v_refinement: refinement of the level of v
-// link_idx: index of a block in which v must be contained
-// l: AMR link
-// return index of v in the box with index link_idx
+// box: geometry of a block in which v must be contained
+// return index of v in the box
 // v must correspond to unique vertex in the box!
 // (i.e., the box cannot be a neigbour from above!)
 template<unsigned D>
-size_t get_vertex_id(const diy::Point<int, D>& v, int v_refinement, int link_idx, diy::AMRLink* l, bool c_order)
+size_t get_vertex_id(const diy::Point<int, D>& v, int v_refinement, const LinkBox<D>& box, bool c_order)
 {
     using Position = diy::Point<int, D>;
 
-    Position from = point_from_dynamic_point<D>(l->bounds(link_idx).min);
-    Position to = point_from_dynamic_point<D>(l->bounds(link_idx).max);
-    // TODO: vector refinement
-    int refinement = l->refinement(link_idx)[0];
+    const Position& from = box.bounds_from;
+    const Position& to = box.bounds_to;
+    int refinement = box.refinement;
 
     bool debug = false;
 
@@ -181,7 +296,7 @@ size_t get_vertex_id(const diy::Point<int, D>& v, int v_refinement, int link_idx
     if (not(0 <= grid.index(vv) and grid.index(vv) < grid.size()))
     {
         fmt::print("Error here, v = {}, v_refinement = {}, link_idx = {}, from = {}, to = {}, vv = {}, result = {}\n",
-                v, v_refinement, link_idx, from, to, vv, grid.index(vv));
+                v, v_refinement, box.link_idx, from, to, vv, grid.index(vv));
         throw std::runtime_error("bad index");
     }
     //assert(0 <= grid.index(vv) and grid.index(vv) < grid.size());
@@ -189,23 +304,37 @@ size_t get_vertex_id(const diy::Point<int, D>& v, int v_refinement, int link_idx
     return grid.index(vv);
 }
 
+// same, box is the link_idx-th entry of the AMR link l
+template<unsigned D>
+size_t get_vertex_id(const diy::Point<int, D>& v, int v_refinement, int link_idx, diy::AMRLink* l, bool c_order)
+{
+    return get_vertex_id(v, v_refinement, LinkBox<D>(l, link_idx), c_order);
+}
+
 // return (in global coordinates on the high level)
-// bounding vertices of a box that corresponds to v from lower level
+// bounding vertices of a box that corresponds to v from lower level,
+// ratio: refinement of the high level / refinement of v
 template<unsigned D>
 std::tuple<diy::Point<int, D>, diy::Point<int, D>>
-refine_vertex(const diy::Point<int, D>& v, int v_refinement, int target_refinement)
+refine_vertex(const diy::Point<int, D>& v, const RefinementRatio& ratio)
 {
     using Position = diy::Point<int, D>;
 
-    //assert(v_refinement <= target_refinement);
-    //assert(target_refinement % v_refinement == 0);
+    Position from = ratio.refine(v);
+    Position to = from + (ratio.ratio() - 1) * Position::one();
 
-    int ratio = target_refinement / v_refinement;
+    return std::tie(from, to);
+}
 
-    Position from = ratio * v;
-    Position to = from + (ratio - 1) * Position::one();
+// same, ratio is computed from the refinements of the two levels
+template<unsigned D>
+std::tuple<diy::Point<int, D>, diy::Point<int, D>>
+refine_vertex(const diy::Point<int, D>& v, int v_refinement, int target_refinement)
+{
+    //assert(v_refinement <= target_refinement);
+    //assert(target_refinement % v_refinement == 0);
 
-    return std::tie(from, to);
+    return refine_vertex(v, RefinementRatio(target_refinement, v_refinement));
 }
 
 /**
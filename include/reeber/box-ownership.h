@@ -0,0 +1,122 @@
+#ifndef REEBER_BOX_OWNERSHIP_H
+#define REEBER_BOX_OWNERSHIP_H
+
+#include <vector>
+
+#include "box.h"
+
+namespace reeber
+{
+
+// Gid generator for a block of a regular decomposition: answers "who owns vertex v" without
+// going through the decomposer for the vertices the block actually asks about.
+//      core: the vertices owned by the block -- is_local() is a plain box test;
+//      halo: core extended by one layer of the neighbors' vertices; the owner of a halo vertex
+//            is looked up in a table with one entry per face/edge/corner direction (3^D entries),
+//            filled once from the fallback;
+// the fallback (Position -> gid) is called only for vertices outside of the halo.
+// The distributed templates (distributed-tmt.h) detect is_local() and use it instead of comparing gids.
+template<unsigned D, class Fallback>
+class BoxOwnership
+{
+    public:
+        using Box       = reeber::Box<D>;
+        using Position  = typename Box::Position;
+        using Vertex    = typename Box::Vertex;
+
+                    BoxOwnership(const Box& core, const Box& halo, int gid, const Fallback& fallback):
+                        core_(core), halo_(halo), gid_(gid), fallback_(fallback)
+        {
+            int n_directions = 1;
+            for (unsigned i = 0; i < D; ++i)
+                n_directions *= 3;
+            table_.resize(n_directions, -1);
+
+            for (int code = 0; code < n_directions; ++code)
+            {
+                // probe one halo position in the direction
+                Position p;
+                int c = code;
+                for (int i = D - 1; i >= 0; --i, c /= 3)
+                {
+                    switch(c % 3)
+                    {
+                        case 0:     p[i] = core_.from()[i] - 1; break;
+                        case 1:     p[i] = core_.from()[i];     break;
+                        default:    p[i] = core_.to()[i] + 1;   break;
+                    }
+                }
+
+                if (code == center())
+                    table_[code] = gid_;
+                else if (halo_.contains(p))
+                    table_[code] = fallback_(p);
+            }
+        }
+
+        bool        is_local(const Vertex& v) const                     { return core_.contains(v); }
+
+        int         operator()(const Vertex& v) const
+        {
+            Position p = halo_.position(v);
+            int  code    = 0;
+            bool in_halo = true;
+            for (unsigned i = 0; i < D; ++i)
+            {
+                code = 3 * code + (p[i] >= core_.from()[i]) + (p[i] > core_.to()[i]);
+                in_halo &= (p[i] >= halo_.from()[i]) & (p[i] <= halo_.to()[i]);
+            }
+
+            if (in_halo)
+                return table_[code];
+
+            return fallback_(p);
+        }
+
+        int         gid() const                                         { return gid_; }
+        const Box&  core() const                                        { return core_; }
+        const Box&  halo() const                                        { return halo_; }
+
+    private:
+        static int  center()                                            { int c = 0; for (unsigned i = 0; i < D; ++i) c = 3 * c + 1; return c; }
+
+        Box                 core_;
+        Box                 halo_;
+        int                 gid_;
+        Fallback            fallback_;
+        std::vector<int>    table_;
+};
+
+// Topology of a block of a regular decomposition: the halo of BoxOwnership, i.e., the block's core
+// plus one layer of the neighbors' vertices. The vertices of the core are local, so boundary() is the complement
+// of the core, and compute_merge_tree (distributed-tmt.h) asks for the owners of the halo layer only.
+template<unsigned D>
+class HaloBox: public Box<D>
+{
+    public:
+        using Vertex    = typename Box<D>::Vertex;
+
+        static constexpr bool   interior_is_local = true;
+
+                    HaloBox(const Box<D>& core, const Box<D>& halo):
+                        Box<D>(halo), core_(core)                                       {}
+
+        bool        boundary(const Vertex& v) const                                     { return !core_.contains(v); }
+
+        const Box<D>&   core() const                                                    { return core_; }
+
+    private:
+        Box<D>      core_;
+};
+
+template<unsigned D>
+HaloBox<D>
+make_halo_box(const Box<D>& core, const Box<D>& halo)                                   { return HaloBox<D>(core, halo); }
+
+template<unsigned D, class Fallback>
+BoxOwnership<D, Fallback>
+make_box_ownership(const Box<D>& core, const Box<D>& halo, int gid, const Fallback& fallback)   { return BoxOwnership<D, Fallback>(core, halo, gid, fallback); }
+
+}
+
+#endif
@@ -10,6 +10,13 @@
 
 #include "triplet-merge-tree.h"
 #include "edges.h"
+#include "edges-serialization.h"
+
+// default number of blocks merged per round of the swap-reduce in merge_trees;
+// k trees are merged with one combined edge set and one sparsification per round
+#ifndef REEBER_MERGE_K
+#define REEBER_MERGE_K 4
+#endif
 
 namespace reeber
 {
@@ -25,6 +32,38 @@ namespace detail
     template<class Topology, class LocalTest>
     LocalTopology<Topology, LocalTest>
     make_local_topology(const Topology& t, const LocalTest& lt)     { return LocalTopology<Topology, LocalTest>(t, lt); }
+
+    // false, if v is known to be local without asking the gid generator:
+    // a topology that declares interior_is_local = true (e.g., HaloBox, box-ownership.h) promises
+    // that only the vertices on its boundary() can be remote; for all other topologies every vertex may be remote
+    template<class Topology, class Vertex>
+    auto may_be_remote(const Topology& t, const Vertex& v, int) -> decltype(void(Topology::interior_is_local), bool(t.boundary(v)))
+                                                                                                    { return !Topology::interior_is_local || t.boundary(v); }
+
+    template<class Topology, class Vertex>
+    bool may_be_remote(const Topology&, const Vertex&, long)                                        { return true; }
+
+    // true, if v belongs to block gid; a box test, if the gid generator provides is_local(v) (e.g., BoxOwnership)
+    template<class GidGen, class Vertex>
+    auto is_local(const GidGen& g, const Vertex& v, int, int) -> decltype(bool(g.is_local(v)))      { return g.is_local(v); }
+
+    template<class GidGen, class Vertex>
+    bool is_local(const GidGen& g, const Vertex& v, int gid, long)                                  { return g(v) == gid; }
+
+    // gid of the block that owns v, asking the generator at most once
+    template<class GidGen, class Vertex>
+    auto owner(const GidGen& g, const Vertex& v, int gid, int) -> decltype(bool(g.is_local(v)), int())  { return g.is_local(v) ? gid : g(v); }
+
+    template<class GidGen, class Vertex>
+    int owner(const GidGen& g, const Vertex& v, int, long)                                          { return g(v); }
+
+    template<class Vertex, class Value, class Topology, class Function, class GidGen>
+    void compute_local_tree_and_edges(TripletMergeTree<Vertex,Value>&   mt,
+                                      EdgeMaps<Vertex,Value>&           edge_maps,
+                                      const Topology&                   topology,
+                                      const Function&                   f,
+                                      const GidGen&                     gid_gen,
+                                      int                               gid);
 }
 
 template<class Block, class Vertex, class Value>
@@ -89,7 +128,7 @@ void resolve_and_merge(diy::Master&                            master,
     // best we can hope for in absence of other assumptions.
     int nblocks = assigner.nblocks();
     diy::RegularDecomposer<diy::DiscreteBounds>  decomposer(1, diy::interval(0, nblocks - 1), nblocks);
-    resolve_and_merge(master, assigner, tmt_, edge_maps_, gid_generator, diy::RegularSwapPartners(decomposer, 2, true));
+    resolve_and_merge(master, assigner, tmt_, edge_maps_, gid_generator, diy::RegularSwapPartners(decomposer, REEBER_MERGE_K, true));
 }
 
 template<class Block, class Vertex, class Value,
@@ -104,11 +143,10 @@ void compute_merge_tree(diy::Master&                            master,
                         const GidGenerator&                     gid_generator,
                         const Partners&                         partners)
 {
-    // This makes two passes over the topology: first to compute the local
-    // tree; second to figure out outgoing edges. Not super-efficient, but good
-    // enough for now.
-
-    // compute local tree
+    // One pass over the topology computes the local tree and collects the outgoing edges.
+    // Ownership (gid_generator) decides which vertices are local. If the topology declares interior_is_local
+    // (see detail::may_be_remote), ownership is evaluated only on its boundary.
+    // For regular decompositions, the topology can be a HaloBox and the gid generator a BoxOwnership (box-ownership.h).
     master.foreach([&](Block* b, const diy::Master::ProxyWithLink& cp)
     {
         using Topology      = decltype(topology_generator(b));
@@ -123,35 +161,10 @@ void compute_merge_tree(diy::Master&                            master,
 
         int   gid = cp.gid();
         auto& tmt = b->*tmt_;
-        compute_merge_tree2(tmt, detail::make_local_topology(topology, [&](Vertex v) { return gid_gen(v) == gid; }), function);
+        detail::compute_local_tree_and_edges(tmt, b->*edge_maps_, topology, function, gid_gen, gid);
         LOG_SEV(debug) << "[" << b->gid << "] " << "Initial tree size: " << tmt.size();
     });
 
-    // fill edges
-    master.foreach([&](Block* b, const diy::Master::ProxyWithLink& cp)
-    {
-        auto    topology    = topology_generator(b);
-        auto    gid_gen     = gid_generator(b);
-        int     gid         = cp.gid();
-        auto&   edge_maps   = b->*edge_maps_;
-
-        for (auto u : topology.vertices())
-        {
-            if (gid_gen(u) != gid)
-                continue;
-
-            for (auto v : topology.link(u))
-            {
-                int v_gid = gid_gen(v);
-                if (v_gid == gid)      // need non-local neighbors
-                    continue;
-
-                using ValueVertex   = std::tuple<Value, Vertex>;
-                edge_maps[v_gid].emplace(std::make_tuple(u,v), ValueVertex());     // just keep the edges
-            }
-        }
-    });
-
     resolve_and_merge(master, assigner, tmt_, edge_maps_, gid_generator, partners);
 }
 
@@ -170,7 +183,7 @@ void compute_merge_tree(diy::Master&                            master,
     diy::RegularDecomposer<diy::DiscreteBounds>  decomposer(1, diy::interval(0, nblocks - 1), nblocks);
     compute_merge_tree(master, assigner, tmt_, edge_maps_,
                        topology_generator, function_generator, gid_generator,
-                       diy::RegularSwapPartners(decomposer, 2, true));
+                       diy::RegularSwapPartners(decomposer, REEBER_MERGE_K, true));
 }
 
 }
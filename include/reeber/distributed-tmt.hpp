@@ -20,8 +20,69 @@ struct reeber::detail::LocalTopology
     const LocalTest&    local_test;
 };
 
+// Equivalent to compute_merge_tree2 on the local part of the topology, followed by a sweep
+// that records every edge (u,v) with local u and remote v in edge_maps[gid of v].
+// Both happen in the same pass over the links; the owner of a vertex is looked up only if it may be remote
+// (see may_be_remote), at most once per vertex and link neighbor, and not at all for local vertices
+// of generators with is_local().
+template<class Vertex, class Value, class Topology, class Function, class GidGen>
+void
+reeber::detail::
+compute_local_tree_and_edges(TripletMergeTree<Vertex,Value>&   mt,
+                             EdgeMaps<Vertex,Value>&           edge_maps,
+                             const Topology&                   topology,
+                             const Function&                   f,
+                             const GidGen&                     gid_gen,
+                             int                               gid)
+{
+    using Neighbor      = typename TripletMergeTree<Vertex, Value>::Neighbor;
+    using ValueVertex   = std::tuple<Value, Vertex>;
+
+    dlog::prof << "compute-local-tree-and-edges";
+
+    auto owner_gid = [&topology,&gid_gen,gid](const Vertex& v) { return may_be_remote(topology, v, 0) ? owner(gid_gen, v, gid, 0) : gid; };
+
+    vector<Vertex> vertices;
+    for (auto v : topology.vertices())
+        if (owner_gid(v) == gid)
+            vertices.push_back(v);
+
+    for_each(0, vertices.size(), [&](size_t i) { Vertex a = vertices[i]; mt.add(a, f(a)); });
+
+    vector<std::tuple<int, Vertex, Vertex>> outgoing;
+    for_each(0, vertices.size(), [&](size_t i)
+    {
+        Vertex a = vertices[i];
+        Neighbor u = mt[a];
+        for (const Vertex& b : topology.link(a))
+        {
+            int b_gid = owner_gid(b);
+            if (b_gid != gid)
+            {
+                outgoing.push_back(std::make_tuple(b_gid, a, b));           // just keep the edges
+                continue;
+            }
+
+            if (b < a) continue;
+            Neighbor v = mt[b];
+            mt.merge(u, v);
+        }
+    });
+
+    for (auto& x : outgoing)
+        edge_maps[std::get<0>(x)].append(std::make_tuple(std::get<1>(x), std::get<2>(x)), ValueVertex());
+    auto lower = [&mt](const ValueVertex& x, const ValueVertex& y) { return mt.cmp(x,y); };
+    for (auto& kv : edge_maps)
+        kv.second.normalize(lower);
+
+    repair(mt);
+
+    dlog::prof >> "compute-local-tree-and-edges";
+}
+
 // TODO: this needs to use gids as a mechanism to decide what to prune, not boxes
-// NB: this assumes binary reduction
+// Works for any number k of blocks per round (k = srp.in_link().size()): all k trees are merged at once,
+// along one combined set of edges, followed by a single repair and sparsification
 template<class Block, class Vertex, class Value, class Partners, class GidGenerator>
 struct reeber::detail::MergeSparsify
 {
@@ -42,6 +103,7 @@ struct reeber::detail::MergeSparsify
     void    operator()(Block* b, const diy::ReduceProxy& srp, const Partners& partners) const
     {
         using Edge              = Edge<Vertex>;
+        using ValueVertex       = typename EdgeMap::ValueVertex;
 
         LOG_SEV(debug) << "Entered merge_sparsify()";
 
@@ -58,22 +120,21 @@ struct reeber::detail::MergeSparsify
         {
             dlog::prof << "dequeue";
             std::vector<TripletMergeTree>  trees;
+            std::vector<EdgeMap>           trees_edges(in_size);
             for (int i = 0; i < in_size; ++i)
                 trees.emplace_back((b->*tmt).negate());
-            EdgeMap out_edges;
-            int local_pos = -1;
             for (int i = 0; i < in_size; ++i)
             {
               int nbr_gid = srp.in_link().target(i).gid;
               if (nbr_gid == srp.gid())
               {
-                  local_pos = i;
                   trees[i].swap(b->*tmt);
+                  trees_edges[i].swap(edges);
                   LOG_SEV(debug) << "  swapped in tree of size: " << trees[i].size();
               } else
               {
                   srp.dequeue(nbr_gid, trees[i]);
-                  srp.dequeue(nbr_gid, out_edges);
+                  srp.dequeue(nbr_gid, trees_edges[i]);
                   LOG_SEV(debug) << "  received tree of size: " << trees[i].size();
               }
             }
@@ -81,40 +142,64 @@ struct reeber::detail::MergeSparsify
             dlog::prof >> "dequeue";
 
             dlog::prof << "compute edges";
-            std::vector<Edge> merge_edges, discard;
-            auto& mt = trees[local_pos];
-            for (auto& kv : edges)
+            // An edge (u,v) between two of the trees arrives twice: as (u,v) from the tree of u
+            // and as (v,u) from the tree of v. Sorting all the edges by the unordered pair puts the two copies
+            // next to each other; the copy from the later tree turns the pair into a merge edge:
+            // find u - s - v, and determine whether s is in the tree of that copy or not
+            // (i.e., if we are merging (s,v) or (u,s)).
+            // Unpaired edges go out of the merged group.
+            using Copy = std::tuple<Vertex, Vertex, int, size_t>;         // min(u,v), max(u,v), tree, position
+            std::vector<Copy> copies;
+            size_t n_copies = 0;
+            for (int i = 0; i < in_size; ++i)
+                n_copies += trees_edges[i].size();
+            copies.reserve(n_copies);
+            for (int i = 0; i < in_size; ++i)
+                for (size_t k = 0; k < trees_edges[i].size(); ++k)
+                {
+                    Vertex u, v;
+                    std::tie(u,v) = trees_edges[i].data()[k].first;
+                    copies.emplace_back(std::min(u,v), std::max(u,v), i, k);
+                }
+            std::sort(copies.begin(), copies.end());
+
+            std::vector<Edge> merge_edges;
+            for (size_t k = 0; k < copies.size(); ++k)
             {
-                // Determine if (u,v) is an edge to this neighbor; if so, find
-                // u - s - v, and determine whether s is local or remote (i.e.,
-                // if we are mering (u,s) or (s,v))
-
-                auto& uv = kv.first;
-                Vertex u, v;
-                std::tie(u,v) = uv;
-                auto vu = std::make_tuple(v,u);
-                if (out_edges.find(vu) != out_edges.end())
+                int     i   = std::get<2>(copies[k]);
+                auto&   kv  = trees_edges[i].data()[std::get<3>(copies[k])];
+                if (k + 1 < copies.size() && std::get<0>(copies[k]) == std::get<0>(copies[k+1]) && std::get<1>(copies[k]) == std::get<1>(copies[k+1]))
                 {
-                    map_erase(out_edges, vu);
-                    Vertex s = std::get<1>(kv.second);
+                    ++k;
+                    int     j      = std::get<2>(copies[k]);
+                    auto&   kv_j   = trees_edges[j].data()[std::get<3>(copies[k])];
+                    auto&   later  = j > i ? kv_j : kv;
+                    int     t      = std::max(i,j);
 
-                    if (mt.contains(s))
+                    Vertex u, v;
+                    std::tie(u,v) = later.first;
+                    Vertex s = std::get<1>(later.second);
+
+                    if (trees[t].contains(s))
                         merge_edges.emplace_back(s,v);
                     else
                         merge_edges.emplace_back(u,s);
-                    discard.push_back(uv);
-                }
+                } else
+                    edges.append(kv);
             }
-            for (Edge e : discard)
-                map_erase(edges, e);
-            edges.insert(out_edges.begin(), out_edges.end());
+            edges.normalize([b,this](const ValueVertex& x, const ValueVertex& y) { return (b->*tmt).cmp(x,y); });
+            std::vector<Copy>().swap(copies);
+            for (int i = 0; i < in_size; ++i)
+                EdgeMap().swap(trees_edges[i]);
             dlog::prof >> "compute edges";
 
+            // merge in link order, so that for a shared vertex the first tree's node wins, as with two trees;
+            // merge keeps the largest vertex map in place and moves the nodes of the others into it
             trees[0].swap(b->*tmt);
-            reeber::merge(b->*tmt, trees[1], merge_edges);
+            reeber::merge(b->*tmt, trees, merge_edges);
 
             trees.clear();
-            LOG_SEV(debug) << "  trees merged: " << (b->*tmt).size();
+            LOG_SEV(debug) << "  trees merged: " << (b->*tmt).size() << " (from " << in_size << " trees)";
         }
 
         dlog::prof << "compute edge_vertices";
@@ -131,7 +216,7 @@ struct reeber::detail::MergeSparsify
 
         auto gid_gen    = gid_generator(b);
         int  gid        = srp.gid();
-        auto local_test = [&gid_gen,gid](Vertex u)  { return gid_gen(u) == gid; };
+        auto local_test = [&gid_gen,gid](Vertex u)  { return is_local(gid_gen, u, gid, 0); };
 
         if (in_size)
             reeber::sparsify(b->*tmt, [&edge_vertices, &local_test](Vertex u)
@@ -172,7 +257,9 @@ struct reeber::detail::MergeSparsify
 
 // "Resolve" outgoing edges stored as keys in edge_maps[target_gid]. For each
 // one, find its canonical representation (representatives in both blocks) as
-// well as the value and vertex through which the connection is made
+// well as the value and vertex through which the connection is made.
+// Edge maps are sorted by (u,v), so the relabeling sent to each neighbor comes out sorted by u
+// and is searched by the receiver; duplicates are combined by normalize(), keeping the lower saddle.
 template<class Block, class Vertex, class Value>
 void
 reeber::
@@ -181,8 +268,8 @@ resolve_edges(diy::Master&                            master,
               EdgeMaps<Vertex,Value> Block::*         edge_maps_)
 {
     using ValueVertex   = std::tuple<Value, Vertex>;
-    using RelabelMap    = std::unordered_map<Vertex, ValueVertex>;
-    using RelabelMaps   = std::unordered_map<int, RelabelMap>;
+    using Relabel       = std::vector<std::pair<Vertex, ValueVertex>>;      // sorted by vertex
+    using RelabelMaps   = std::unordered_map<int, Relabel>;
     using EdgeMap       = reeber::EdgeMap<Vertex,Value>;
 
     master.foreach([&](Block* b, const diy::Master::ProxyWithLink& cp)
@@ -190,6 +277,8 @@ resolve_edges(diy::Master&                            master,
         auto&   tmt         = b->*tmt_;
         auto&   edge_maps   = b->*edge_maps_;
 
+        auto    lower       = [&tmt](const ValueVertex& x, const ValueVertex& y) { return tmt.cmp(x,y); };
+
         size_t edge_count = 0;
 
         RelabelMaps relabel;
@@ -197,8 +286,10 @@ resolve_edges(diy::Master&                            master,
         {
             int   v_gid    = em_kv.first;
             auto& edge_map = em_kv.second;
+            auto& relabel_v = relabel[v_gid];
 
             EdgeMap new_edge_map;
+            new_edge_map.reserve(edge_map.size());
             for (auto& kv : edge_map)
             {
                 Vertex u,v;
@@ -208,17 +299,14 @@ resolve_edges(diy::Master&                            master,
                 auto  u_     = tmt.representative(u_node, u_node)->vertex;
                 Value f_u    = u_node->value;
 
-                ValueVertex uval { f_u, u };
-
                 ++edge_count;
 
-                relabel[v_gid][u] = ValueVertex{ f_u, u_ };
-                auto it = new_edge_map.find(std::tuple<Vertex, Vertex>{ u_, v });
-                if (it == new_edge_map.end())
-                    new_edge_map.emplace(std::make_tuple(u_, v), uval);
-                else if (tmt.cmp(uval, it->second))
-                    it->second = uval;
+                // edge_map is sorted by u, so the relabeling is too
+                if (relabel_v.empty() || relabel_v.back().first != u)
+                    relabel_v.emplace_back(u, ValueVertex{ f_u, u_ });
+                new_edge_map.append(std::make_tuple(u_, v), ValueVertex{ f_u, u });
             }
+            new_edge_map.normalize(lower);
             edge_map.swap(new_edge_map);
         }
 
@@ -241,6 +329,8 @@ resolve_edges(diy::Master&                            master,
         auto&   edge_maps   = b->*edge_maps_;
         auto&   edges       = edge_maps[cp.gid()];
 
+        auto    lower       = [&tmt](const ValueVertex& x, const ValueVertex& y) { return tmt.cmp(x,y); };
+
         size_t edge_count = cp.get<size_t>();
         cp.scratch(edge_count);
 
@@ -250,10 +340,11 @@ resolve_edges(diy::Master&                            master,
         {
             int target_gid = l->target(i).gid;
 
-            RelabelMap relabel;
+            Relabel relabel;
             cp.dequeue(target_gid, relabel);
 
             EdgeMap new_edges;
+            new_edges.reserve(edge_maps[target_gid].size());
             for (auto& kv : edge_maps[target_gid])
             {
                 Vertex u, u_, v, v_;
@@ -261,7 +352,13 @@ resolve_edges(diy::Master&                            master,
 
                 std::tie(u_, v)   = kv.first;
                 std::tie(f_u, u)  = kv.second;
-                std::tie(f_v, v_) = relabel[v];
+
+                ValueVertex v_relabel {};
+                auto it = std::lower_bound(relabel.begin(), relabel.end(), v,
+                                           [](const std::pair<Vertex, ValueVertex>& x, const Vertex& y) { return x.first < y; });
+                if (it != relabel.end() && it->first == v)
+                    v_relabel = it->second;
+                std::tie(f_v, v_) = v_relabel;
 
                 ValueVertex uval { f_u, u },
                             vval { f_v, v };
@@ -270,19 +367,15 @@ resolve_edges(diy::Master&                            master,
                 if (tmt.cmp(vval, uval))
                     std::swap(uval, vval);
 
-                auto u_v_ = std::make_tuple(u_,v_);
-                auto it = new_edges.find(u_v_);
-                if (it != new_edges.end())
-                {
-                    if (tmt.cmp(vval, it->second))
-                        it->second = vval;
-                } else
-                    new_edges[u_v_] = vval;
+                new_edges.append(std::make_tuple(u_,v_), vval);
             }
-            edge_maps[target_gid].clear();
-            edges.insert(new_edges.begin(), new_edges.end());
+            new_edges.normalize(lower);
+            EdgeMap().swap(edge_maps[target_gid]);
             new_edge_count += new_edges.size();
+            for (auto& kv : new_edges)
+                edges.append(kv);
         }
+        edges.normalize(lower);
 
         cp.all_reduce(new_edge_count, std::plus<size_t>());
     });
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <diy/serialization.hpp>
+
+#include "edges.h"
+
+namespace diy
+{
+
+// edges go out field by field, in the order of the map; the entries themselves have padding
+template<class Vertex, class Value>
+struct Serialization< ::reeber::SortedEdgeMap<Vertex, Value> >
+{
+    typedef     ::reeber::SortedEdgeMap<Vertex, Value>          EdgeMap;
+
+    static void save(BinaryBuffer& bb, const EdgeMap& em)
+    {
+        size_t s = em.size();
+        diy::save(bb, s);
+        for (const auto& kv : em)
+        {
+            diy::save(bb, std::get<0>(kv.first));
+            diy::save(bb, std::get<1>(kv.first));
+            diy::save(bb, std::get<0>(kv.second));
+            diy::save(bb, std::get<1>(kv.second));
+        }
+    }
+
+    static void load(BinaryBuffer& bb, EdgeMap& em)
+    {
+        size_t s;
+        diy::load(bb, s);
+        em.data().resize(s);
+        for (auto& kv : em)
+        {
+            diy::load(bb, std::get<0>(kv.first));
+            diy::load(bb, std::get<1>(kv.first));
+            diy::load(bb, std::get<0>(kv.second));
+            diy::load(bb, std::get<1>(kv.second));
+        }
+    }
+};
+
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
 #include "parallel-tbb.h"
 
 namespace reeber
@@ -31,8 +36,72 @@ namespace detail
     };
 }
 
+// Edges (u,v) -> (value, vertex), stored as a flat array sorted by (u,v).
+// Edges are appended in bulk with append() and then normalize()d: sorted and deduplicated,
+// so that matching, relabeling, and deduplication are linear passes over sorted runs instead of hash lookups.
+// find() is a binary search and is only valid on a normalized map; iteration gives kv.first = (u,v), kv.second = (value, vertex).
+template<class Vertex, class Value>
+class SortedEdgeMap
+{
+    public:
+        using Edge              = detail::Edge<Vertex>;
+        using ValueVertex       = std::tuple<Value, Vertex>;
+        using value_type        = std::pair<Edge, ValueVertex>;
+        using Container         = std::vector<value_type>;
+        using iterator          = typename Container::iterator;
+        using const_iterator    = typename Container::const_iterator;
+
+        iterator        begin()                                         { return edges_.begin(); }
+        iterator        end()                                           { return edges_.end(); }
+        const_iterator  begin() const                                   { return edges_.begin(); }
+        const_iterator  end() const                                     { return edges_.end(); }
+
+        size_t          size() const                                    { return edges_.size(); }
+        bool            empty() const                                   { return edges_.empty(); }
+        void            clear()                                         { edges_.clear(); }
+        void            reserve(size_t n)                               { edges_.reserve(n); }
+        void            swap(SortedEdgeMap& other)                      { edges_.swap(other.edges_); }
+
+        void            append(const Edge& e, const ValueVertex& vv)    { edges_.emplace_back(e, vv); }
+        void            append(const value_type& kv)                    { edges_.push_back(kv); }
+
+        // sort by (u,v) and keep one entry per edge; the one with the smallest ValueVertex w.r.t. less
+        // (for merge trees, less is the tree's cmp, so that duplicates keep the lower saddle)
+        template<class Less>
+        void            normalize(const Less& less)
+        {
+            std::sort(edges_.begin(), edges_.end(), [](const value_type& x, const value_type& y) { return x.first < y.first; });
+
+            auto out = edges_.begin();
+            for (auto it = edges_.begin(); it != edges_.end(); ++it)
+            {
+                if (out != edges_.begin() && std::prev(out)->first == it->first)
+                {
+                    if (less(it->second, std::prev(out)->second))
+                        std::prev(out)->second = it->second;
+                } else
+                    *out++ = *it;
+            }
+            edges_.erase(out, edges_.end());
+        }
+
+        iterator        find(const Edge& e)
+        {
+            auto it = std::lower_bound(edges_.begin(), edges_.end(), e, [](const value_type& x, const Edge& y) { return x.first < y; });
+            return (it != edges_.end() && it->first == e) ? it : edges_.end();
+        }
+
+        const_iterator  find(const Edge& e) const                       { return const_cast<SortedEdgeMap*>(this)->find(e); }
+
+        const Container&    data() const                                { return edges_; }
+        Container&          data()                                      { return edges_; }
+
+    private:
+        Container       edges_;
+};
+
 template<class Vertex, class Value>
-using EdgeMap = map<detail::Edge<Vertex>, std::tuple<Value, Vertex>, detail::edge_hash<Vertex>, detail::edge_equal<Vertex>>;
+using EdgeMap = SortedEdgeMap<Vertex, Value>;
 
 template<class Vertex, class Value>
 using EdgeMaps = map<int, EdgeMap<Vertex,Value>>;
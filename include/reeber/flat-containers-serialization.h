@@ -0,0 +1,62 @@
+#pragma once
+
+#include <diy/serialization.hpp>
+
+#include "flat-containers.h"
+
+namespace diy
+{
+
+// same layout as std::map: size, then (key, value) pairs
+template<class Key, class T, class Hash>
+struct Serialization< ::reeber::FlatHashMap<Key, T, Hash> >
+{
+    typedef     ::reeber::FlatHashMap<Key, T, Hash>             Map;
+
+    static void save(BinaryBuffer& bb, const Map& m)
+    {
+        size_t s = m.size();
+        diy::save(bb, s);
+        for (const auto& x : m)
+        {
+            diy::save(bb, x.first);
+            diy::save(bb, x.second);
+        }
+    }
+
+    static void load(BinaryBuffer& bb, Map& m)
+    {
+        size_t s;
+        diy::load(bb, s);
+        m.clear();
+        m.reserve(s);
+        for (size_t i = 0; i < s; ++i)
+        {
+            Key k;
+            diy::load(bb, k);
+            diy::load(bb, m[k]);
+        }
+    }
+};
+
+// same layout as std::set: size, then the elements in order
+template<class Key, class Compare>
+struct Serialization< ::reeber::SortedVectorSet<Key, Compare> >
+{
+    typedef     ::reeber::SortedVectorSet<Key, Compare>         Set;
+
+    static void save(BinaryBuffer& bb, const Set& s)
+    {
+        diy::save(bb, s.data());
+    }
+
+    static void load(BinaryBuffer& bb, Set& s)
+    {
+        std::vector<Key> data;
+        diy::load(bb, data);
+        s.clear();
+        s.insert(data.begin(), data.end());
+    }
+};
+
+}
@@ -0,0 +1,330 @@
+#ifndef REEBER_FLAT_CONTAINERS_H
+#define REEBER_FLAT_CONTAINERS_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace reeber
+{
+
+// Open-addressing hash map (linear probing, power-of-two capacity, tombstones on erase)
+// with the subset of the std::map interface the blocks use.
+// Elements live in one array, so there is no allocation per element.
+// Iteration order is unspecified; erasing does not move other elements,
+// so erase(iterator) can be used while iterating.
+// Keys and values must be default-constructible: free slots hold default values.
+template<class Key, class T, class Hash = std::hash<Key>>
+class FlatHashMap
+{
+    public:
+        using key_type      = Key;
+        using mapped_type   = T;
+        using value_type    = std::pair<Key, T>;
+        using size_type     = size_t;
+
+    private:
+        enum State : unsigned char { EMPTY = 0, FULL = 1, DELETED = 2 };
+
+        template<bool is_const>
+        class Iterator
+        {
+            public:
+                using Map               = typename std::conditional<is_const, const FlatHashMap, FlatHashMap>::type;
+                using iterator_category = std::forward_iterator_tag;
+                using value_type        = FlatHashMap::value_type;
+                using difference_type   = std::ptrdiff_t;
+                using reference         = typename std::conditional<is_const, const value_type&, value_type&>::type;
+                using pointer           = typename std::conditional<is_const, const value_type*, value_type*>::type;
+
+                            Iterator()                                      {}
+                            Iterator(Map* map, size_t i): map_(map), i_(i)  { skip(); }
+                // iterator -> const_iterator
+                template<bool c, class = typename std::enable_if<is_const and not c>::type>
+                            Iterator(const Iterator<c>& other): map_(other.map_), i_(other.i_)  {}
+
+                reference   operator*() const                               { return map_->slots_[i_]; }
+                pointer     operator->() const                              { return &map_->slots_[i_]; }
+
+                Iterator&   operator++()                                    { ++i_; skip(); return *this; }
+                Iterator    operator++(int)                                 { Iterator it = *this; ++(*this); return it; }
+
+                bool        operator==(const Iterator& other) const         { return i_ == other.i_; }
+                bool        operator!=(const Iterator& other) const         { return i_ != other.i_; }
+
+            private:
+                void        skip()                                          { while (i_ < map_->states_.size() and map_->states_[i_] != FULL) ++i_; }
+
+                Map*        map_ = nullptr;
+                size_t      i_ = 0;
+
+                friend class FlatHashMap;
+                template<bool> friend class Iterator;
+        };
+
+    public:
+        using iterator          = Iterator<false>;
+        using const_iterator    = Iterator<true>;
+
+                        FlatHashMap()                                       {}
+
+        template<class InputIterator>
+                        FlatHashMap(InputIterator first, InputIterator last){ insert(first, last); }
+
+        size_t          size() const                                        { return size_; }
+        bool            empty() const                                       { return size_ == 0; }
+        size_t          capacity() const                                    { return slots_.size(); }
+
+        iterator        begin()                                             { return iterator(this, 0); }
+        iterator        end()                                               { return iterator(this, slots_.size()); }
+        const_iterator  begin() const                                       { return const_iterator(this, 0); }
+        const_iterator  end() const                                         { return const_iterator(this, slots_.size()); }
+        const_iterator  cbegin() const                                      { return begin(); }
+        const_iterator  cend() const                                        { return end(); }
+
+        iterator        find(const Key& k)                                  { return iterator(this, find_slot(k)); }
+        const_iterator  find(const Key& k) const                            { return const_iterator(this, find_slot(k)); }
+        size_t          count(const Key& k) const                           { return find_slot(k) != slots_.size(); }
+
+        T&              at(const Key& k)
+        {
+            size_t i = find_slot(k);
+            if (i == slots_.size())
+                throw std::out_of_range("FlatHashMap::at");
+            return slots_[i].second;
+        }
+
+        const T&        at(const Key& k) const                              { return const_cast<FlatHashMap*>(this)->at(k); }
+
+        T&              operator[](const Key& k)                            { return slots_[insert_slot(k).first].second; }
+
+        std::pair<iterator, bool>
+                        insert(const value_type& x)
+        {
+            auto slot_inserted = insert_slot(x.first);
+            if (slot_inserted.second)
+                slots_[slot_inserted.first].second = x.second;
+            return { iterator(this, slot_inserted.first), slot_inserted.second };
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool>
+                        emplace(Args&&... args)                             { return insert(value_type(std::forward<Args>(args)...)); }
+
+        // existing keys are not overwritten, as in std::map
+        template<class InputIterator>
+        void            insert(InputIterator first, InputIterator last)
+        {
+            for (; first != last; ++first)
+                insert(*first);
+        }
+
+        iterator        erase(const_iterator it)
+        {
+            size_t i = it.i_;
+            states_[i] = DELETED;
+            slots_[i] = value_type();
+            --size_;
+            ++n_deleted_;
+            return iterator(this, i + 1);
+        }
+
+        size_t          erase(const Key& k)
+        {
+            size_t i = find_slot(k);
+            if (i == slots_.size())
+                return 0;
+            erase(const_iterator(this, i));
+            return 1;
+        }
+
+        void            clear()
+        {
+            slots_.clear();
+            states_.clear();
+            size_ = n_deleted_ = 0;
+        }
+
+        void            reserve(size_t n)
+        {
+            if (4 * n >= 3 * slots_.size())
+                rehash(n);
+        }
+
+        void            swap(FlatHashMap& other)
+        {
+            slots_.swap(other.slots_);
+            states_.swap(other.states_);
+            std::swap(size_, other.size_);
+            std::swap(n_deleted_, other.n_deleted_);
+        }
+
+    private:
+        // Fibonacci hashing: the high bits of the product, so that weak hashes (identity for ints) spread too
+        size_t          home(const Key& k) const                            { return (static_cast<std::uint64_t>(Hash()(k)) * 0x9E3779B97F4A7C15ull) >> shift_; }
+
+        size_t          find_slot(const Key& k) const
+        {
+            if (slots_.empty())
+                return 0;
+            size_t mask = slots_.size() - 1;
+            for (size_t i = home(k); ; i = (i + 1) & mask)
+            {
+                if (states_[i] == EMPTY)
+                    return slots_.size();
+                if (states_[i] == FULL and slots_[i].first == k)
+                    return i;
+            }
+        }
+
+        // slot of k, inserted with a default value if missing; second = true, if inserted
+        std::pair<size_t, bool>
+                        insert_slot(const Key& k)
+        {
+            size_t i = find_slot(k);
+            if (i != slots_.size())
+                return { i, false };
+
+            // keep at most 3/4 of the slots used (full or deleted)
+            if (4 * (size_ + n_deleted_ + 1) > 3 * slots_.size())
+                rehash(size_ + 1);
+
+            size_t mask = slots_.size() - 1;
+            for (i = home(k); states_[i] == FULL; i = (i + 1) & mask);
+
+            if (states_[i] == DELETED)
+                --n_deleted_;
+            states_[i] = FULL;
+            slots_[i].first = k;
+            ++size_;
+            return { i, true };
+        }
+
+        // capacity for n elements, drops tombstones
+        void            rehash(size_t n)
+        {
+            size_t capacity = 8;
+            unsigned log_capacity = 3;
+            while (4 * n > 3 * capacity)
+            {
+                capacity *= 2;
+                ++log_capacity;
+            }
+
+            std::vector<value_type>     old_slots(capacity);
+            std::vector<State>          old_states(capacity, EMPTY);
+            old_slots.swap(slots_);
+            old_states.swap(states_);
+            shift_ = 64 - log_capacity;
+            n_deleted_ = 0;
+
+            size_t mask = capacity - 1;
+            for (size_t j = 0; j < old_slots.size(); ++j)
+            {
+                if (old_states[j] != FULL)
+                    continue;
+                size_t i = home(old_slots[j].first);
+                while (states_[i] == FULL)
+                    i = (i + 1) & mask;
+                states_[i] = FULL;
+                slots_[i] = std::move(old_slots[j]);
+            }
+        }
+
+        std::vector<value_type>     slots_;
+        std::vector<State>          states_;
+        size_t                      size_ = 0;
+        size_t                      n_deleted_ = 0;
+        unsigned                    shift_ = 64;
+};
+
+
+// Set kept as a sorted vector: binary search lookups, ordered iteration like std::set,
+// no allocation per element. Inserting a new element shifts the tail,
+// so it is meant for sets that are looked up much more often than they grow.
+template<class Key, class Compare = std::less<Key>>
+class SortedVectorSet
+{
+    public:
+        using key_type          = Key;
+        using value_type        = Key;
+        using size_type         = size_t;
+        using const_iterator    = typename std::vector<Key>::const_iterator;
+        using iterator          = const_iterator;
+
+                        SortedVectorSet()                                   {}
+
+        template<class InputIterator>
+                        SortedVectorSet(InputIterator first, InputIterator last)    { insert(first, last); }
+
+        size_t          size() const                                        { return data_.size(); }
+        bool            empty() const                                       { return data_.empty(); }
+
+        const_iterator  begin() const                                       { return data_.begin(); }
+        const_iterator  end() const                                         { return data_.end(); }
+        const_iterator  cbegin() const                                      { return data_.begin(); }
+        const_iterator  cend() const                                        { return data_.end(); }
+
+        const_iterator  find(const Key& k) const
+        {
+            auto it = std::lower_bound(data_.begin(), data_.end(), k, Compare());
+            return (it != data_.end() and not Compare()(k, *it)) ? it : data_.end();
+        }
+
+        size_t          count(const Key& k) const                           { return find(k) != data_.end(); }
+
+        std::pair<const_iterator, bool>
+                        insert(const Key& k)
+        {
+            auto it = std::lower_bound(data_.begin(), data_.end(), k, Compare());
+            if (it != data_.end() and not Compare()(k, *it))
+                return { it, false };
+            return { data_.insert(it, k), true };
+        }
+
+        // for std::inserter
+        const_iterator  insert(const_iterator, const Key& k)                { return insert(k).first; }
+
+        // bulk insertion: append, sort, merge
+        template<class InputIterator>
+        void            insert(InputIterator first, InputIterator last)
+        {
+            size_t old_size = data_.size();
+            data_.insert(data_.end(), first, last);
+            std::sort(data_.begin() + old_size, data_.end(), Compare());
+            std::inplace_merge(data_.begin(), data_.begin() + old_size, data_.end(), Compare());
+            data_.erase(std::unique(data_.begin(), data_.end(),
+                                    [](const Key& a, const Key& b) { return not Compare()(a, b) and not Compare()(b, a); }),
+                        data_.end());
+        }
+
+        size_t          erase(const Key& k)
+        {
+            auto it = find(k);
+            if (it == data_.end())
+                return 0;
+            data_.erase(it);
+            return 1;
+        }
+
+        void            clear()                                             { data_.clear(); }
+        void            reserve(size_t n)                                   { data_.reserve(n); }
+        void            swap(SortedVectorSet& other)                        { data_.swap(other.data_); }
+
+        bool            operator==(const SortedVectorSet& other) const      { return data_ == other.data_; }
+        bool            operator!=(const SortedVectorSet& other) const      { return data_ != other.data_; }
+
+        const std::vector<Key>&
+                        data() const                                        { return data_; }
+
+    private:
+        std::vector<Key>    data_;
+};
+
+}
+
+#endif
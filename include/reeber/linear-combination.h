@@ -0,0 +1,115 @@
+#ifndef REEBER_LINEAR_COMBINATION_H
+#define REEBER_LINEAR_COMBINATION_H
+
+#include <vector>
+#include <stdexcept>
+
+#include "grid.h"
+
+namespace reeber {
+
+    // Function over a grid, given as a linear combination of several grids
+    // of the same shape and layout: f(i) = sum_k coefficients[k] * grids[k](i).
+    // Values are computed on the fly, so the combined field is never stored.
+    // Indexing interface matches GridRef, so it can be used as Function in compute_merge_tree2
+    // and wherever a block looks up values of its field.
+    template<class T, unsigned D>
+    class LinearCombination
+    {
+    public:
+        using Value = T;
+        using GridRef = ::reeber::GridRef<T, D>;
+        using Vertex = typename GridRef::Vertex;
+        using Index = size_t;
+
+        LinearCombination() {}
+
+        // single grid, coefficient 1
+        LinearCombination(const GridRef& grid) :
+                LinearCombination(std::vector<GridRef> { grid })
+        {
+        }
+
+        // all coefficients are 1, if none are given
+        LinearCombination(const std::vector<GridRef>& grids, const std::vector<T>& coefficients = {}) :
+                grids_(grids),
+                coefficients_(coefficients.empty() ? std::vector<T>(grids.size(), T(1)) : coefficients),
+                index_(nullptr, grids.empty() ? Vertex::zero() : grids[0].shape(), grids.empty() or grids[0].c_order())
+        {
+            if (grids_.empty())
+                throw std::runtime_error("LinearCombination: no grids");
+
+            if (coefficients_.size() != grids_.size())
+                throw std::runtime_error("LinearCombination: number of coefficients does not match number of grids");
+
+            for(const GridRef& g : grids_)
+            {
+                if (g.shape() != grids_[0].shape() or g.c_order() != grids_[0].c_order())
+                    throw std::runtime_error("LinearCombination: grids must have same shape and order");
+                data_.push_back(g.data());
+            }
+
+            is_single_ = (grids_.size() == 1 and coefficients_[0] == T(1));
+        }
+
+        T operator()(Index i) const
+        {
+            if (is_single_)
+                return data_[0][i];
+
+            T result = 0;
+            for(size_t k = 0; k < data_.size(); ++k)
+                result += coefficients_[k] * data_[k][i];
+            return result;
+        }
+
+        T operator()(const Vertex& v) const
+        {
+            return operator()(index(v));
+        }
+
+        // evaluate the function at linear indices [from, from + n) into out,
+        // grid by grid, so that every pass is a contiguous, vectorizable loop
+        void evaluate(Index from, size_t n, T* out) const
+        {
+            const T* src = data_[0] + from;
+            T c = coefficients_[0];
+            for(size_t i = 0; i < n; ++i)
+                out[i] = c * src[i];
+
+            for(size_t k = 1; k < data_.size(); ++k)
+            {
+                src = data_[k] + from;
+                c = coefficients_[k];
+                for(size_t i = 0; i < n; ++i)
+                    out[i] += c * src[i];
+            }
+        }
+
+        Index index(const Vertex& v) const { return index_.index(v); }
+
+        Vertex vertex(Index i) const { return index_.vertex(i); }
+
+        Vertex shape() const { return index_.shape(); }
+
+        size_t size() const { return index_.size(); }
+
+        bool c_order() const { return index_.c_order(); }
+
+        size_t n_grids() const { return grids_.size(); }
+
+        const GridRef& grid(size_t k) const { return grids_[k]; }
+
+        T coefficient(size_t k) const { return coefficients_[k]; }
+
+    private:
+        std::vector<GridRef> grids_;
+        std::vector<T> coefficients_;
+        std::vector<const T*> data_;
+        ::reeber::GridRef<void*, D> index_ { nullptr, Vertex::zero() };
+        bool is_single_ { false };
+    };
+
+}
+
+#endif
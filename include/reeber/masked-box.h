@@ -12,6 +12,7 @@
 #include "format.h"
 
 #include "grid.h"
+#include "packed-mask.h"
 #include "box.h"
 #include "vertices.h"
 
@@ -24,7 +25,8 @@ namespace reeber {
     {
     public:
         using MaskValue = int;   // type of single cell in mask
-        using MaskType = Grid<MaskValue, D>;
+        using MaskType = Grid<MaskValue, D>;                // unpacked mask, see mask_grid()
+        using PackedMaskType = PackedMask<D>;               // 3 bits per cell + sparse table of owner gids
         using Position = typename MaskType::Vertex;
         using NewDynamicPoint = diy::DynamicPoint<int, D>;
 
@@ -40,6 +42,9 @@ namespace reeber {
         static constexpr MaskValue UNINIT = -4;
         // if wrap is false, then some mask cells don't correspond to any domain cells
         static constexpr MaskValue NOT_IN_DOMAIN = -5;
+        static_assert(PackedMaskType::LOW == -LOW and PackedMaskType::GHOST == -GHOST and PackedMaskType::ACTIVE == -ACTIVE and
+                      PackedMaskType::UNINIT == -UNINIT and PackedMaskType::NOT_IN_DOMAIN == -NOT_IN_DOMAIN,
+                      "special mask values must match the packed mask states");
         class FreudenthalLinkIterator;
 
         using FreudenthalLinkRange = range::iterator_range<FreudenthalLinkIterator>;
@@ -59,10 +64,24 @@ namespace reeber {
                   int _level,
                   int _gid,
                   bool c_order) :
-                core_from_( point_from_dynamic_point<D>(core_from)),
-                core_to_(point_from_dynamic_point<D>(core_to)),
-                bounds_from_(point_from_dynamic_point<D>(bounds_from)),
-                bounds_to_(point_from_dynamic_point<D>(bounds_to)),
+                MaskedBox(point_from_dynamic_point<D>(core_from), point_from_dynamic_point<D>(core_to),
+                          point_from_dynamic_point<D>(bounds_from), point_from_dynamic_point<D>(bounds_to),
+                          _ref, _level, _gid, c_order)
+        {
+        }
+
+        MaskedBox(const Position& core_from,
+                  const Position& core_to,
+                  const Position& bounds_from,
+                  const Position& bounds_to,
+                  int _ref,
+                  int _level,
+                  int _gid,
+                  bool c_order) :
+                core_from_(core_from),
+                core_to_(core_to),
+                bounds_from_(bounds_from),
+                bounds_to_(bounds_to),
                 local_box_(nullptr, bounds_to_ - bounds_from_ + Position::one(), c_order),
                 mask_from_(core_from_ - Position::one()),
                 mask_to_(core_to_ + Position::one()),
@@ -137,6 +156,21 @@ namespace reeber {
                    | range::filtered(std::bind(&MaskedBox::is_active_global, this, std::placeholders::_1));
         }
 
+        /**
+         *
+         * @param x first global coordinate, between core_from[0] and core_to[0]
+         * @return active core vertices with first coordinate x, as points in global coordinates;
+         * in the order of active_global_positions, so slabs can be processed separately and concatenated
+         */
+        decltype(auto) active_global_positions_in_slab(int x) const
+        {
+            Position slab_from = core_from_;
+            Position slab_to = core_to_;
+            slab_from[0] = slab_to[0] = x;
+            return range::iterator_range<VI>(VI::begin(slab_from, slab_to), VI::end(slab_from, slab_to))
+                   | range::filtered(std::bind(&MaskedBox::is_active_global, this, std::placeholders::_1));
+        }
+
         /**
          *
          * @param v AmrVertexId: index of a cell
@@ -208,7 +242,21 @@ namespace reeber {
          */
         void set_mask(const Position& p_mask, MaskValue value)
         {
-            mask_(p_mask) = value;
+            mask_.set(p_mask, value);
+        }
+
+        /**
+         *
+         * @param f f(p_mask, counts) returns the new mask value of cell p_mask; it may read the mask of p_mask only
+         * @return sum of counts over all cells
+         * cells are processed in parallel with TBB, see PackedMask::transform
+         */
+        template<class Counts, class F>
+        Counts transform_mask(const F& f)
+        {
+            return mask_.template transform<Counts>([this, &f](typename PackedMaskType::Index i, Counts& counts) {
+                return f(mask_.vertex(i), counts);
+            });
         }
 
         /**
@@ -229,11 +277,22 @@ namespace reeber {
             return mask_(p_mask);
         }
 
-        const MaskType& mask_grid() const
+        // materializes the full int grid, for tests and debug output only
+        MaskType mask_grid() const
+        {
+            return mask_.unpack();
+        }
+
+        const PackedMaskType& packed_mask() const
         {
             return mask_;
         }
 
+        bool c_order() const
+        {
+            return mask_.c_order();
+        }
+
 
         /**
          *
@@ -251,6 +310,8 @@ namespace reeber {
             return false;
         }
 
+        Position core_from() const { return core_from_; }
+
         Position bounds_from() const { return bounds_from_; }
 
         Position mask_from() const { return mask_from_; }
@@ -468,7 +529,7 @@ namespace reeber {
          */
         bool is_active_global(const Position& p_global) const
         {
-            return mask_(mask_position_from_global(p_global)) == ACTIVE;
+            return mask_.state(mask_position_from_global(p_global)) == PackedMaskType::ACTIVE;
         }
 
         /**
@@ -482,7 +543,7 @@ namespace reeber {
             if (not is_valid_mask_position(p_mask))
                 return false;
             else
-                return mask(p_mask) == ACTIVE;
+                return mask_.state(p_mask) == PackedMaskType::ACTIVE;
         }
 
         /**
@@ -492,7 +553,7 @@ namespace reeber {
          */
         bool is_active_index(const Vertex& v) const
         {
-            return mask_(mask_position(v)) == ACTIVE;
+            return mask_.state(mask_position(v)) == PackedMaskType::ACTIVE;
         }
 
         /**
@@ -515,7 +576,8 @@ namespace reeber {
             }
 #endif
 
-            return mask_(p_mask) != ACTIVE and mask_(p_mask) != LOW;
+            auto s = mask_.state(p_mask);
+            return s != PackedMaskType::ACTIVE and s != PackedMaskType::LOW;
         }
 
         bool is_valid_mask_position(const Position& p_mask) const
@@ -561,7 +623,7 @@ namespace reeber {
         const Position mask_shape_;
         const Position ghost_adjustment_;
         const Position mask_adjustment_;
-        MaskType mask_;
+        PackedMaskType mask_;
         const int refinement_ { 0 };
         const int level_ { -1 };
         const int gid_ { -1 };
@@ -0,0 +1,234 @@
+#ifndef REEBER_PACKED_MASK_H
+#define REEBER_PACKED_MASK_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "grid.h"
+#include "parallel-tbb.h"
+
+namespace reeber {
+
+    // Mask grid that stores 3 bits of state per cell instead of a full int;
+    // cells that are owned by some other block keep their gid in a sparse side table.
+    // Values are exchanged with the caller as ints with the same encoding as MaskedBox:
+    // negative special values or the gid (>= 0) of the owner.
+    template<unsigned D>
+    class PackedMask
+    {
+    public:
+        using Value = int;
+        using Word = std::uint64_t;
+        using State = std::uint8_t;
+        using Index = size_t;
+        using Unpacked = Grid<Value, D>;
+        using Position = typename Unpacked::Vertex;
+
+        // cell states, must fit into bits_per_cell bits
+        static constexpr State OWNED = 0;             // value is stored in the side table
+        static constexpr State LOW = 1;
+        static constexpr State GHOST = 2;
+        static constexpr State ACTIVE = 3;
+        static constexpr State UNINIT = 4;
+        static constexpr State NOT_IN_DOMAIN = 5;
+
+        static constexpr unsigned bits_per_cell = 3;
+        static constexpr unsigned cells_per_word = 64 / bits_per_cell;     // 21 cells, no cell straddles two words
+        static constexpr Word state_mask = (Word(1) << bits_per_cell) - 1;
+
+        PackedMask() {}
+
+        PackedMask(const Position& shape, bool c_order = true) :
+                shape_(shape),
+                c_order_(c_order)
+        {
+            set_stride();
+            words_.resize((size_ + cells_per_word - 1) / cells_per_word, 0);
+        }
+
+        // encoding of the special (negative) values, -1 .. -5, as states and back
+        static State state_from_value(Value v) { return v >= 0 ? OWNED : static_cast<State>(-v); }
+
+        static Value value_from_state(State s) { return -static_cast<Value>(s); }
+
+        State state(Index i) const
+        {
+            return static_cast<State>((words_[i / cells_per_word] >> (bits_per_cell * (i % cells_per_word))) & state_mask);
+        }
+
+        State state(const Position& p) const { return state(index(p)); }
+
+        Value operator()(Index i) const
+        {
+            State s = state(i);
+            if (s != OWNED)
+                return value_from_state(s);
+            return owners_.at(i);
+        }
+
+        Value operator()(const Position& p) const { return operator()(index(p)); }
+
+        void set(Index i, Value v)
+        {
+            State s = state_from_value(v);
+            set_state(i, s);
+            if (s == OWNED)
+                owners_[i] = v;
+            else
+                owners_.erase(i);
+        }
+
+        void set(const Position& p, Value v) { set(index(p), v); }
+
+        // set every cell i to f(i, counts) and return the sum of counts over all cells;
+        // f may read the value of cell i, but no other cell.
+        // Cells are handed out in runs of whole words (in parallel, with TBB), so no two tasks write one word;
+        // changes to the owner table are collected per run and applied at the end.
+        // Counts are kept per run and summed in run order, so floating-point members
+        // get the same value regardless of how the runs are scheduled.
+        template<class Counts, class F>
+        Counts transform(const F& f)
+        {
+            const Index run_size = words_per_run * cells_per_word;
+            const size_t n_runs = (size_ + run_size - 1) / run_size;
+
+            std::vector<std::vector<std::pair<Index, Value>>> owner_changes(n_runs);
+            std::vector<Counts> run_counts(n_runs);
+
+            for_each(0, n_runs, [&](size_t r)
+            {
+                Counts& counts = run_counts[r];
+                Index to = std::min(size_, (r + 1) * run_size);
+                for (Index i = r * run_size; i < to; ++i)
+                {
+                    State old_s = state(i);
+                    Value v = f(i, counts);
+                    State s = state_from_value(v);
+                    set_state(i, s);
+                    if ((s == OWNED and (old_s != OWNED or owners_.at(i) != v)) or (s != OWNED and old_s == OWNED))
+                        owner_changes[r].emplace_back(i, v);
+                }
+            });
+
+            Counts result {};
+            for (const Counts& counts : run_counts)
+                result += counts;
+
+            for (const auto& changes : owner_changes)
+                for (const auto& iv : changes)
+                {
+                    if (state_from_value(iv.second) == OWNED)
+                        owners_[iv.first] = iv.second;
+                    else
+                        owners_.erase(iv.first);
+                }
+
+            return result;
+        }
+
+        // number of cells in state s; works word-by-word on the packed representation
+        size_t count(State s) const
+        {
+            size_t result = 0;
+            for (size_t k = 0; k < words_.size(); ++k)
+            {
+                Word w = words_[k];
+                unsigned n_cells = (k + 1 == words_.size()) ? size_ - k * cells_per_word : cells_per_word;
+                for (unsigned j = 0; j < n_cells; ++j)
+                    result += (((w >> (bits_per_cell * j)) & state_mask) == s);
+            }
+            return result;
+        }
+
+        Index index(const Position& p) const
+        {
+            Index result = 0;
+            for (unsigned i = 0; i < D; ++i)
+                result += p[i] * stride_[i];
+            return result;
+        }
+
+        Position vertex(Index idx) const
+        {
+            Position p;
+            if (c_order_)
+                for (unsigned i = 0; i < D; ++i) { p[i] = idx / stride_[i]; idx %= stride_[i]; }
+            else
+                for (int i = D - 1; i >= 0; --i) { p[i] = idx / stride_[i]; idx %= stride_[i]; }
+            return p;
+        }
+
+        Position shape() const { return shape_; }
+
+        size_t size() const { return size_; }
+
+        bool c_order() const { return c_order_; }
+
+        size_t n_owned() const { return owners_.size(); }
+
+        // approximate memory footprint in bytes, for stats
+        size_t bytes() const
+        {
+            return words_.size() * sizeof(Word) + owners_.size() * (sizeof(Index) + sizeof(Value) + 2 * sizeof(void*));
+        }
+
+        // full int grid, for tests and debug output
+        Unpacked unpack() const
+        {
+            Unpacked result(shape(), c_order());
+            for (Index i = 0; i < size(); ++i)
+                result(vertex(i)) = operator()(i);
+            return result;
+        }
+
+        void swap(PackedMask& other)
+        {
+            std::swap(shape_, other.shape_);
+            std::swap(stride_, other.stride_);
+            std::swap(size_, other.size_);
+            std::swap(c_order_, other.c_order_);
+            words_.swap(other.words_);
+            owners_.swap(other.owners_);
+        }
+
+        bool operator==(const PackedMask& other) const
+        {
+            return shape() == other.shape() and c_order() == other.c_order() and words_ == other.words_ and owners_ == other.owners_;
+        }
+
+        bool operator!=(const PackedMask& other) const { return not(*this == other); }
+
+    private:
+        static constexpr size_t words_per_run = 64;          // cells per task in transform: 64 * cells_per_word
+
+        void set_state(Index i, State s)
+        {
+            Word& w = words_[i / cells_per_word];
+            unsigned shift = bits_per_cell * (i % cells_per_word);
+            w = (w & ~(state_mask << shift)) | (static_cast<Word>(s) << shift);
+        }
+
+        void set_stride()
+        {
+            Index cur = 1;
+            if (c_order_)
+                for (unsigned i = D; i > 0; --i) { stride_[i - 1] = cur; cur *= shape_[i - 1]; }
+            else
+                for (unsigned i = 0; i < D; ++i) { stride_[i] = cur; cur *= shape_[i]; }
+            size_ = cur;
+        }
+
+        Position shape_ { Position::zero() };
+        Position stride_ { Position::zero() };
+        size_t size_ { 0 };
+        bool c_order_ { true };
+        std::vector<Word> words_;
+        std::unordered_map<Index, Value> owners_;
+    };
+
+}
+
+#endif
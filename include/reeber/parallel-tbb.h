@@ -60,6 +60,9 @@ namespace reeber
     typename map<Key, T, H, KE, A>::iterator
     map_erase(map<Key, T, H, KE, A>& m, typename map<Key, T, H, KE, A>::const_iterator it)  { return m.unsafe_erase(it); }
 
+    template<class Key, class T, class H, class KE, class A>
+    void map_reserve(map<Key, T, H, KE, A>& m, size_t n)                                { m.rehash(static_cast<size_t>(n / m.max_load_factor()) + 1); }
+
     // set
     template<class Key,
              class Hash = std::hash<Key>,
@@ -135,6 +138,9 @@ namespace reeber
     typename map<Key, T, H, KE, A>::iterator
     map_erase(map<Key, T, H, KE, A>& m, typename map<Key, T, H, KE, A>::const_iterator it)  { return m.erase(it); }
 
+    template<class Key, class T, class H, class KE, class A>
+    void map_reserve(map<Key, T, H, KE, A>& m, size_t n)                                { m.reserve(n); }
+
     // set
     template<class Key,
              class Hash = std::hash<Key>,
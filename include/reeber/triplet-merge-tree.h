@@ -99,6 +99,11 @@ class TripletMergeTree
 
         void        swap(TripletMergeTree& other)       { std::swap(negate_, other.negate_); nodes_.swap(other.nodes_); }
 
+        // take over the nodes of other (other is left empty); the nodes themselves stay where they are,
+        // only their entries move, and only from the smaller of the two vertex maps into the larger one;
+        // for a vertex that both trees have, our node wins
+        void        splice(TripletMergeTree& other);
+
         bool        negate() const                      { return negate_; }
         void        set_negate(bool negate)             { negate_ = negate; }
 
@@ -121,6 +126,9 @@ class TripletMergeTree
     private:
         VertexNeighborMap& nodes()                      { return nodes_; }
 
+        // move the entries of other into our map; overwrite: for a vertex in both maps, the node of other wins
+        void        splice_nodes(TripletMergeTree& other, bool overwrite);
+
         template<class Vert, class Val, class T, class F>
         friend void
         compute_merge_tree(TripletMergeTree<Vert, Val>& mt, const T& t, const F& f);
@@ -161,6 +169,10 @@ class TripletMergeTree
         friend void
         merge(TripletMergeTree<Vert, Val>& mt1, TripletMergeTree<Vert, Val>& mt2, const E& edges, bool ignore_missing_edges);
 
+        template<class Vert, class Val, class E>
+        friend void
+        merge(TripletMergeTree<Vert, Val>& mt, std::vector<TripletMergeTree<Vert, Val>>& trees, const E& edges, bool ignore_missing_edges);
+
     private:
         bool                        negate_;
         VertexNeighborMap           nodes_;
@@ -199,6 +211,10 @@ representative(TripletMergeTree<Vertex, Value>& mt, typename TripletMergeTree<Ve
 template<class Vertex, class Value, class Edges>
 void merge(TripletMergeTree<Vertex, Value>& mt1, TripletMergeTree<Vertex, Value>& mt2, const Edges& edges, bool ignore_missing_edges = false);
 
+// k-way version: moves the nodes of all trees into mt, connects them along edges, repairs once; trees are left empty
+template<class Vertex, class Value, class Edges>
+void merge(TripletMergeTree<Vertex, Value>& mt, std::vector<TripletMergeTree<Vertex, Value>>& trees, const Edges& edges, bool ignore_missing_edges = false);
+
 template<class Vertex, class Value, class Special>
 set<Vertex>
 sparsify_keep(TripletMergeTree<Vertex, Value>& mt, const Special& special);
@@ -412,6 +412,35 @@ merge(Neighbor u, Neighbor v)
         merge(u, u, v);
 }
 
+template<class Vertex, class Value>
+void
+reeber::TripletMergeTree<Vertex, Value>::
+splice(TripletMergeTree& other)
+{
+    // if the maps are swapped, our old entries are the ones moved in, and they overwrite
+    bool swapped = other.nodes_.size() > nodes_.size();
+    if (swapped)
+        nodes_.swap(other.nodes_);
+
+    splice_nodes(other, swapped);
+}
+
+template<class Vertex, class Value>
+void
+reeber::TripletMergeTree<Vertex, Value>::
+splice_nodes(TripletMergeTree& other, bool overwrite)
+{
+    if (other.nodes_.empty())
+        return;
+
+    map_reserve(nodes_, nodes_.size() + other.nodes_.size());
+    if (overwrite)
+        for_each_range(other.nodes_, [this](const typename VertexNeighborMap::value_type& x) { nodes_[x.first] = x.second; });
+    else
+        for_each_range(other.nodes_, [this](const typename VertexNeighborMap::value_type& x) { nodes_.insert(x); });
+    VertexNeighborMap().swap(other.nodes_);
+}
+
 template<class Vertex, class Value, class Edges>
 void
 reeber::merge(TripletMergeTree<Vertex, Value>& mt1, TripletMergeTree<Vertex, Value>& mt2, const Edges& edges,
@@ -419,8 +448,7 @@ reeber::merge(TripletMergeTree<Vertex, Value>& mt1, TripletMergeTree<Vertex, Val
 {
     dlog::prof << "merge";
 
-    mt1.nodes_.insert(mt2.nodes().begin(), mt2.nodes().end());
-    mt2.nodes_.clear();
+    mt1.splice(mt2);
 
     for_each(0, edges.size(), [&](size_t i)
     {
@@ -435,6 +463,57 @@ reeber::merge(TripletMergeTree<Vertex, Value>& mt1, TripletMergeTree<Vertex, Val
     dlog::prof >> "merge";
 }
 
+template<class Vertex, class Value, class Edges>
+void
+reeber::merge(TripletMergeTree<Vertex, Value>& mt, std::vector<TripletMergeTree<Vertex, Value>>& trees, const Edges& edges,
+              bool ignore_missing_edges)
+{
+    dlog::prof << "merge";
+
+    // keep the largest vertex map in place and extend it once, instead of rehashing it as it grows
+    size_t total = mt.nodes_.size();
+    size_t largest = trees.size();          // trees.size(): the map of mt
+    size_t largest_size = mt.nodes_.size();
+    for (size_t i = 0; i < trees.size(); ++i)
+    {
+        total += trees[i].nodes_.size();
+        if (trees[i].nodes_.size() > largest_size)
+        {
+            largest = i;
+            largest_size = trees[i].nodes_.size();
+        }
+    }
+    if (largest != trees.size())
+        mt.nodes_.swap(trees[largest].nodes_);
+    map_reserve(mt.nodes_, total);
+
+    // for a vertex in several trees, the node of the first one wins (mt, then trees in order), as in merge(mt1, mt2):
+    // the trees that come before the largest one overwrite its entries, from the last to the first one,
+    // the trees after it only add new entries
+    size_t first_after = 0;
+    if (largest != trees.size())
+    {
+        for (size_t i = largest; i > 0; --i)
+            mt.splice_nodes(trees[i - 1], true);
+        mt.splice_nodes(trees[largest], true);      // the old entries of mt
+        first_after = largest + 1;
+    }
+    for (size_t i = first_after; i < trees.size(); ++i)
+        mt.splice_nodes(trees[i], false);
+
+    for_each(0, edges.size(), [&](size_t i)
+    {
+        Vertex a, b;
+        std::tie(a, b) = edges[i];
+        if (!ignore_missing_edges || (mt.contains(a) && mt.contains(b)))
+            mt.merge(mt[a], mt[b]);
+    });
+
+    repair(mt);
+
+    dlog::prof >> "merge";
+}
+
 
 template<class Vertex, class Value, class Functor>
 void